@@ -0,0 +1,55 @@
+#-------------------------------------------------
+#
+# benchmark of package build, install and read throughput
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
+
+TARGET = gmpackagebench
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    gmpackagebenchmark.cpp \
+    ../gmpackagebuilder.cpp \
+    ../gmpackageinstaller.cpp \
+    ../gmpackagemanager.cpp \
+    ../gmpackagefileindex.cpp \
+    ../gmpackagefilewriter.cpp \
+    ../gmpackagesparsemap.cpp \
+    ../gmpackagefilehandle.cpp \
+    ../gmpackageentrydevice.cpp \
+    ../gmpackagereader.cpp \
+    ../gmpackagedictionary.cpp \
+    ../gmpackagedirscanner.cpp \
+    ../gmpackagemanifest.cpp \
+    ../gmpackagecipher.cpp \
+    ../gmpackagestatistics.cpp \
+    ../gmpackageprogress.cpp
+
+HEADERS += \
+    gmpackagebenchmark.h \
+    ../gmpackagebuilder.h \
+    ../gmpackageinstaller.h \
+    ../gmpackagemanager.h \
+    ../gmpackagefileindex.h \
+    ../gmpackagefilewriter.h \
+    ../gmpackagesparsemap.h \
+    ../gmpackagefilehandle.h \
+    ../gmpackageentrydevice.h \
+    ../gmpackagereader.h \
+    ../gmpackagedictionary.h \
+    ../gmpackagedirscanner.h \
+    ../gmpackagemanifest.h \
+    ../gmpackagecipher.h \
+    ../gmpackagestatistics.h \
+    ../gmpackageprogress.h
+
+LIBS += -lz
@@ -0,0 +1,362 @@
+#include "gmpackagebenchmark.h"
+
+#include "gmpackagebuilder.h"
+#include "gmpackageinstaller.h"
+#include "gmpackagemanager.h"
+#include "gmpackagereader.h"
+#include "gmpackagecipher.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+
+#include <string.h>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+// words of compressible text data
+static const char *TextWords[] = {
+    "package", "file", "data", "block", "install", "build", "compress", "index", "volume", "solid",
+    "position", "length", "checksum", "manifest", "reader", "thread", "read", "write", "size", "name",
+    "{", "}", "(", ")", ";", "=", "0", "1", "return", "if", "for", "int", "qint64", "const", "void"
+};
+static const int TextWordCount = sizeof (TextWords) / sizeof (TextWords[0]);
+
+GmPackageBenchmark::GmPackageBenchmark(const QString & workDirName, QTextStream & out)
+    : m_workDirName(workDirName), m_out(out)
+{
+    m_scale = 1.0;
+    m_randomReadCount = 2000;
+    m_cleanFlag = true;
+    m_randomState = 0x12345678;
+}
+
+void GmPackageBenchmark::setScale(double scale)
+{
+    m_scale = (scale > 0) ? scale : 1.0;
+}
+
+void GmPackageBenchmark::setRandomReadCount(int randomReadCount)
+{
+    m_randomReadCount = (randomReadCount > 0) ? randomReadCount : 0;
+}
+
+void GmPackageBenchmark::setCleanFlag(bool cleanFlag)
+{
+    m_cleanFlag = cleanFlag;
+}
+
+const QStringList & GmPackageBenchmark::getErrorMessage() const
+{
+    return m_errorMessageList;
+}
+
+bool GmPackageBenchmark::run()
+{
+    m_errorMessageList.clear();
+    QDir workDir(m_workDirName);
+    if (!workDir.mkpath("trees") || !workDir.mkpath("packages") || !workDir.mkpath("install")) {
+        m_errorMessageList.append(QString("Creates work dir %1 failure.").arg(m_workDirName));
+        return false;
+    }
+
+    runCipher();
+
+    QElapsedTimer timer;
+    QString treeNames[] = { "small", "huge", "mixed", "append" };
+    qint64 treeBytes[4];
+    int treeFileNumbers[4];
+    for (int i = 0; i < 4; i++) {
+        QString dirName = workDir.absoluteFilePath("trees/" + treeNames[i]);
+        removeDir(dirName);
+        timer.start();
+        if (i == 0) treeBytes[i] = generateSmallTree(dirName, treeFileNumbers[i]);
+        else if (i == 1) treeBytes[i] = generateHugeTree(dirName, treeFileNumbers[i]);
+        else if (i == 2) treeBytes[i] = generateMixedTree(dirName, treeFileNumbers[i]);
+        else treeBytes[i] = generateAppendTree(dirName, treeFileNumbers[i]);
+        if (treeBytes[i] < 0) return false;
+        writeResult(treeNames[i], "generate", timer.nsecsElapsed() / 1e9, treeBytes[i], treeFileNumbers[i]);
+    }
+
+    // package appended to packages of other trees
+    QString appendPackageFilename = workDir.absoluteFilePath("packages/append.lop");
+    QStringList appendFileList;
+    GmPackageBuilder::getFileList(workDir.absoluteFilePath("trees/append"), appendFileList);
+    GmPackageBuilder appendBuilder(workDir.absoluteFilePath("trees/append"), appendFileList);
+    if (!appendBuilder.buildPackage(appendPackageFilename)) {
+        m_errorMessageList.append(appendBuilder.getErrorMessage());
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < 3; i++) {
+        if (!runTree(treeNames[i], treeBytes[i], treeFileNumbers[i])) ok = false;
+    }
+
+    if (m_cleanFlag) {
+        removeDir(workDir.absoluteFilePath("trees"));
+        removeDir(workDir.absoluteFilePath("packages"));
+        removeDir(workDir.absoluteFilePath("install"));
+    }
+    return ok;
+}
+
+bool GmPackageBenchmark::runTree(const QString & treeName, qint64 treeBytes, int treeFileNumber)
+{
+    QDir workDir(m_workDirName);
+    QString sourceDirName = workDir.absoluteFilePath("trees/" + treeName);
+    QString packageFilename = workDir.absoluteFilePath("packages/" + treeName + ".lop");
+    QString installDirName = workDir.absoluteFilePath("install/" + treeName);
+    QElapsedTimer timer;
+
+    // build
+    timer.start();
+    QStringList fileList;
+    GmPackageBuilder::getFileList(sourceDirName, fileList);
+    GmPackageBuilder builder(sourceDirName, fileList);
+    bool ok = builder.buildPackage(packageFilename);
+    if (!ok) {
+        m_errorMessageList.append(builder.getErrorMessage());
+        return false;
+    }
+    writeResult(treeName, "build", timer.nsecsElapsed() / 1e9, treeBytes, treeFileNumber);
+    qint64 packageSize = QFileInfo(packageFilename).size();
+
+    // open, load file information
+    timer.start();
+    GmPackageManager lopm;
+    ok = lopm.load(packageFilename);
+    if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
+        return false;
+    }
+    writeResult(treeName, "open", timer.nsecsElapsed() / 1e9, packageSize, lopm.getFileNumber());
+
+    // install
+    removeDir(installDirName);
+    QDir().mkpath(installDirName);
+    timer.start();
+    GmPackageInstaller installer(installDirName);
+    ok = installer.installPackage(packageFilename);
+    if (!ok) {
+        m_errorMessageList.append(installer.getErrorMessage());
+        return false;
+    }
+    writeResult(treeName, "install", timer.nsecsElapsed() / 1e9, treeBytes, treeFileNumber);
+    removeDir(installDirName);
+
+    // random read by long-lived reader, data cache is disabled
+    if (m_randomReadCount > 0 && !fileList.isEmpty()) {
+        timer.start();
+        GmPackageReader reader;
+        reader.setCacheSize(0);
+        ok = reader.open(packageFilename);
+        if (!ok) {
+            m_errorMessageList.append(reader.getErrorMessage());
+            return false;
+        }
+        qint64 readBytes = 0;
+        QByteArray data;
+        for (int i = 0; i < m_randomReadCount; i++) {
+            const QString & filename = fileList.at((int) (nextRandom() % (quint32) fileList.size()));
+            QString errorMessage;
+            ok = reader.getFileData(filename, data, &errorMessage);
+            if (!ok) {
+                m_errorMessageList.append(errorMessage);
+                return false;
+            }
+            readBytes += data.size();
+        }
+        writeResult(treeName, "random_read", timer.nsecsElapsed() / 1e9, readBytes, m_randomReadCount);
+    }
+
+    // append package of append tree
+    timer.start();
+    QString appendPackageFilename = workDir.absoluteFilePath("packages/append.lop");
+    GmPackageManager appendLopm(packageFilename);
+    ok = appendLopm.appendPackage(appendPackageFilename);
+    if (!ok) {
+        m_errorMessageList.append(appendLopm.getErrorMessage());
+        return false;
+    }
+    // size and file number of the package appended to
+    GmPackageManager appendedLopm(packageFilename);
+    writeResult(treeName, "append", timer.nsecsElapsed() / 1e9, QFileInfo(packageFilename).size(), appendedLopm.getFileNumber());
+
+    return true;
+}
+
+void GmPackageBenchmark::runCipher()
+{
+    // data encryption in memory, xor and ChaCha20 of package data
+    QByteArray data((int) qMin((qint64) (256 * 1024 * 1024 * m_scale), (qint64) 0x40000000), 'x');
+    QElapsedTimer timer;
+
+    GmPackageCipher xorCipher;
+    xorCipher.setMode(GmPackageCipher::XorMode);
+    timer.start();
+    xorCipher.process(data.data(), data.size(), 0, 0);
+    writeResult("memory", "xor", timer.nsecsElapsed() / 1e9, data.size(), 1);
+
+    GmPackageCipher chachaCipher;
+    chachaCipher.setMode(GmPackageCipher::ChaCha20Mode);
+    chachaCipher.setKey(QByteArray(GmPackageCipher::KeySize, 'k'));
+    timer.start();
+    chachaCipher.process(data.data(), data.size(), 0, 0);
+    writeResult("memory", "chacha20", timer.nsecsElapsed() / 1e9, data.size(), 1);
+}
+
+void GmPackageBenchmark::writeResult(const QString & treeName, const QString & phase, double seconds, qint64 bytes, int files)
+{
+    double mbPerSecond = (seconds > 0) ? bytes / (1024.0 * 1024.0) / seconds : 0;
+    double filesPerSecond = (seconds > 0) ? files / seconds : 0;
+    m_out << "{\"tree\":\"" << treeName << "\",\"phase\":\"" << phase << "\""
+          << ",\"seconds\":" << QString::number(seconds, 'f', 6)
+          << ",\"bytes\":" << bytes
+          << ",\"files\":" << files
+          << ",\"mb_per_s\":" << QString::number(mbPerSecond, 'f', 2)
+          << ",\"files_per_s\":" << QString::number(filesPerSecond, 'f', 1)
+          << ",\"peak_rss_kb\":" << getPeakRss()
+          << "}\n";
+    m_out.flush();
+}
+
+qint64 GmPackageBenchmark::generateSmallTree(const QString & dirName, int & fileNumber)
+{
+    // many small compressible files in 100 directories
+    fileNumber = (int) (20000 * m_scale);
+    qint64 totalSize = 0;
+    for (int i = 0; i < fileNumber; i++) {
+        QString filename = QString("%1/dir%2/file%3.txt").arg(dirName).arg(i % 100, 3, 10, QChar('0')).arg(i);
+        qint64 size = 512 + nextRandom() % (8 * 1024);
+        if (!writeFile(filename, size, true)) return -1;
+        totalSize += size;
+    }
+    return totalSize;
+}
+
+qint64 GmPackageBenchmark::generateHugeTree(const QString & dirName, int & fileNumber)
+{
+    // few huge files, random data and compressible data
+    fileNumber = 4;
+    qint64 size = (qint64) (128 * 1024 * 1024 * m_scale);
+    qint64 totalSize = 0;
+    for (int i = 0; i < fileNumber; i++) {
+        QString filename = QString("%1/huge%2.bin").arg(dirName).arg(i);
+        if (!writeFile(filename, size, (i % 2) == 1)) return -1;
+        totalSize += size;
+    }
+    return totalSize;
+}
+
+qint64 GmPackageBenchmark::generateMixedTree(const QString & dirName, int & fileNumber)
+{
+    // sizes from 1 KiB to under 8 MiB, a power of two from 1 KiB to 4 MiB plus up to the same again, half compressible
+    fileNumber = (int) (2000 * m_scale);
+    qint64 totalSize = 0;
+    for (int i = 0; i < fileNumber; i++) {
+        QString filename = QString("%1/dir%2/mixed%3.dat").arg(dirName).arg(i % 20, 2, 10, QChar('0')).arg(i);
+        qint64 size = (qint64) 1024 << (nextRandom() % 13);
+        size += nextRandom() % size;
+        if (!writeFile(filename, size, (nextRandom() % 2) == 0)) return -1;
+        totalSize += size;
+    }
+    return totalSize;
+}
+
+qint64 GmPackageBenchmark::generateAppendTree(const QString & dirName, int & fileNumber)
+{
+    // file names differ from other trees, so the package can be appended to them
+    fileNumber = (int) (1000 * m_scale) + 1;
+    qint64 totalSize = 0;
+    for (int i = 0; i < fileNumber; i++) {
+        QString filename = QString("%1/append/append%2.txt").arg(dirName).arg(i);
+        qint64 size = 1024 + nextRandom() % (32 * 1024);
+        if (!writeFile(filename, size, true)) return -1;
+        totalSize += size;
+    }
+    return totalSize;
+}
+
+bool GmPackageBenchmark::writeFile(const QString & filename, qint64 size, bool compressible)
+{
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+    QFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_errorMessageList.append(QString("Creates file %1 failure.").arg(filename));
+        return false;
+    }
+
+    const int bufferSize = 1024 * 1024;
+    if (m_buffer.size() != bufferSize) m_buffer.resize(bufferSize);
+    while (size > 0) {
+        int length = (int) qMin(size, (qint64) bufferSize);
+        char *data = m_buffer.data();
+        if (compressible) {
+            int pos = 0;
+            while (pos < length) {
+                const char *word = TextWords[nextRandom() % TextWordCount];
+                while (*word && pos < length) data[pos++] = *word++;
+                if (pos < length) data[pos++] = (nextRandom() % 8 == 0) ? '\n' : ' ';
+            }
+        } else {
+            for (int i = 0; i + 4 <= length; i += 4) {
+                quint32 r = nextRandom();
+                memcpy(data + i, &r, 4);
+            }
+            for (int i = length & ~3; i < length; i++) data[i] = (char) nextRandom();
+        }
+        if (file.write(data, length) != length) {
+            m_errorMessageList.append(QString("Writes file %1 failure.").arg(filename));
+            return false;
+        }
+        size -= length;
+    }
+    return true;
+}
+
+quint32 GmPackageBenchmark::nextRandom()
+{
+    // xorshift32
+    quint32 x = m_randomState;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m_randomState = x;
+    return x;
+}
+
+qint64 GmPackageBenchmark::getPeakRss()
+{
+#ifdef Q_OS_UNIX
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MAC
+        return (qint64) usage.ru_maxrss / 1024; // bytes on mac
+#else
+        return (qint64) usage.ru_maxrss; // KiB on linux
+#endif
+    }
+#endif
+    return 0;
+}
+
+bool GmPackageBenchmark::removeDir(const QString & dirName)
+{
+    QDir dir(dirName);
+    if (!dir.exists()) return true;
+
+    QFileInfoList infoList = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Hidden | QDir::System);
+    for (int i = 0; i < infoList.size(); i++) {
+        const QFileInfo & info = infoList.at(i);
+        if (info.isDir() && !info.isSymLink()) {
+            removeDir(info.absoluteFilePath());
+        } else {
+            QFile::remove(info.absoluteFilePath());
+        }
+    }
+    return QDir().rmdir(dirName);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+// benchmark of package throughput,
+// synthetic source trees are generated in work dir: many small files, few huge files, and files of
+// mixed size and compressibility. for every tree the phases build, open (load file information),
+// install, random read and append are timed, and data encryption in memory. every result is a JSON object in one line:
+//   {"tree":"small","phase":"build","seconds":1.25,"bytes":...,"files":...,"mb_per_s":...,"files_per_s":...,"peak_rss_kb":...}
+class GmPackageBenchmark
+{
+public:
+    GmPackageBenchmark(const QString & workDirName, QTextStream & out);
+
+public:
+    // scale of generated trees, 1.0 generates about 600 MiB source data
+    void setScale(double scale);
+    // number of files read by random read phase
+    void setRandomReadCount(int randomReadCount);
+    // remove generated trees, packages and installed files after benchmark
+    void setCleanFlag(bool cleanFlag);
+
+    // run all phases of all trees, return false if some phase failure
+    bool run();
+    const QStringList & getErrorMessage() const;
+
+private:
+    // generate source trees, return total bytes of tree
+    qint64 generateSmallTree(const QString & dirName, int & fileNumber);
+    qint64 generateHugeTree(const QString & dirName, int & fileNumber);
+    qint64 generateMixedTree(const QString & dirName, int & fileNumber);
+    qint64 generateAppendTree(const QString & dirName, int & fileNumber);
+    bool writeFile(const QString & filename, qint64 size, bool compressible);
+
+    // encryption throughput of package data in memory
+    void runCipher();
+    // run phases of one tree
+    bool runTree(const QString & treeName, qint64 treeBytes, int treeFileNumber);
+    void writeResult(const QString & treeName, const QString & phase, double seconds, qint64 bytes, int files);
+
+    // pseudo random number, same data for every run
+    quint32 nextRandom();
+    static qint64 getPeakRss();
+    static bool removeDir(const QString & dirName);
+
+private:
+    QString m_workDirName;
+    QTextStream & m_out;
+    double m_scale;
+    int m_randomReadCount;
+    bool m_cleanFlag;
+    quint32 m_randomState;
+    QByteArray m_buffer;
+    QStringList m_errorMessageList;
+};
@@ -0,0 +1,78 @@
+/*
+ * benchmark of package build, install, open, random read and append throughput,
+ * results are JSON lines on stdout or in output file
+ */
+
+#include <QCoreApplication>
+#include <QStringList>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+#include "gmpackagebenchmark.h"
+
+void printUsage(const QString & app)
+{
+    QTextStream out(stderr);
+    out << "Usage: " << app << " [-s Scale] [-r RandomReadCount] [-o OutputFile] [-k] [WorkDirName]" << "\n";
+    out << "    -s  scale of generated trees, default 1.0 (about 600 MiB)" << "\n";
+    out << "    -r  number of files read by random read phase, default 2000" << "\n";
+    out << "    -o  append JSON lines to output file, default stdout" << "\n";
+    out << "    -k  keep generated trees and packages" << "\n";
+    out.flush();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    double scale = 1.0;
+    int randomReadCount = 2000;
+    bool cleanFlag = true;
+    QString outputFilename;
+    QString workDirName = QDir::temp().absoluteFilePath("gmpackagebench");
+    for (int i = 1; i < args.size(); i++) {
+        const QString & arg = args.at(i);
+        if (arg == "-s" && i + 1 < args.size()) {
+            scale = args.at(++i).toDouble();
+        } else if (arg == "-r" && i + 1 < args.size()) {
+            randomReadCount = args.at(++i).toInt();
+        } else if (arg == "-o" && i + 1 < args.size()) {
+            outputFilename = args.at(++i);
+        } else if (arg == "-k") {
+            cleanFlag = false;
+        } else if (arg.startsWith("-")) {
+            printUsage(args.at(0));
+            return 1;
+        } else {
+            workDirName = arg;
+        }
+    }
+
+    QFile outputFile;
+    if (outputFilename.isEmpty()) {
+        outputFile.open(stdout, QIODevice::WriteOnly);
+    } else {
+        outputFile.setFileName(outputFilename);
+        if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            QTextStream(stderr) << "Opens output file " << outputFilename << " failure." << "\n";
+            return 1;
+        }
+    }
+    QTextStream out(&outputFile);
+
+    GmPackageBenchmark benchmark(workDirName, out);
+    benchmark.setScale(scale);
+    benchmark.setRandomReadCount(randomReadCount);
+    benchmark.setCleanFlag(cleanFlag);
+    bool ok = benchmark.run();
+    if (!ok) {
+        QTextStream err(stderr);
+        const QStringList & msgList = benchmark.getErrorMessage();
+        for (int i = 0; i < msgList.size(); i++) err << "  " << msgList.at(i) << "\n";
+        err << "Benchmark failure!" << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,92 @@
-#include <stdio.h>
+#include "encrypt_rc4.h"
+
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+
+// 64 bit position of stream, so progress of files over 2 GiB is right where long is 32 bits
+#ifdef _WIN32
+#define rc4_ftell _ftelli64
+#define rc4_fseek _fseeki64
+typedef long long rc4_off_t;
+#else
+#define rc4_ftell ftello
+#define rc4_fseek fseeko
+typedef off_t rc4_off_t;
+#endif
+
+Rc4Cipher::Rc4Cipher(const char *key, size_t keyLength)
+{
+    for (int i = 0; i < 256; i++) m_state[i] = (unsigned char) i;
+
+    // key schedule
+    unsigned int j = 0;
+    for (int i = 0; i < 256; i++) {
+        j = (j + m_state[i] + (unsigned char) key[i % keyLength]) & 0xFF;
+        unsigned char temp = m_state[i];
+        m_state[i] = m_state[j];
+        m_state[j] = temp;
+    }
+    m_i = m_j = 0;
+}
+
+void Rc4Cipher::process(unsigned char *data, size_t dataLength)
+{
+    // state in locals, so compiler keeps indexes in registers
+    unsigned char *S = m_state;
+    unsigned int i = m_i, j = m_j;
+    for (size_t n = 0; n < dataLength; n++) {
+        i = (i + 1) & 0xFF;
+        unsigned char si = S[i];
+        j = (j + si) & 0xFF;
+        unsigned char sj = S[j];
+        S[i] = sj;
+        S[j] = si;
+        data[n] ^= S[(si + sj) & 0xFF];
+    }
+    m_i = i;
+    m_j = j;
+}
+
+bool rc4(FILE *readfile, FILE *writefile, const char *key, Rc4ProgressCallback progress, void *userData)
+{
+    size_t keylen = strlen(key);
+    if (keylen == 0) return false;
+    Rc4Cipher cipher(key, keylen);
 
-void swap(char *s1, char *s2)
+    // total size for progress, 0 if the stream can't seek
+    long long totalSize = 0;
+    rc4_off_t startPosition = rc4_ftell(readfile);
+    if (startPosition >= 0 && rc4_fseek(readfile, 0, SEEK_END) == 0) {
+        rc4_off_t endPosition = rc4_ftell(readfile);
+        if (endPosition > startPosition) totalSize = endPosition - startPosition;
+        rc4_fseek(readfile, startPosition, SEEK_SET);
+    }
+
+    unsigned char *buf = (unsigned char *) malloc(Rc4BlockSize);
+    if (buf == NULL) return false;
+
+    bool ok = true;
+    long long processedSize = 0;
+    size_t nb = 0;
+    while ((nb = fread(buf, 1, Rc4BlockSize, readfile)) > 0) {
+        cipher.process(buf, nb);
+        if (fwrite(buf, 1, nb, writefile) != nb) {
+            ok = false;
+            break;
+        }
+        processedSize += nb;
+        if (progress) progress(processedSize, totalSize, userData);
+    }
+    if (ferror(readfile)) ok = false;
+
+    free(buf);
+    return ok;
+}
+
+// key stream of old versions, state is signed char, so indexes of it may be out of range and
+// the key stream depends on the stack of old code, which is kept as it was to decrypt old files
+static void legacySwap(char *s1, char *s2)
 {
     char temp;
     temp = *s1;
@@ -10,83 +94,100 @@ void swap(char *s1, char *s2)
     *s2 = temp;
 }
 
-void re_S(char *S)
+static void legacyResetState(char *S)
 {
-    for(int i=0; i<256; i++) S[i]=i;
+    for (int i = 0; i < 256; i++) S[i] = i;
 }
 
-void re_T(char *T, char *key)
+static void legacyResetKey(char *T, const char *key)
 {
     int keylen;
     keylen = strlen(key);
-    for (int i = 0; i < 256; i++)
-    T[i] = key[i%keylen];
+    for (int i = 0; i < 256; i++) T[i] = key[i % keylen];
 }
 
-void re_Sbox(char *S, char *T)
+static void legacyScheduleKey(char *S, char *T)
 {
     int j = 0;
-    for(int i = 0; i < 256; i++)
-    {
+    for (int i = 0; i < 256; i++) {
         j = (j + S[i] + T[i]) % 256;
-        swap(&S[i], &S[j]);
+        legacySwap(&S[i], &S[j]);
     }
 }
 
-void rc4(FILE *readfile, FILE *writefile, char *key)
+bool rc4Legacy(FILE *readfile, FILE *writefile, const char *key)
 {
+    if (strlen(key) == 0) return false;
     char S[256] = {0};
     char readbuf[1];
     int i, j, t;
     char T[256] = {0};
 
-    re_S(S);
-    re_T(T, key);
-    re_Sbox(S, T);
+    legacyResetState(S);
+    legacyResetKey(T, key);
+    legacyScheduleKey(S, T);
 
     i = j = 0;
 
-    while(fread(readbuf, 1, 1,readfile))
-    {
+    while (fread(readbuf, 1, 1, readfile)) {
         i = (i + 1) % 256;
         j = (j + S[i]) % 256;
-        swap(&S[i], &S[j]);
+        legacySwap(&S[i], &S[j]);
         t = (S[i] + (S[j] % 256)) % 256;
         readbuf[0] = readbuf[0] ^ S[t];
         fwrite(readbuf, 1, 1, writefile);
         memset(readbuf, 0, 1);
     }
-    printf("ok!\n");
+    return (!ferror(readfile) && !ferror(writefile));
 }
 
 int readkey(char *keyfile, char *key)
 {
     FILE *file1 = fopen(keyfile, "r");
     if (file1 == NULL) return -1;
-    fscanf(file1, "%s", key);
+    fscanf(file1, "%255s", key);
     fclose(file1);
     return 0;
 }
 
-void encrypt(char *sourcefile, char *destfile, char *key0)
+bool encryptFile(const char *sourcefile, const char *destfile, const char *key,
+        Rc4ProgressCallback progress, void *userData, bool legacyFlag)
 {
-    char key[256] = "abcd1234";
-    if (key0 && strlen(key0) > 0) {
-        strncpy(key, key0, 255);
-        key[255] = 0;
+    char key1[256] = "abcd1234";
+    if (key && strlen(key) > 0) {
+        strncpy(key1, key, 255);
+        key1[255] = 0;
     }
 
     FILE *file1 = fopen(sourcefile, "rb");
-    if (file1 == NULL) return;
+    if (file1 == NULL) return false;
     FILE *file2 = fopen(destfile, "wb");
     if (file2 == NULL) {
         fclose(file1);
-        return;
+        return false;
     }
 
-    rc4(file1, file2, key);
+    bool ok = legacyFlag ? rc4Legacy(file1, file2, key1) : rc4(file1, file2, key1, progress, userData);
 
     fclose(file1);
-    fclose(file2);
+    if (fclose(file2) != 0) ok = false;
+    return ok;
 }
 
+static void printEncryptProgress(long long processedSize, long long totalSize, void *userData)
+{
+    (void) userData;
+    if (totalSize > 0) {
+        printf("\r%lld%%", processedSize * 100 / totalSize);
+    } else {
+        printf("\r%lld MiB", processedSize >> 20);
+    }
+    fflush(stdout);
+}
+
+void encrypt(char *sourcefile, char *destfile, char *key0, bool legacyFlag)
+{
+    bool ok = encryptFile(sourcefile, destfile, key0, printEncryptProgress, NULL, legacyFlag);
+    printf("\n");
+    printf(ok ? "ok!\n" : "failure!\n");
+}
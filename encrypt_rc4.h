@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+// progress of file encryption, processed bytes and total bytes of source file (0 if unknown)
+typedef void (*Rc4ProgressCallback)(long long processedSize, long long totalSize, void *userData);
+
+// RC4 stream cipher with unsigned state, data is processed in place by blocks,
+// the key stream continues between calls of process
+class Rc4Cipher
+{
+public:
+    Rc4Cipher(const char *key, size_t keyLength);
+
+    void process(unsigned char *data, size_t dataLength);
+
+private:
+    unsigned char m_state[256];
+    unsigned int m_i, m_j;
+};
+
+// size of read and write blocks of file encryption
+static const size_t Rc4BlockSize = 1024 * 1024;
+
+// encrypt or decrypt stream, return false if read or write failure
+bool rc4(FILE *readfile, FILE *writefile, const char *key, Rc4ProgressCallback progress = NULL, void *userData = NULL);
+// encrypt or decrypt stream by signed char key stream of old versions, it isn't standard RC4,
+// only for files encrypted by old versions
+bool rc4Legacy(FILE *readfile, FILE *writefile, const char *key);
+// encrypt or decrypt file, default key is used if key is empty, legacy flag selects key stream of old versions
+bool encryptFile(const char *sourcefile, const char *destfile, const char *key,
+        Rc4ProgressCallback progress = NULL, void *userData = NULL, bool legacyFlag = false);
+
+// read key from key file
+int readkey(char *keyfile, char *key);
+// encrypt sourcefile to destfile and print result
+void encrypt(char *sourcefile, char *destfile, char *key0, bool legacyFlag = false);
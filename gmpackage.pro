@@ -5,6 +5,7 @@
 #-------------------------------------------------
 
 QT       += core gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += concurrent
 
 TARGET = gmpackage
 CONFIG   += console
@@ -17,9 +18,36 @@ SOURCES += main.cpp \
     gmpackagebuilder.cpp \
     gmpackageinstaller.cpp \
     gmpackagemanager.cpp \
+    gmpackagefileindex.cpp \
+    gmpackagefilewriter.cpp \
+    gmpackagesparsemap.cpp \
+    gmpackagefilehandle.cpp \
+    gmpackageentrydevice.cpp \
+    gmpackagereader.cpp \
+    gmpackagedictionary.cpp \
+    gmpackagedirscanner.cpp \
+    gmpackagemanifest.cpp \
+    gmpackagecipher.cpp \
+    gmpackagestatistics.cpp \
+    gmpackageprogress.cpp \
     encrypt_rc4.cpp
 
 HEADERS += \
     gmpackagebuilder.h \
     gmpackageinstaller.h \
-    gmpackagemanager.h
+    gmpackagemanager.h \
+    gmpackagefileindex.h \
+    gmpackagefilewriter.h \
+    gmpackagesparsemap.h \
+    gmpackagefilehandle.h \
+    gmpackageentrydevice.h \
+    gmpackagereader.h \
+    gmpackagedictionary.h \
+    gmpackagedirscanner.h \
+    gmpackagemanifest.h \
+    gmpackagecipher.h \
+    gmpackagestatistics.h \
+    gmpackageprogress.h \
+    encrypt_rc4.h
+
+LIBS += -lz
@@ -1,8 +1,30 @@
 #include "gmpackagebuilder.h"
 #include "gmpackagemanager.h"
+#include "gmpackagedictionary.h"
+#include "gmpackagedirscanner.h"
 
 #include <QFile>
 #include <QDir>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+
+#include <algorithm>
+
+const qint64 GmPackageBuilder::DefaultSolidBlockSize;
+const qint64 GmPackageBuilder::DefaultSolidFileSizeLimit;
+const int GmPackageBuilder::DefaultDictionarySize;
+const qint64 GmPackageBuilder::DefaultDictionarySampleSize;
+
+// compare files by solid group key, files of one group are adjacent in package
+class GmSolidGroupLessThan
+{
+public:
+    GmSolidGroupLessThan(const QStringList & groupKeyList) : m_groupKeyList(groupKeyList) { }
+    bool operator()(int i, int j) const { return m_groupKeyList.at(i) < m_groupKeyList.at(j); }
+
+private:
+    const QStringList & m_groupKeyList;
+};
 
 GmPackageBuilder::GmPackageBuilder()
 {
@@ -33,37 +55,39 @@ void GmPackageBuilder::init()
     m_fileSort = 0;
     m_compressFlag = true;
     m_compressionLevel = 9;
+    m_solidFlag = false;
+    m_solidBlockSize = DefaultSolidBlockSize;
+    m_solidGroup = SolidGroupByDirectory;
+    m_solidFileSizeLimit = DefaultSolidFileSizeLimit;
+    m_dictionaryFlag = false;
+    m_dictionarySize = DefaultDictionarySize;
+    m_volumeSize = 0;
+    m_deduplicateFlag = false;
+    m_progressDevice = NULL;
+
+    // statistics and progress are passed by queued connection from build thread
+    qRegisterMetaType<GmPackageStatistics>("GmPackageStatistics");
+    qRegisterMetaType<GmPackageProgressInfo>("GmPackageProgressInfo");
 }
 
 bool GmPackageBuilder::getFileList(const QString & startDirName, QStringList & fileList, bool isStartDir)
 {
     if (startDirName.isEmpty()) return false;
 
-    // get file list
-    QDir dir(startDirName);
-    QStringList list = dir.entryList(QDir::Dirs | QDir::Files | QDir::Readable, QDir::Name);
-    QStringList symLinkList;
-    for (int i = 0; i < list.size(); i++) {
-        if (list.at(i) == "." || list.at(i) == "..") continue;
-        QString file = QString("%1%2%3").arg(startDirName, QDir::separator(), list.at(i));
-        QFileInfo info(file);
-        if (info.isFile()) {
-            if (!info.isSymLink()) {
-                fileList.append(info.absoluteFilePath());
-            } else {
-                symLinkList.append(info.absoluteFilePath());
-            }
+    // scan directory tree in parallel, found file names are relative to start dir
+    GmPackageDirScanner scanner;
+    QList<GmPackageDirEntry> entryList;
+    scanner.scan(startDirName, entryList);
+
+    QString startPath = QDir(startDirName).absolutePath() + QDir::separator();
+    for (int i = 0; i < entryList.size(); i++) {
+        const QString & filename = entryList.at(i).filename;
+        if (isStartDir) {
+            fileList.append(filename);
         } else {
-            QString subDirName = info.absoluteFilePath();
-            getFileList(subDirName, fileList, false);
+            fileList.append(startPath + filename);
         }
     }
-    if (symLinkList.isEmpty()) fileList.append(symLinkList);
-
-    if (isStartDir) {
-        QStringList fileList2 = removeStartDirNameFromFilePath(startDirName, fileList);
-        fileList = fileList2;
-    }
 
     return (fileList.size() > 0);
 }
@@ -93,6 +117,7 @@ bool GmPackageBuilder::setFileList(const QStringList & fileList)
     if (m_startDirName.isEmpty()) return false;
 
     m_fileList = removeStartDirNameFromFilePath(m_startDirName, fileList);
+    m_dirEntryList.clear();
     return (m_fileList.size() > 0);
 }
 
@@ -126,82 +151,303 @@ void GmPackageBuilder::setPackageFileSort(int sort)
     m_fileSort = sort;
 }
 
-bool GmPackageBuilder::setFileList(const QString & startDirName, const QStringList & fileList)
+void GmPackageBuilder::setSolidMode(bool solidFlag, qint64 solidBlockSize, int solidGroup)
 {
-    m_startDirName = startDirName;
-    bool ok = setFileList(fileList);
-    return ok;
+    m_solidFlag = solidFlag;
+    m_solidBlockSize = (solidBlockSize > 0) ? solidBlockSize : DefaultSolidBlockSize;
+    m_solidGroup = solidGroup;
 }
 
-bool GmPackageBuilder::setPackageFilename(const QString & packageFilename)
+bool GmPackageBuilder::getSolidMode() const
 {
-    m_packageFilename = packageFilename;
-    if (m_packageFilename.isEmpty()) return false;
+    return m_solidFlag;
+}
 
-    QFileInfo info(m_packageFilename);
-    if (info.isFile() && info.isWritable())
-        return true;
+void GmPackageBuilder::setSolidFileSizeLimit(qint64 solidFileSizeLimit)
+{
+    m_solidFileSizeLimit = solidFileSizeLimit;
+}
 
-    return true;
+void GmPackageBuilder::setDictionaryMode(bool dictionaryFlag, int dictionarySize)
+{
+    m_dictionaryFlag = dictionaryFlag;
+    m_dictionarySize = (dictionarySize > 0) ? dictionarySize : DefaultDictionarySize;
 }
 
-bool GmPackageBuilder::buildPackage(bool printInfo)
+bool GmPackageBuilder::getDictionaryMode() const
 {
-    return buildPackage(m_packageFilename, printInfo);
+    return m_dictionaryFlag;
 }
 
-bool GmPackageBuilder::buildPackage(const QString & packageFilename, bool printInfo)
+void GmPackageBuilder::setVolumeSize(qint64 volumeSize)
+{
+    m_volumeSize = (volumeSize > 0) ? volumeSize : 0;
+}
+
+qint64 GmPackageBuilder::getVolumeSize() const
+{
+    return m_volumeSize;
+}
+
+void GmPackageBuilder::setDeduplicateMode(bool deduplicateFlag)
+{
+    m_deduplicateFlag = deduplicateFlag;
+}
+
+bool GmPackageBuilder::getDeduplicateMode() const
+{
+    return m_deduplicateFlag;
+}
+
+void GmPackageBuilder::setEncryptionKey(const QByteArray & userKey)
+{
+    m_encryptionKey = userKey;
+}
+
+QByteArray GmPackageBuilder::trainDictionary(const QDir & startDir) const
+{
+    // small files are candidates of samples
+    // sizes of scanned entries are used, so files aren't stat again
+    QStringList sampleFilenames;
+    qint64 sampleFileSize = 0;
+    bool dirEntryFlag = (m_dirEntryList.size() == m_fileList.size());
+    for (int i = 0; i < m_fileList.size(); i++) {
+        if (dirEntryFlag) {
+            const GmPackageDirEntry & entry = m_dirEntryList.at(i);
+            if (entry.isSymLink || entry.size == 0 || entry.size > m_solidFileSizeLimit) continue;
+            sampleFilenames.append(startDir.absoluteFilePath(entry.filename));
+            sampleFileSize += entry.size;
+            continue;
+        }
+        QFileInfo finfo(startDir.absoluteFilePath(m_fileList.at(i)));
+        if (finfo.isSymLink() || !finfo.isFile()) continue;
+        if (finfo.size() == 0 || finfo.size() > m_solidFileSizeLimit) continue;
+        sampleFilenames.append(finfo.absoluteFilePath());
+        sampleFileSize += finfo.size();
+    }
+
+    // files are sampled evenly from the file list when they are larger than sample size
+    int step = 1;
+    if (sampleFileSize > DefaultDictionarySampleSize) step = (int) ((sampleFileSize + DefaultDictionarySampleSize - 1) / DefaultDictionarySampleSize);
+
+    QList<QByteArray> sampleList;
+    for (int i = 0; i < sampleFilenames.size(); i += step) {
+        QFile file(sampleFilenames.at(i));
+        if (!file.open(QIODevice::ReadOnly)) continue;
+        QByteArray sample = file.readAll();
+        if (!sample.isEmpty()) sampleList.append(sample);
+    }
+
+    return GmPackageDictionary::train(sampleList, m_dictionarySize);
+}
+
+void GmPackageBuilder::startProgress(const QDir & startDir, const QStringList & fileList,
+        const QList<GmPackageDirEntry> & dirEntryList)
+{
+    // sizes of scanned entries are summed, otherwise files are stat,
+    // files are in file system cache when they are output after their sizes are read
+    qint64 bytesTotal = 0;
+    if (dirEntryList.size() == fileList.size()) {
+        for (int i = 0; i < dirEntryList.size(); i++) bytesTotal += dirEntryList.at(i).size;
+    } else {
+        for (int i = 0; i < fileList.size(); i++) {
+            bytesTotal += QFileInfo(startDir.absoluteFilePath(fileList.at(i))).size();
+        }
+    }
+    m_progress.start(fileList.size(), bytesTotal);
+}
+
+void GmPackageBuilder::updateProgress(const QString & filename, int index, bool printInfo)
+{
+    if (m_progress.update(filename, index)) reportProgress(printInfo);
+}
+
+void GmPackageBuilder::reportProgress(bool printInfo)
+{
+    const GmPackageProgressInfo & info = m_progress.getInfo();
+    // file number is unknown when files are streamed from directory scanner
+    int percent = info.getPercent();
+    if (percent >= 0) emit currentProgress(info.filename, percent);
+    emit currentFile(info.filename, info.fileIndex);
+    emit progressReport(info);
+
+    if (m_progressDevice) {
+        QByteArray line = info.toJson().toUtf8();
+        line.append('\n');
+        m_progressDevice->write(line);
+    }
+    if (printInfo) {
+        QByteArray ba = info.filename.toLocal8Bit();
+        double mbPerSecond = info.bytesPerSecond / (1024.0 * 1024.0);
+        if (info.fileNumber > 0 && info.etaSeconds >= 0) {
+            printf("\r%5d of %5d, %7.2f MB/s, ETA %5.0f s, %s", info.fileIndex + 1, info.fileNumber, mbPerSecond, info.etaSeconds, ba.data());
+        } else {
+            printf("\r%5d, %7.2f MB/s, %s", info.fileIndex + 1, mbPerSecond, ba.data());
+        }
+        if (info.finished) printf("\n");
+        fflush(stdout);
+    }
+}
+
+bool GmPackageBuilder::writeFile(GmPackageManager & lopm, QFile & packageFile, const QDir & startDir,
+        const QString & relativeFilename, QStringList *solidFilenames, const GmPackageDirEntry *dirEntry)
 {
-    clearErrorMessage();
-    if (m_startDirName.isEmpty()) return false;
-    if (m_fileList.isEmpty()) return false;
-    if (packageFilename.isEmpty()) return false;
     bool ok = false;
+    QString filename = startDir.absoluteFilePath(relativeFilename);
+    QString startPath = startDir.absolutePath() + QDir::separator();
+    int startPathLen = startPath.length();
 
-    QFile packageFile(packageFilename);
-    ok = packageFile.open(QIODevice::WriteOnly);
+    // open file for read, scanned file which can't be read is skipped
+    QFile file(filename);
+    ok = file.open(QIODevice::ReadOnly);
+    if (!ok && dirEntry) return true;
     if (!ok) {
-        QString errInfo = QString("Opens package file %1 failure.").arg(packageFilename);
+        QString errInfo = QString("Opens file %1 failure.").arg(filename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package manager
-    GmPackageManager lopm;
-    // set package compress flag
-    lopm.setCompressFlag(m_compressFlag);
-    lopm.setCompressionLevel(m_compressionLevel);
+    // file information item
+    GmPackageFileInfoItem item;
+    item.filename = relativeFilename;
+    item.permissions = file.permissions();
+    item.sort = m_fileSort;
+
+    // check file is symbolic link, size of scanned file is known
+    qint64 fileSize = dirEntry ? dirEntry->size : file.size();
+    bool symLinkFlag = dirEntry ? dirEntry->isSymLink : QFileInfo(filename).isSymLink();
+    if (symLinkFlag) {
+        // add symbolic link to package
+        QString symLinkTarget = QFileInfo(filename).symLinkTarget();
+        if (symLinkTarget.startsWith(startPath)) {
+            symLinkTarget = symLinkTarget.mid(startPathLen);
+            item.symLinkTarget = symLinkTarget;
+            item.setSymbolicLinkFlag(true);
+            ok = lopm.appendFileInfo(item);
+            if (!ok) {
+                m_errorMessageList.append(lopm.getErrorMessage());
+                return false;
+            }
+            return true;
+        }
+    }
 
-    // output package file header
+    // if file is not symbolic link or doesn't processed as symbolic link
+    if (fileSize == 0) {
+        // add empty file to package
+        ok = lopm.appendFileInfo(item);
+        if (!ok) {
+            m_errorMessageList.append(lopm.getErrorMessage());
+            return false;
+        }
+        return true;
+    }
 
-    ok = lopm.writePackageFileHeader(packageFile);
+    // small file of solid mode is output to solid block later
+    if (solidFilenames && m_solidFlag && fileSize <= m_solidFileSizeLimit) {
+        solidFilenames->append(relativeFilename);
+        return true;
+    }
+
+    // read all from file
+    QByteArray fba = readFileData(file);
+    if (fba.isEmpty() && fileSize > 0) {
+        QString errInfo = QString("Reads data from file %1 failure.").arg(filename);
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
+    // file of same data as an output file shares its data block
+    QByteArray dataHash = getDataHash(fba);
+    if (!findSameData(dataHash, fba.size(), item)) {
+        // output file data to package
+        ok = lopm.writeDataFile(fba, packageFile, item);
+        if (!ok) {
+            m_errorMessageList.append(lopm.getErrorMessage());
+            return false;
+        }
+        addDataHash(dataHash, item);
+    }
+    // add file information to package file information list
+    ok = lopm.appendFileInfo(item);
     if (!ok) {
         m_errorMessageList.append(lopm.getErrorMessage());
         return false;
     }
+    return true;
+}
 
-    // start dir
-    QDir startDir(m_startDirName);
-    QString startPath = startDir.absolutePath() + QDir::separator();
-    int startPathLen = startPath.length();
+QByteArray GmPackageBuilder::getDataHash(const QByteArray & data) const
+{
+    if (!m_deduplicateFlag) return QByteArray();
+#if QT_VERSION >= 0x050000
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+#else
+    // no SHA-256 in Qt 4, length of data is checked as well
+    return QCryptographicHash::hash(data, QCryptographicHash::Sha1);
+#endif
+}
 
-    int percent = 0;
-    int fileNumber = m_fileList.size();
-    for (int i = 0; i < fileNumber; i++) {
-        // current file
-        QString filename = startDir.absoluteFilePath(m_fileList.at(i));
-        percent = (int) (1.0 * (i + 1) / fileNumber * 100);
-        emit currentProgress(filename, percent);
-        emit currentFile(filename, i);
-        if (printInfo) {
-            QByteArray ba = filename.toLocal8Bit();
-            if (i == 0) printf("\n");
-            printf("\r%5d of %5d, %s", i + 1, fileNumber, ba.data());
-            if (i == fileNumber - 1) printf("\n");
-            fflush(0);
-        }
+bool GmPackageBuilder::findSameData(const QByteArray & dataHash, qint64 dataLength, GmPackageFileInfoItem & item) const
+{
+    if (dataHash.isEmpty()) return false;
+    QHash<QByteArray, GmPackageFileInfoItem>::const_iterator it = m_dataHashItemHash.constFind(dataHash);
+    if (it == m_dataHashItemHash.constEnd()) return false;
+
+    // data of same hash but other length isn't same
+    const GmPackageFileInfoItem & sameItem = it.value();
+    if (sameItem.originalDataLength != dataLength) return false;
+    item.position = sameItem.position;
+    item.compressedDataLength = sameItem.compressedDataLength;
+    item.originalDataLength = sameItem.originalDataLength;
+    item.compressFlag = sameItem.compressFlag;
+    item.blockIndex = sameItem.blockIndex;
+    item.blockOffset = sameItem.blockOffset;
+    item.volume = sameItem.volume;
+    item.checksum = sameItem.checksum;
+    return true;
+}
+
+void GmPackageBuilder::addDataHash(const QByteArray & dataHash, const GmPackageFileInfoItem & item)
+{
+    if (!dataHash.isEmpty()) m_dataHashItemHash.insert(dataHash, item);
+}
+
+QByteArray GmPackageBuilder::readFileData(QFile & file)
+{
+    GmPackageStatisticsTimer timer(&m_statistics, GmPackageStatistics::FileReadPhase);
+    QByteArray fba = file.readAll();
+    timer.setBytes(fba.size());
+    m_progress.addBytes(fba.size());
+    return fba;
+}
+
+bool GmPackageBuilder::writeSolidFiles(GmPackageManager & lopm, QFile & packageFile, const QDir & startDir,
+        const QStringList & solidFilenames, int & fileIndex, bool printInfo)
+{
+    // files of one group are adjacent, order of files in one group is kept
+    QStringList groupKeyList;
+    QList<int> solidFileOrder;
+    for (int i = 0; i < solidFilenames.size(); i++) {
+        QFileInfo info(solidFilenames.at(i));
+        QString groupKey;
+        if (m_solidGroup == SolidGroupByExtension) groupKey = info.suffix().toLower() + QChar('/');
+        groupKey += info.path();
+        groupKeyList.append(groupKey);
+        solidFileOrder.append(i);
+    }
+    std::stable_sort(solidFileOrder.begin(), solidFileOrder.end(), GmSolidGroupLessThan(groupKeyList));
+
+    // current solid block, hashes of block items and block items of data hashes
+    QByteArray blockData;
+    QList<GmPackageFileInfoItem> blockItemList;
+    QList<QByteArray> blockHashList;
+    QHash<QByteArray, int> blockHashIndexHash;
+    bool ok = false;
+
+    for (int i = 0; i < solidFileOrder.size(); i++) {
+        const QString & relativeFilename = solidFilenames.at(solidFileOrder.at(i));
+        QString filename = startDir.absoluteFilePath(relativeFilename);
 
-        // open file for read
         QFile file(filename);
         ok = file.open(QIODevice::ReadOnly);
         if (!ok) {
@@ -210,62 +456,140 @@ bool GmPackageBuilder::buildPackage(const QString & packageFilename, bool printI
             return false;
         }
 
-        // file information item
         GmPackageFileInfoItem item;
-        item.filename = m_fileList.at(i);
+        item.filename = relativeFilename;
         item.permissions = file.permissions();
         item.sort = m_fileSort;
 
-        // check file is symbolic link
-        bool asSymLinkFlag = false;
-        QFileInfo finfo(filename);
-        if (finfo.isSymLink()) {
-            // add symbolic link to package
-            QString symLinkTarget = finfo.symLinkTarget();
-            if (symLinkTarget.startsWith(startPath)) {
-                symLinkTarget = symLinkTarget.mid(startPathLen);
-                item.symLinkTarget = symLinkTarget;
-                item.setSymbolicLinkFlag(true);
-                ok = lopm.appendFileInfo(item);
-                if (!ok) {
-                    m_errorMessageList.append(lopm.getErrorMessage());
-                    return false;
-                }
-                asSymLinkFlag = true;
-            }
+        // append file data to solid block, output the block when it is full
+        QByteArray fba = readFileData(file);
+        if (fba.isEmpty()) {
+            QString errInfo = QString("Reads data from file %1 failure.").arg(filename);
+            m_errorMessageList.append(errInfo);
+            return false;
         }
-        // if file is not symbolic link or doesn't processed as symbolic link
-        if (!asSymLinkFlag) {
-            if (file.size() == 0) {
-                // add empty file to package
-                ok = lopm.appendFileInfo(item);
-                if (!ok) {
-                    m_errorMessageList.append(lopm.getErrorMessage());
-                    return false;
-                }
-            } else {
-                // read all from file
-                QByteArray fba = file.readAll();
-                if (fba.isEmpty() && file.size() > 0) {
-                    QString errInfo = QString("Reads data from file %1 failure.").arg(filename);
-                    m_errorMessageList.append(errInfo);
-                    return false;
-                }
-                // output file data to package
-                ok = lopm.writeDataFile(fba, packageFile, item);
-                if (!ok) {
-                    m_errorMessageList.append(lopm.getErrorMessage());
-                    return false;
-                }
-                // add file information to package file information list
-                ok = lopm.appendFileInfo(item);
-                if (!ok) {
-                    m_errorMessageList.append(lopm.getErrorMessage());
-                    return false;
-                }
+        // file of same data as a file of output blocks shares its block
+        QByteArray dataHash = getDataHash(fba);
+        if (findSameData(dataHash, fba.size(), item)) {
+            ok = lopm.appendFileInfo(item);
+            if (!ok) {
+                m_errorMessageList.append(lopm.getErrorMessage());
+                return false;
             }
+            updateProgress(filename, fileIndex++, printInfo);
+            continue;
+        }
+
+        // file of same data as a file of current block shares its data in the block
+        item.originalDataLength = fba.size();
+        int sameIndex = dataHash.isEmpty() ? -1 : blockHashIndexHash.value(dataHash, -1);
+        if (sameIndex >= 0 && blockItemList.at(sameIndex).originalDataLength == item.originalDataLength) {
+            item.blockOffset = blockItemList.at(sameIndex).blockOffset;
+            blockItemList.append(item);
+            blockHashList.append(QByteArray());
+            updateProgress(filename, fileIndex++, printInfo);
+            continue;
         }
+
+        item.blockOffset = blockData.size();
+        blockData.append(fba);
+        blockItemList.append(item);
+        blockHashList.append(dataHash);
+        if (!dataHash.isEmpty()) blockHashIndexHash.insert(dataHash, blockItemList.size() - 1);
+        updateProgress(filename, fileIndex++, printInfo);
+        if (blockData.size() >= m_solidBlockSize) {
+            ok = writeSolidBlock(lopm, blockData, packageFile, blockItemList, blockHashList);
+            if (!ok) return false;
+            blockHashIndexHash.clear();
+        }
+    }
+
+    // output last solid block
+    ok = writeSolidBlock(lopm, blockData, packageFile, blockItemList, blockHashList);
+    return ok;
+}
+
+bool GmPackageBuilder::writeSolidBlock(GmPackageManager & lopm, QByteArray & blockData, QFile & packageFile, QList<GmPackageFileInfoItem> & blockItemList,
+        QList<QByteArray> & blockHashList)
+{
+    if (blockItemList.isEmpty()) return true;
+    bool ok = lopm.writeSolidBlock(blockData, packageFile, blockItemList);
+    if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
+        return false;
+    }
+    // items of the block have data position of the block now
+    for (int i = 0; i < blockItemList.size() && i < blockHashList.size(); i++) {
+        addDataHash(blockHashList.at(i), blockItemList.at(i));
     }
+    blockData.clear();
+    blockItemList.clear();
+    blockHashList.clear();
+    return true;
+}
+
+bool GmPackageBuilder::setFileList(const QString & startDirName, const QStringList & fileList)
+{
+    m_startDirName = startDirName;
+    bool ok = setFileList(fileList);
+    return ok;
+}
+
+bool GmPackageBuilder::setPackageFilename(const QString & packageFilename)
+{
+    m_packageFilename = packageFilename;
+    if (m_packageFilename.isEmpty()) return false;
+
+    QFileInfo info(m_packageFilename);
+    if (info.isFile() && info.isWritable())
+        return true;
+
+    return true;
+}
+
+bool GmPackageBuilder::buildPackage(bool printInfo)
+{
+    return buildPackage(m_packageFilename, printInfo);
+}
+
+bool GmPackageBuilder::buildPackage(const QString & packageFilename, bool printInfo)
+{
+    clearErrorMessage();
+    if (m_startDirName.isEmpty()) return false;
+    if (m_fileList.isEmpty()) return false;
+    if (packageFilename.isEmpty()) return false;
+    bool ok = false;
+
+    QFile packageFile(packageFilename);
+    GmPackageManager lopm;
+    QDir startDir(m_startDirName);
+
+    // train dictionary before output header which contains it
+    QByteArray dictionary;
+    if (m_compressFlag && m_dictionaryFlag) dictionary = trainDictionary(startDir);
+
+    ok = beginPackage(lopm, packageFile, dictionary);
+    if (!ok) return false;
+    startProgress(startDir, m_fileList, m_dirEntryList);
+
+    // small files of solid mode are output at last
+    QStringList solidFilenames;
+    int fileIndex = 0;
+    int fileNumber = m_fileList.size();
+    for (int i = 0; i < fileNumber; i++) {
+        // current file
+        const QString & relativeFilename = m_fileList.at(i);
+        const GmPackageDirEntry *dirEntry = (m_dirEntryList.size() == fileNumber) ? &m_dirEntryList.at(i) : NULL;
+        int solidFileCount = solidFilenames.size();
+        ok = writeFile(lopm, packageFile, startDir, relativeFilename, &solidFilenames, dirEntry);
+        if (!ok) return false;
+        if (solidFilenames.size() == solidFileCount) {
+            updateProgress(startDir.absoluteFilePath(relativeFilename), fileIndex++, printInfo);
+        }
+    }
+
+    ok = writeSolidFiles(lopm, packageFile, startDir, solidFilenames, fileIndex, printInfo);
+    if (!ok) return false;
 
     // save package file information list to package file end
     ok = lopm.saveFileInfo(packageFile);
@@ -274,6 +598,73 @@ bool GmPackageBuilder::buildPackage(const QString & packageFilename, bool printI
         return false;
     }
 
+    m_progress.finish();
+    reportProgress(printInfo);
+    emit statisticsReady(m_statistics);
+    return true;
+}
+
+bool GmPackageBuilder::buildPackageFromDir(const QString & startDirName, const QString & packageFilename, bool printInfo)
+{
+    clearErrorMessage();
+    if (startDirName.isEmpty()) return false;
+    if (packageFilename.isEmpty()) return false;
+    bool ok = false;
+
+    // directory tree is scanned in parallel, files are sorted by filename before any data is output,
+    // so package order doesn't depend on scanning threads
+    GmPackageDirScanner scanner;
+    QList<GmPackageDirEntry> entryList;
+    QElapsedTimer scanTimer;
+    scanTimer.start();
+    ok = scanner.scan(startDirName, entryList);
+    m_statistics.add(GmPackageStatistics::ScanPhase, scanTimer.nsecsElapsed(), 0, entryList.size());
+    if (!ok) {
+        m_errorMessageList.append(scanner.getErrorMessage());
+        return false;
+    }
+    if (entryList.isEmpty()) {
+        m_errorMessageList.append(QString("No file is found in dir %1.").arg(startDirName));
+        return false;
+    }
+
+    m_startDirName = startDirName;
+    m_fileList.clear();
+    for (int i = 0; i < entryList.size(); i++) m_fileList.append(entryList.at(i).filename);
+    m_dirEntryList = entryList;
+    return buildPackage(packageFilename, printInfo);
+}
+
+bool GmPackageBuilder::beginPackage(GmPackageManager & lopm, QFile & packageFile, const QByteArray & dictionary)
+{
+    m_dataHashItemHash.clear();
+    bool ok = packageFile.open(QIODevice::WriteOnly);
+    if (!ok) {
+        QString errInfo = QString("Opens package file %1 failure.").arg(packageFile.fileName());
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
+
+    // remove data volumes of old package
+    for (int volume = 1; ; volume++) {
+        QFile volumeFile(GmPackageManager::getVolumeFilename(packageFile.fileName(), volume));
+        if (!volumeFile.exists() || !volumeFile.remove()) break;
+    }
+
+    // set package compress flag
+    lopm.setCompressFlag(m_compressFlag);
+    lopm.setCompressionLevel(m_compressionLevel);
+    lopm.setDictionary(dictionary);
+    lopm.setVolumeSize(m_volumeSize);
+    lopm.setEncryptionKey(m_encryptionKey);
+    lopm.setStatistics(&m_statistics);
+
+    // output package file header
+    ok = lopm.writePackageFileHeader(packageFile);
+    if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
+        return false;
+    }
     return true;
 }
 
@@ -291,17 +682,21 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
     bool ok = false;
 
     // package manager
-    GmPackageManager lopm(packageFilename);
+    GmPackageManager lopm(packageFilename, m_encryptionKey);
 
     // load package information
     ok = lopm.isValid();
     if (!ok) {
         GmPackageBuilder builder(startDirName, fileList);
+        builder.setEncryptionKey(m_encryptionKey);
         ok = builder.buildPackage(packageFilename);
+        m_statistics.add(builder.getStatistics());
+        if (ok) emit statisticsReady(m_statistics);
         return ok;
     }
 
     // append file data to package
+    lopm.setStatistics(&m_statistics);
     QFile packageFile(packageFilename);
     ok = packageFile.open(QIODevice::ReadWrite);
     if (!ok) {
@@ -320,21 +715,12 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
     }
 
     QDir startDir(startDirName);
-    int percent = 0;
     int fileNumber = fileList.size();
+    m_dataHashItemHash.clear();
+    startProgress(startDir, fileList);
     for (int i = 0; i < fileNumber; i++) {
         // current file
         QString filename = startDir.absoluteFilePath(fileList.at(i));
-        percent = (int) (1.0 * (i + 1) / fileNumber * 100);
-        emit currentProgress(filename, percent);
-        emit currentFile(filename, i);
-        if (printInfo) {
-            QByteArray ba = filename.toLocal8Bit();
-            if (i == 0) printf("\n");
-            printf("\r%5d of %5d, %s", i + 1, fileNumber, ba.data());
-            if (i == fileNumber - 1) printf("\n");
-            fflush(0);
-        }
 
         // open file for read
         QFile file(filename);
@@ -345,7 +731,7 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
             continue;
         }
         // read all from file
-        QByteArray fba = file.readAll();
+        QByteArray fba = readFileData(file);
         if (fba.isEmpty() && file.size() > 0) {
             QString errInfo = QString("Reads data from file %1 failure.").arg(filename);
             m_errorMessageList.append(errInfo);
@@ -364,11 +750,15 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
                 return false;
             }
         } else {
-            // output file data to package
-            ok = lopm.writeDataFile(fba, packageFile, item);
-            if (!ok) {
-                m_errorMessageList.append(lopm.getErrorMessage());
-                return false;
+            // output file data to package, file of same data as an appended file shares its data block
+            QByteArray dataHash = getDataHash(fba);
+            if (!findSameData(dataHash, fba.size(), item)) {
+                ok = lopm.writeDataFile(fba, packageFile, item);
+                if (!ok) {
+                    m_errorMessageList.append(lopm.getErrorMessage());
+                    return false;
+                }
+                addDataHash(dataHash, item);
             }
             // add file information to package file information list
             ok = lopm.appendFileInfo(item);
@@ -377,6 +767,7 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
                 return false;
             }
         }
+        updateProgress(filename, i, printInfo);
     }
     // save package file information list to package file end
     ok = lopm.saveFileInfo(packageFile);
@@ -385,9 +776,32 @@ bool GmPackageBuilder::appendFileList2Package(const QString & startDirName, cons
         return false;
     }
 
+    m_progress.finish();
+    reportProgress(printInfo);
+    emit statisticsReady(m_statistics);
     return true;
 }
 
+void GmPackageBuilder::setProgressInterval(int msecs)
+{
+    m_progress.setInterval(msecs);
+}
+
+void GmPackageBuilder::setProgressDevice(QIODevice *device)
+{
+    m_progressDevice = device;
+}
+
+const GmPackageStatistics & GmPackageBuilder::getStatistics() const
+{
+    return m_statistics;
+}
+
+void GmPackageBuilder::clearStatistics()
+{
+    m_statistics.clear();
+}
+
 void GmPackageBuilder::clearErrorMessage()
 {
     m_errorMessageList.clear();
@@ -1,7 +1,17 @@
 #pragma once
 
+#include "gmpackagestatistics.h"
+#include "gmpackageprogress.h"
+#include "gmpackagemanager.h"
+#include "gmpackagedirscanner.h"
+
 #include <QThread>
 #include <QStringList>
+#include <QHash>
+
+class QFile;
+class QDir;
+class QIODevice;
 
 class GmPackageBuilder : public QThread {
     Q_OBJECT
@@ -16,12 +26,16 @@ protected:
     void run();
 
 signals:
+    // progress signals are emitted at most once every progress interval, and for the last file
     void currentProgress(const QString & filename, int percent); // percent value from 0 to 100
     void currentFile(const QString & filename, int index); // index is file index number, from 0 to n-1
+    void progressReport(const GmPackageProgressInfo & info); // bytes, throughput and ETA
     void finished(bool ok);
+    void statisticsReady(const GmPackageStatistics & statistics); // cumulative statistics at the end of build or append
 
 public:
-    // get file list from start dir named startDirName, return relative file name
+    // get file list from start dir named startDirName, return relative file name,
+    // the directory tree is scanned in parallel, file names are sorted
     static bool getFileList(const QString & startDirName, QStringList & fileList, bool isStartDir = true);
     static QStringList removeStartDirNameFromFilePath(const QString & startDirName, const QStringList & fileList);
 
@@ -34,6 +48,42 @@ public:
     // set sort of files in package
     void setPackageFileSort(int sort);
 
+    // solid mode, small files are concatenated into shared data blocks compressed as a whole,
+    // files are grouped by directory or by extension, so similar files are compressed together
+    enum SolidGroup { SolidGroupByDirectory = 0, SolidGroupByExtension = 1 };
+    static const qint64 DefaultSolidBlockSize = 1024 * 1024;
+    static const qint64 DefaultSolidFileSizeLimit = 64 * 1024;
+    void setSolidMode(bool solidFlag = true, qint64 solidBlockSize = DefaultSolidBlockSize, int solidGroup = SolidGroupByDirectory);
+    bool getSolidMode() const;
+    // files not larger than solidFileSizeLimit are stored in solid blocks
+    void setSolidFileSizeLimit(qint64 solidFileSizeLimit = DefaultSolidFileSizeLimit);
+
+    // dictionary mode, small files are sampled to train a zlib dictionary saved in package header,
+    // then data is compressed with the dictionary, small files not in solid blocks gain the most
+    static const int DefaultDictionarySize = 32 * 1024;
+    static const qint64 DefaultDictionarySampleSize = 4 * 1024 * 1024;
+    void setDictionaryMode(bool dictionaryFlag = true, int dictionarySize = DefaultDictionarySize);
+    bool getDictionaryMode() const;
+
+    // split package, file data are output to data volumes 'package.001', 'package.002', ... of volumeSize,
+    // package file contains header and file information, 0 means no data volume
+    void setVolumeSize(qint64 volumeSize);
+    qint64 getVolumeSize() const;
+
+    // deduplicate mode, files of same data (same SHA-256 hash and length) share one data block, the data is output once.
+    // installer can clone or link the shared data instead of uncompressing it again, default is false
+    void setDeduplicateMode(bool deduplicateFlag = true);
+    bool getDeduplicateMode() const;
+
+    // encrypt data blocks by ChaCha20 with a package key derived from user key, every data block is
+    // encrypted after it is compressed, while it is output. empty key is the default xor encryption
+    void setEncryptionKey(const QByteArray & userKey);
+
+    // progress is reported at most once every interval milliseconds by signals, console output of printInfo
+    // and JSON lines written to progress device. device isn't owned, NULL means no JSON lines
+    void setProgressInterval(int msecs = GmPackageProgress::DefaultInterval);
+    void setProgressDevice(QIODevice *device);
+
     // set file list with start dir name
     bool setFileList(const QString & startDirName, const QStringList & fileList);
     // set package filename to m_packageFilename
@@ -41,9 +91,17 @@ public:
 
     bool buildPackage(bool printInfo = false); // build package m_packageFilename
     bool buildPackage(const QString & packageFilename, bool printInfo = false);
+    // build package of all files in startDirName, the directory tree is scanned in parallel and files are
+    // output sorted by filename, so the same tree gives the same package. sizes of scanned files are used,
+    // files which can't be opened are skipped, it fails if no file is found
+    bool buildPackageFromDir(const QString & startDirName, const QString & packageFilename, bool printInfo = false);
     bool appendFileList2Package(const QString & startDirName, const QStringList & fileList, bool printInfo = false);
     bool appendFileList2Package(const QString & startDirName, const QStringList & fileList, const QString & packageFilename, bool printInfo = false);
 
+    // per-phase time and bytes of builds and appends, counters are cumulative until they are cleared
+    const GmPackageStatistics & getStatistics() const;
+    void clearStatistics();
+
     // error message
     void clearErrorMessage(); // clear error message list
     const QStringList & getErrorMessage() const;
@@ -51,13 +109,55 @@ public:
 private:
     void init();
     bool setFileList(const QStringList & fileList);
+    // open package file and output package header
+    bool beginPackage(GmPackageManager & lopm, QFile & packageFile, const QByteArray & dictionary);
+    // output file to package, small file of solid mode is appended to solidFilenames and output later.
+    // size and symbolic link flag of scanned dirEntry are used if it isn't NULL, so the file isn't stat again,
+    // a scanned file which can't be opened is skipped
+    bool writeFile(GmPackageManager & lopm, QFile & packageFile, const QDir & startDir,
+            const QString & relativeFilename, QStringList *solidFilenames = NULL, const GmPackageDirEntry *dirEntry = NULL);
+    // output small files to solid blocks, files are sorted by solid group
+    bool writeSolidFiles(GmPackageManager & lopm, QFile & packageFile, const QDir & startDir,
+            const QStringList & solidFilenames, int & fileIndex, bool printInfo);
+    bool writeSolidBlock(GmPackageManager & lopm, QByteArray & blockData, QFile & packageFile, QList<GmPackageFileInfoItem> & blockItemList,
+            QList<QByteArray> & blockHashList);
+    // SHA-256 hash (SHA-1 in Qt 4) of file data in deduplicate mode, otherwise empty
+    QByteArray getDataHash(const QByteArray & data) const;
+    // item of same data hash and length is output, its data block is set to item
+    bool findSameData(const QByteArray & dataHash, qint64 dataLength, GmPackageFileInfoItem & item) const;
+    void addDataHash(const QByteArray & dataHash, const GmPackageFileInfoItem & item);
+    // train dictionary from samples of small files in file list, sizes of scanned entries are used if they are set
+    QByteArray trainDictionary(const QDir & startDir) const;
+    // start progress of files, data size of files is total bytes, sizes of scanned entries are used if they are given
+    void startProgress(const QDir & startDir, const QStringList & fileList,
+            const QList<GmPackageDirEntry> & dirEntryList = QList<GmPackageDirEntry>());
+    // file of index is done, progress is reported if a report is due
+    void updateProgress(const QString & filename, int index, bool printInfo);
+    // emit progress signals, print progress and output JSON line of current progress
+    void reportProgress(bool printInfo);
+    // read all data of opened file, time is added to statistics and bytes are added to progress
+    QByteArray readFileData(QFile & file);
 
 private:
     int m_fileSort; // file sort, default is 0
     bool m_compressFlag;
     int m_compressionLevel;
+    bool m_solidFlag;
+    qint64 m_solidBlockSize;
+    int m_solidGroup;
+    qint64 m_solidFileSizeLimit;
+    bool m_dictionaryFlag;
+    int m_dictionarySize;
+    qint64 m_volumeSize;
+    bool m_deduplicateFlag;
+    QHash<QByteArray, GmPackageFileInfoItem> m_dataHashItemHash; // output item of data hash, cleared by every build and append
+    QByteArray m_encryptionKey;
     QString m_startDirName;
     QStringList m_fileList;
+    QList<GmPackageDirEntry> m_dirEntryList; // scanned entries of file list, empty if file list is set by names
     QString m_packageFilename;
+    GmPackageStatistics m_statistics;
+    GmPackageProgress m_progress;
+    QIODevice *m_progressDevice;
     QStringList m_errorMessageList;
 };
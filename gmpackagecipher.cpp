@@ -0,0 +1,259 @@
+// rand_s of random data is declared by stdlib.h if it is defined before any include
+#ifdef _WIN32
+#define _CRT_RAND_S
+#endif
+#include "gmpackagecipher.h"
+
+#include <QFile>
+#include <QCryptographicHash>
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+const int GmPackageCipher::KeySize;
+const int GmPackageCipher::SaltSize;
+const int GmPackageCipher::KeyCheckSize;
+const int GmPackageCipher::DefaultIterationCount;
+
+// byte of xor mode
+static const char XorByte = 0x62;
+// ChaCha20 block size in bytes
+static const int ChaChaBlockSize = 64;
+// blocks of key stream generated at a time
+static const int ChaChaBufferBlockCount = 16;
+
+static inline quint32 rotateLeft(quint32 v, int n)
+{
+    return (v << n) | (v >> (32 - n));
+}
+
+static inline quint32 readLittleEndian32(const uchar *p)
+{
+    return (quint32) p[0] | ((quint32) p[1] << 8) | ((quint32) p[2] << 16) | ((quint32) p[3] << 24);
+}
+
+static inline void writeLittleEndian32(uchar *p, quint32 v)
+{
+    p[0] = (uchar) v;
+    p[1] = (uchar) (v >> 8);
+    p[2] = (uchar) (v >> 16);
+    p[3] = (uchar) (v >> 24);
+}
+
+#define CHACHA_QUARTER_ROUND(a, b, c, d) \
+    a += b; d ^= a; d = rotateLeft(d, 16); \
+    c += d; b ^= c; b = rotateLeft(b, 12); \
+    a += b; d ^= a; d = rotateLeft(d, 8); \
+    c += d; b ^= c; b = rotateLeft(b, 7);
+
+// one block of ChaCha20 key stream
+static void chachaBlock(const quint32 input[16], uchar output[ChaChaBlockSize])
+{
+    quint32 x[16];
+    memcpy(x, input, sizeof (x));
+    for (int i = 0; i < 10; i++) {
+        CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+        CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+        CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+        CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+        CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+        CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+        CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+        CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+    }
+    for (int i = 0; i < 16; i++) writeLittleEndian32(output + i * 4, x[i] + input[i]);
+}
+
+#ifdef __SSE2__
+#define ROTL128(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - n))
+#define SSE_QUARTER_ROUND(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL128(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL128(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = ROTL128(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = ROTL128(b, 7);
+// four blocks of ChaCha20 key stream, every 32 bits lane of vectors is one block
+static void chachaBlocks4(const quint32 input[16], uchar output[256])
+{
+    __m128i x[16], s[16];
+    for (int i = 0; i < 16; i++) s[i] = _mm_set1_epi32((int) input[i]);
+    s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+    for (int i = 0; i < 16; i++) x[i] = s[i];
+    for (int i = 0; i < 10; i++) {
+        SSE_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+        SSE_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+        SSE_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+        SSE_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+        SSE_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+        SSE_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+        SSE_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+        SSE_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+    }
+    // transpose words of 4 blocks to output blocks
+    for (int i = 0; i < 16; i += 4) {
+        __m128i a = _mm_add_epi32(x[i], s[i]), b = _mm_add_epi32(x[i + 1], s[i + 1]);
+        __m128i c = _mm_add_epi32(x[i + 2], s[i + 2]), d = _mm_add_epi32(x[i + 3], s[i + 3]);
+        __m128i ab0 = _mm_unpacklo_epi32(a, b), ab1 = _mm_unpackhi_epi32(a, b);
+        __m128i cd0 = _mm_unpacklo_epi32(c, d), cd1 = _mm_unpackhi_epi32(c, d);
+        _mm_storeu_si128((__m128i *) (output + i * 4), _mm_unpacklo_epi64(ab0, cd0));
+        _mm_storeu_si128((__m128i *) (output + 64 + i * 4), _mm_unpackhi_epi64(ab0, cd0));
+        _mm_storeu_si128((__m128i *) (output + 128 + i * 4), _mm_unpacklo_epi64(ab1, cd1));
+        _mm_storeu_si128((__m128i *) (output + 192 + i * 4), _mm_unpackhi_epi64(ab1, cd1));
+    }
+}
+#endif
+
+static QByteArray hmacSha1(const QByteArray & key, const QByteArray & message)
+{
+    const int blockSize = 64;
+    QByteArray k = key;
+    if (k.size() > blockSize) k = QCryptographicHash::hash(k, QCryptographicHash::Sha1);
+    k.append(QByteArray(blockSize - k.size(), '\0'));
+
+    QByteArray innerPad(blockSize, '\0'), outerPad(blockSize, '\0');
+    for (int i = 0; i < blockSize; i++) {
+        innerPad[i] = k.at(i) ^ 0x36;
+        outerPad[i] = k.at(i) ^ 0x5c;
+    }
+    QCryptographicHash inner(QCryptographicHash::Sha1);
+    inner.addData(innerPad);
+    inner.addData(message);
+    QCryptographicHash outer(QCryptographicHash::Sha1);
+    outer.addData(outerPad);
+    outer.addData(inner.result());
+    return outer.result();
+}
+
+GmPackageCipher::GmPackageCipher()
+{
+    m_mode = NoneMode;
+    memset(m_key, 0, sizeof (m_key));
+}
+
+void GmPackageCipher::setMode(int mode)
+{
+    m_mode = mode;
+}
+
+int GmPackageCipher::getMode() const
+{
+    return m_mode;
+}
+
+bool GmPackageCipher::setKey(const QByteArray & key)
+{
+    if (key.size() != KeySize) return false;
+    const uchar *k = (const uchar *) key.constData();
+    for (int i = 0; i < 8; i++) m_key[i] = readLittleEndian32(k + i * 4);
+    return true;
+}
+
+void GmPackageCipher::process(char *data, qint64 dataLength, quint32 volume, qint64 position, qint64 offset) const
+{
+    if (data == NULL || dataLength <= 0) return;
+
+    if (m_mode == XorMode) {
+        for (qint64 i = 0; i < dataLength; i++) data[i] ^= XorByte;
+    } else if (m_mode == ChaCha20Mode) {
+        processChaCha20(data, dataLength, volume, position, offset);
+    }
+}
+
+void GmPackageCipher::processChaCha20(char *data, qint64 dataLength, quint32 volume, qint64 position, qint64 offset) const
+{
+    // constants, key, block counter and nonce of volume and position
+    quint32 input[16];
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    memcpy(input + 4, m_key, sizeof (m_key));
+    input[12] = (quint32) (offset / ChaChaBlockSize);
+    input[13] = volume;
+    input[14] = (quint32) ((quint64) position & 0xFFFFFFFF);
+    input[15] = (quint32) ((quint64) position >> 32);
+
+    uchar keyStream[ChaChaBlockSize * ChaChaBufferBlockCount];
+    int skip = (int) (offset % ChaChaBlockSize);
+    uchar *out = (uchar *) data;
+    while (dataLength > 0) {
+        int blockCount = (int) qMin((qint64) ChaChaBufferBlockCount, (skip + dataLength + ChaChaBlockSize - 1) / ChaChaBlockSize);
+        int i = 0;
+#ifdef __SSE2__
+        for (; i + 4 <= blockCount; i += 4) {
+            chachaBlocks4(input, keyStream + i * ChaChaBlockSize);
+            input[12] += 4;
+        }
+#endif
+        for (; i < blockCount; i++) {
+            chachaBlock(input, keyStream + i * ChaChaBlockSize);
+            input[12]++;
+        }
+
+        int length = (int) qMin((qint64) (blockCount * ChaChaBlockSize - skip), dataLength);
+        const uchar *ks = keyStream + skip;
+        i = 0;
+        // xor by words, key stream buffer and data may be unaligned
+        for (; i + 8 <= length; i += 8) {
+            quint64 d, k;
+            memcpy(&d, out + i, 8);
+            memcpy(&k, ks + i, 8);
+            d ^= k;
+            memcpy(out + i, &d, 8);
+        }
+        for (; i < length; i++) out[i] ^= ks[i];
+
+        out += length;
+        dataLength -= length;
+        skip = 0;
+    }
+}
+
+QByteArray GmPackageCipher::deriveKey(const QByteArray & userKey, const QByteArray & salt, int iterationCount)
+{
+    QByteArray key;
+    for (quint32 blockIndex = 1; key.size() < KeySize; blockIndex++) {
+        QByteArray message = salt;
+        uchar index[4] = { (uchar) (blockIndex >> 24), (uchar) (blockIndex >> 16), (uchar) (blockIndex >> 8), (uchar) blockIndex };
+        message.append((const char *) index, 4);
+
+        QByteArray u = hmacSha1(userKey, message);
+        QByteArray t = u;
+        for (int i = 1; i < iterationCount; i++) {
+            u = hmacSha1(userKey, u);
+            for (int j = 0; j < t.size(); j++) t[j] = t.at(j) ^ u.at(j);
+        }
+        key.append(t);
+    }
+    return key.left(KeySize);
+}
+
+QByteArray GmPackageCipher::getKeyCheck(const QByteArray & key)
+{
+    return hmacSha1(key, QByteArray("GMTOOLKITPACKAGEKEYCHECK")).left(KeyCheckSize);
+}
+
+QByteArray GmPackageCipher::getRandomData(int size)
+{
+    QByteArray data;
+#ifdef Q_OS_WIN
+    // rand_s gets random numbers of the system
+    data.resize(size);
+    for (int i = 0; i < size; i++) {
+        unsigned int value = 0;
+        if (rand_s(&value) != 0) return QByteArray();
+        data[i] = (char) (value & 0xFF);
+    }
+#else
+    QFile randomFile("/dev/urandom");
+    if (randomFile.open(QIODevice::ReadOnly)) {
+        data = randomFile.read(size);
+    }
+#endif
+    // salt and nonce must be unpredictable, there is no weaker fallback
+    if (data.size() != size) return QByteArray();
+    return data;
+}
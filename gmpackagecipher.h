@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QByteArray>
+
+// stream cipher of package data,
+// XorMode is the original encryption of xor with a constant byte,
+// ChaCha20Mode is ChaCha20 (RFC 8439) keyed per package, the nonce of a data block is its data volume and
+// position, so every data block is decrypted independently, and from any offset for streaming reads.
+// the same function encrypts and decrypts, the cipher can be used by many threads at the same time.
+// key stream of four blocks is generated at a time by SSE2 when it is available.
+class GmPackageCipher
+{
+public:
+    enum Mode { NoneMode = 0, XorMode = 1, ChaCha20Mode = 2 };
+
+    static const int KeySize = 32;
+    static const int SaltSize = 16;
+    static const int KeyCheckSize = 16;
+    static const int DefaultIterationCount = 10000;
+
+    GmPackageCipher();
+
+public:
+    // mode of cipher, not NoneMode means data is encrypted
+    void setMode(int mode);
+    int getMode() const;
+    // key of ChaCha20Mode, it must have KeySize bytes
+    bool setKey(const QByteArray & key);
+
+    // encrypt or decrypt data of block in place, offset is the offset of data in data block
+    void process(char *data, qint64 dataLength, quint32 volume, qint64 position, qint64 offset = 0) const;
+
+    // derive package key from user key and package salt by PBKDF2-HMAC-SHA1
+    static QByteArray deriveKey(const QByteArray & userKey, const QByteArray & salt, int iterationCount = DefaultIterationCount);
+    // data to check package key without decrypting package data
+    static QByteArray getKeyCheck(const QByteArray & key);
+    // random data of salt and nonce from random source of system, it is empty if the source fails
+    static QByteArray getRandomData(int size);
+
+private:
+    void processChaCha20(char *data, qint64 dataLength, quint32 volume, qint64 position, qint64 offset) const;
+
+private:
+    int m_mode;
+    quint32 m_key[8];
+};
@@ -0,0 +1,194 @@
+#include "gmpackagedictionary.h"
+
+#include <QHash>
+#include <QSet>
+
+#include <zlib.h>
+#include <string.h>
+#include <algorithm>
+
+const int GmPackageDictionary::DefaultDictionarySize;
+const int GmPackageDictionary::MaxDictionarySize;
+
+// qCompress stores original data length before the zlib stream
+static const int CompressHeaderSize = 4;
+// length of strings counted in samples
+static const int DmerLength = 8;
+// length of sample segments copied into dictionary
+static const int SegmentLength = 256;
+
+// number of samples containing a string, a string is counted once per sample
+struct GmDmerCount
+{
+    GmDmerCount() : lastSample(-1), count(0) { }
+    int lastSample;
+    int count;
+};
+
+// candidate segment of samples
+struct GmDictionarySegment
+{
+    int sample;
+    int offset;
+    int length;
+    qint64 score; // sum of counts of strings common to other samples
+};
+
+static bool segmentScoreGreaterThan(const GmDictionarySegment & s1, const GmDictionarySegment & s2)
+{
+    return (s1.score > s2.score);
+}
+
+static quint64 getDmer(const char *data)
+{
+    quint64 dmer = 0;
+    memcpy(&dmer, data, DmerLength);
+    return dmer;
+}
+
+QByteArray GmPackageDictionary::train(const QList<QByteArray> & sampleList, int dictionarySize)
+{
+    QByteArray dictionary;
+    if (dictionarySize <= 0) return dictionary;
+    if (dictionarySize > MaxDictionarySize) dictionarySize = MaxDictionarySize;
+
+    // count samples containing every string
+    QHash<quint64, GmDmerCount> dmerCountHash;
+    for (int i = 0; i < sampleList.size(); i++) {
+        const QByteArray & sample = sampleList.at(i);
+        for (int j = 0; j + DmerLength <= sample.size(); j++) {
+            GmDmerCount & dmerCount = dmerCountHash[getDmer(sample.constData() + j)];
+            if (dmerCount.lastSample != i) {
+                dmerCount.lastSample = i;
+                dmerCount.count++;
+            }
+        }
+    }
+
+    // score segments by strings common to other samples
+    QList<GmDictionarySegment> segmentList;
+    for (int i = 0; i < sampleList.size(); i++) {
+        const QByteArray & sample = sampleList.at(i);
+        for (int offset = 0; offset + DmerLength <= sample.size(); offset += SegmentLength) {
+            GmDictionarySegment segment;
+            segment.sample = i;
+            segment.offset = offset;
+            segment.length = qMin(SegmentLength, sample.size() - offset);
+            segment.score = 0;
+            for (int j = offset; j + DmerLength <= offset + segment.length; j++) {
+                int count = dmerCountHash.value(getDmer(sample.constData() + j)).count;
+                if (count > 1) segment.score += count - 1;
+            }
+            if (segment.score > 0) segmentList.append(segment);
+        }
+    }
+    std::sort(segmentList.begin(), segmentList.end(), segmentScoreGreaterThan);
+
+    // select segments, a segment whose strings are mostly covered by selected segments is skipped
+    QSet<quint64> coveredDmerSet;
+    QList<GmDictionarySegment> selectedList;
+    int selectedLength = 0;
+    for (int i = 0; i < segmentList.size() && selectedLength < dictionarySize; i++) {
+        const GmDictionarySegment & segment = segmentList.at(i);
+        const char *data = sampleList.at(segment.sample).constData();
+        qint64 score = 0;
+        for (int j = segment.offset; j + DmerLength <= segment.offset + segment.length; j++) {
+            quint64 dmer = getDmer(data + j);
+            if (coveredDmerSet.contains(dmer)) continue;
+            int count = dmerCountHash.value(dmer).count;
+            if (count > 1) score += count - 1;
+        }
+        if (score * 2 < segment.score) continue;
+
+        for (int j = segment.offset; j + DmerLength <= segment.offset + segment.length; j++) {
+            coveredDmerSet.insert(getDmer(data + j));
+        }
+        selectedList.append(segment);
+        selectedLength += segment.length;
+    }
+
+    // the best segment is at dictionary end
+    for (int i = selectedList.size() - 1; i >= 0; i--) {
+        const GmDictionarySegment & segment = selectedList.at(i);
+        dictionary.append(sampleList.at(segment.sample).constData() + segment.offset, segment.length);
+    }
+    if (dictionary.size() > dictionarySize) dictionary = dictionary.right(dictionarySize);
+
+    return dictionary;
+}
+
+QByteArray GmPackageDictionary::compress(const char *data, int dataLength, const QByteArray & dictionary, int compressionLevel)
+{
+    QByteArray cba;
+    if (data == NULL || dataLength <= 0) return cba;
+
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(z_stream));
+    int err = deflateInit(&zstream, compressionLevel);
+    if (err != Z_OK) return cba;
+    if (!dictionary.isEmpty()) {
+        err = deflateSetDictionary(&zstream, (const Bytef *) dictionary.constData(), (uInt) dictionary.size());
+        if (err != Z_OK) {
+            deflateEnd(&zstream);
+            return cba;
+        }
+    }
+
+    uLong bound = deflateBound(&zstream, (uLong) dataLength);
+    cba.resize(CompressHeaderSize + (int) bound);
+
+    // original data length, big endian like qCompress
+    uchar *header = (uchar *) cba.data();
+    header[0] = (uchar) ((dataLength >> 24) & 0xFF);
+    header[1] = (uchar) ((dataLength >> 16) & 0xFF);
+    header[2] = (uchar) ((dataLength >> 8) & 0xFF);
+    header[3] = (uchar) (dataLength & 0xFF);
+
+    zstream.next_in = (Bytef *) data;
+    zstream.avail_in = (uInt) dataLength;
+    zstream.next_out = (Bytef *) (cba.data() + CompressHeaderSize);
+    zstream.avail_out = (uInt) bound;
+    err = deflate(&zstream, Z_FINISH);
+    if (err != Z_STREAM_END) {
+        deflateEnd(&zstream);
+        cba.clear();
+        return cba;
+    }
+    cba.resize(CompressHeaderSize + (int) zstream.total_out);
+    deflateEnd(&zstream);
+
+    return cba;
+}
+
+QByteArray GmPackageDictionary::uncompress(const char *data, int dataLength, const QByteArray & dictionary)
+{
+    QByteArray ucba;
+    if (data == NULL || dataLength <= CompressHeaderSize) return ucba;
+
+    const uchar *header = (const uchar *) data;
+    quint32 originalLength = ((quint32) header[0] << 24) | ((quint32) header[1] << 16) |
+            ((quint32) header[2] << 8) | (quint32) header[3];
+    if (originalLength == 0 || originalLength > 0x7FFFFFFF) return ucba;
+
+    z_stream zstream;
+    memset(&zstream, 0, sizeof(z_stream));
+    int err = inflateInit(&zstream);
+    if (err != Z_OK) return ucba;
+
+    ucba.resize((int) originalLength);
+    zstream.next_in = (Bytef *) (data + CompressHeaderSize);
+    zstream.avail_in = (uInt) (dataLength - CompressHeaderSize);
+    zstream.next_out = (Bytef *) ucba.data();
+    zstream.avail_out = (uInt) originalLength;
+    for (;;) {
+        err = inflate(&zstream, Z_FINISH);
+        if (err != Z_NEED_DICT) break;
+        if (dictionary.isEmpty()) break;
+        err = inflateSetDictionary(&zstream, (const Bytef *) dictionary.constData(), (uInt) dictionary.size());
+        if (err != Z_OK) break;
+    }
+    if (err != Z_STREAM_END || zstream.total_out != originalLength) ucba.clear();
+    inflateEnd(&zstream);
+
+    return ucba;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+
+// zlib preset dictionary of package,
+// the dictionary is trained from sample files, small files have no shared context in zlib,
+// with the dictionary their common strings are matched from the first byte.
+// compressed data has the format of qCompress: [4 bytes big endian original length][zlib stream]
+class GmPackageDictionary
+{
+public:
+    // zlib window is 32 KiB, larger dictionary isn't used by zlib
+    static const int DefaultDictionarySize = 32 * 1024;
+    static const int MaxDictionarySize = 32 * 1024;
+
+    // train dictionary from sample data, segments containing strings common to many samples are
+    // selected, the most common segments are put at dictionary end where match distances are short
+    static QByteArray train(const QList<QByteArray> & sampleList, int dictionarySize = DefaultDictionarySize);
+
+    // compress and uncompress data with preset dictionary, failure return empty data
+    static QByteArray compress(const char *data, int dataLength, const QByteArray & dictionary, int compressionLevel = -1);
+    static QByteArray uncompress(const char *data, int dataLength, const QByteArray & dictionary);
+};
@@ -0,0 +1,270 @@
+#include "gmpackagedirscanner.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThread>
+#include <QMutexLocker>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+const int GmPackageDirScanner::DefaultBatchSize;
+
+// task of reading one directory
+class GmPackageDirScanTask : public QRunnable
+{
+public:
+    GmPackageDirScanTask(GmPackageDirScanner *scanner, const QString & dirName) : m_scanner(scanner), m_dirName(dirName) { }
+    void run() { m_scanner->scanDir(m_dirName); }
+
+private:
+    GmPackageDirScanner *m_scanner;
+    QString m_dirName;
+};
+
+static bool dirEntryLessThan(const GmPackageDirEntry & e1, const GmPackageDirEntry & e2)
+{
+    return (e1.filename < e2.filename);
+}
+
+GmPackageDirScanner::GmPackageDirScanner()
+{
+    m_startDirFd = -1;
+    m_pendingDirCount = 0;
+    m_stopFlag = false;
+    // directory reads mostly wait for file system, more threads than cores hide the latency
+    m_threadPool.setMaxThreadCount(qMax(4, QThread::idealThreadCount() * 2));
+}
+
+GmPackageDirScanner::~GmPackageDirScanner()
+{
+    stop();
+}
+
+bool GmPackageDirScanner::start(const QString & startDirName)
+{
+    stop();
+    if (startDirName.isEmpty()) return false;
+
+    m_startDirName = QDir(startDirName).absolutePath();
+    m_entryList.clear();
+    m_errorMessageList.clear();
+    m_stopFlag = false;
+
+#ifdef Q_OS_UNIX
+    QByteArray path = QFile::encodeName(m_startDirName);
+    m_startDirFd = ::open(path.constData(), O_RDONLY | O_DIRECTORY);
+    if (m_startDirFd < 0) {
+        m_errorMessageList.append(QString("Opens dir %1 failure.").arg(m_startDirName));
+        return false;
+    }
+#else
+    if (!QFileInfo(m_startDirName).isDir()) {
+        m_errorMessageList.append(QString("Opens dir %1 failure.").arg(m_startDirName));
+        return false;
+    }
+#endif
+
+    QMutexLocker locker(&m_mutex);
+    startDir(QString());
+    return true;
+}
+
+void GmPackageDirScanner::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopFlag = true;
+    }
+    m_threadPool.waitForDone();
+
+    QMutexLocker locker(&m_mutex);
+    m_pendingDirCount = 0;
+    m_entryCondition.wakeAll();
+#ifdef Q_OS_UNIX
+    if (m_startDirFd >= 0) ::close(m_startDirFd);
+#endif
+    m_startDirFd = -1;
+}
+
+bool GmPackageDirScanner::nextEntries(QList<GmPackageDirEntry> & entryList)
+{
+    entryList.clear();
+    QMutexLocker locker(&m_mutex);
+    while (m_entryList.isEmpty() && m_pendingDirCount > 0) m_entryCondition.wait(&m_mutex);
+    entryList = m_entryList;
+    m_entryList.clear();
+    return !entryList.isEmpty();
+}
+
+void GmPackageDirScanner::wait()
+{
+    m_threadPool.waitForDone();
+}
+
+bool GmPackageDirScanner::isFinished() const
+{
+    QMutexLocker locker(&m_mutex);
+    return (m_pendingDirCount == 0);
+}
+
+bool GmPackageDirScanner::scan(const QString & startDirName, QList<GmPackageDirEntry> & entryList)
+{
+    entryList.clear();
+    bool ok = start(startDirName);
+    if (!ok) return false;
+
+    QList<GmPackageDirEntry> batchList;
+    while (nextEntries(batchList)) entryList.append(batchList);
+    std::sort(entryList.begin(), entryList.end(), dirEntryLessThan);
+
+    QMutexLocker locker(&m_mutex);
+    return m_errorMessageList.isEmpty();
+}
+
+const QString & GmPackageDirScanner::getStartDirName() const
+{
+    return m_startDirName;
+}
+
+QStringList GmPackageDirScanner::getErrorMessage() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_errorMessageList;
+}
+
+void GmPackageDirScanner::startDir(const QString & dirName)
+{
+    // called with m_mutex locked
+    m_pendingDirCount++;
+    m_threadPool.start(new GmPackageDirScanTask(this, dirName));
+}
+
+void GmPackageDirScanner::appendEntries(const QList<GmPackageDirEntry> & entryList)
+{
+    if (entryList.isEmpty()) return;
+    QMutexLocker locker(&m_mutex);
+    m_entryList.append(entryList);
+    m_entryCondition.wakeAll();
+}
+
+void GmPackageDirScanner::finishDir()
+{
+    QMutexLocker locker(&m_mutex);
+    m_pendingDirCount--;
+    if (m_pendingDirCount <= 0) m_entryCondition.wakeAll();
+}
+
+void GmPackageDirScanner::appendErrorMessage(const QString & errorMessage)
+{
+    QMutexLocker locker(&m_mutex);
+    m_errorMessageList.append(errorMessage);
+}
+
+void GmPackageDirScanner::scanDir(const QString & dirName)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_stopFlag) {
+            m_pendingDirCount--;
+            m_entryCondition.wakeAll();
+            return;
+        }
+    }
+
+    QString prefix = dirName.isEmpty() ? QString() : dirName + QChar('/');
+    QList<GmPackageDirEntry> entryList;
+    QStringList subDirNames;
+
+#ifdef Q_OS_UNIX
+    QByteArray path = dirName.isEmpty() ? QByteArray(".") : QFile::encodeName(dirName);
+    int fd = ::openat(m_startDirFd, path.constData(), O_RDONLY | O_DIRECTORY);
+    DIR *dir = (fd >= 0) ? ::fdopendir(fd) : NULL;
+    if (dir == NULL) {
+        // unreadable sub directory is skipped like QDir::Readable filter
+        bool skipFlag = (fd < 0 && errno == EACCES && !dirName.isEmpty());
+        if (fd >= 0) ::close(fd);
+        if (skipFlag) {
+            finishDir();
+            return;
+        }
+        appendErrorMessage(QString("Opens dir %1 failure.").arg(m_startDirName + QChar('/') + dirName));
+        finishDir();
+        return;
+    }
+
+    struct dirent *de;
+    while ((de = ::readdir(dir)) != NULL) {
+        const char *name = de->d_name;
+        if (name[0] == '.') continue; // ".", ".." and hidden entries
+
+        // entry type from directory, stat only when file system doesn't report it or size of file is needed
+        int type = DT_UNKNOWN;
+#ifdef _DIRENT_HAVE_D_TYPE
+        type = de->d_type;
+#endif
+        struct stat st;
+        if (type == DT_UNKNOWN || type == DT_REG) {
+            if (::fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+            if (S_ISDIR(st.st_mode)) type = DT_DIR;
+            else if (S_ISREG(st.st_mode)) type = DT_REG;
+            else if (S_ISLNK(st.st_mode)) type = DT_LNK;
+        }
+        // only symbolic links to files are packaged, size is size of target file
+        if (type == DT_LNK && (::fstatat(fd, name, &st, 0) != 0 || !S_ISREG(st.st_mode))) continue;
+        if (type != DT_DIR && type != DT_REG && type != DT_LNK) continue;
+
+        QString filename = prefix + QFile::decodeName(name);
+        if (type == DT_DIR) {
+            subDirNames.append(filename);
+        } else {
+            entryList.append(GmPackageDirEntry(filename, type == DT_LNK, (qint64) st.st_size));
+        }
+
+        if (entryList.size() >= DefaultBatchSize) {
+            appendEntries(entryList);
+            entryList.clear();
+        }
+    }
+    ::closedir(dir);
+#else
+    QDir dir(m_startDirName + QChar('/') + dirName);
+    if (!dir.exists()) {
+        appendErrorMessage(QString("Opens dir %1 failure.").arg(dir.path()));
+        finishDir();
+        return;
+    }
+    QFileInfoList infoList = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot | QDir::Readable);
+    for (int i = 0; i < infoList.size(); i++) {
+        const QFileInfo & info = infoList.at(i);
+        QString filename = prefix + info.fileName();
+        if (info.isSymLink()) {
+            if (info.isFile()) entryList.append(GmPackageDirEntry(filename, true, info.size()));
+        } else if (info.isDir()) {
+            subDirNames.append(filename);
+        } else if (info.isFile()) {
+            entryList.append(GmPackageDirEntry(filename, false, info.size()));
+        }
+    }
+#endif
+
+    appendEntries(entryList);
+
+    // queue sub directories before this directory is finished, so pending count doesn't reach 0
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_stopFlag) {
+            for (int i = 0; i < subDirNames.size(); i++) startDir(subDirNames.at(i));
+        }
+    }
+    finishDir();
+}
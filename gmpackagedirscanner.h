@@ -0,0 +1,76 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+
+// file found by directory scanner
+struct GmPackageDirEntry
+{
+    GmPackageDirEntry() : isSymLink(false), size(0) { }
+    GmPackageDirEntry(const QString & name, bool symLink, qint64 fileSize) : filename(name), isSymLink(symLink), size(fileSize) { }
+
+    QString filename; // file name relative to start dir
+    bool isSymLink; // symbolic link to file
+    qint64 size; // size of file, or of target file of symbolic link, when it is scanned
+};
+
+// parallel directory tree scanner,
+// every directory is read by a task of scanner thread pool, sub directories found are queued
+// as new tasks, so idle threads take the pending directories of busy threads.
+// on unix directories are read by openat and readdir (getdents) with entry type of d_type,
+// directories are only stat when their type is unknown, files are stat once for their size,
+// so consumer doesn't stat them again. files are streamed to consumer in batches while directories are scanned,
+// in the order directories are finished by scanning threads, scan() returns all files sorted by filename.
+// hidden entries and unreadable directories are skipped, unreadable files aren't checked on unix, so consumer
+// skips files it can't open. symbolic links to directories aren't followed.
+class GmPackageDirScanner
+{
+public:
+    GmPackageDirScanner();
+    virtual ~GmPackageDirScanner();
+
+public:
+    // number of files in one batch of nextEntries
+    static const int DefaultBatchSize = 256;
+
+    // start scanning directory tree of startDirName in background
+    bool start(const QString & startDirName);
+    // stop scanning and wait for scanning threads
+    void stop();
+    // take next found files, wait until some files are found, return false when scan is finished
+    bool nextEntries(QList<GmPackageDirEntry> & entryList);
+    // wait for scan finished
+    void wait();
+    bool isFinished() const;
+
+    // scan directory tree and return all found files sorted by filename
+    bool scan(const QString & startDirName, QList<GmPackageDirEntry> & entryList);
+
+    const QString & getStartDirName() const;
+    // error messages of directories can't be read
+    QStringList getErrorMessage() const;
+
+private:
+    friend class GmPackageDirScanTask;
+    void scanDir(const QString & dirName);
+    void startDir(const QString & dirName);
+    void appendEntries(const QList<GmPackageDirEntry> & entryList);
+    void finishDir();
+    void appendErrorMessage(const QString & errorMessage);
+
+private:
+    QString m_startDirName;
+    int m_startDirFd; // opened start dir for openat on unix
+
+    QThreadPool m_threadPool;
+    mutable QMutex m_mutex;
+    QWaitCondition m_entryCondition;
+    QList<GmPackageDirEntry> m_entryList; // found files not taken by consumer
+    int m_pendingDirCount; // directories not finished
+    bool m_stopFlag;
+    QStringList m_errorMessageList;
+};
@@ -0,0 +1,307 @@
+#include "gmpackageentrydevice.h"
+
+#include <zlib.h>
+#include <string.h>
+
+// size of compressed data window read from package at once
+static const qint64 InflateWindowSize = 64 * 1024;
+// qCompress stores original data length before the zlib stream
+static const qint64 CompressHeaderSize = 4;
+
+GmPackageEntryDevice::GmPackageEntryDevice(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+        const GmPackageManager & lopm, const GmPackageFileInfoItem & item, QObject *parent)
+    : QIODevice(parent)
+{
+    m_item = item;
+    m_validFlag = true;
+    init(packageHandle, lopm);
+}
+
+GmPackageEntryDevice::GmPackageEntryDevice(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+        const GmPackageManager & lopm, const QString & filename, QObject *parent)
+    : QIODevice(parent)
+{
+    int index = lopm.indexOf(filename);
+    m_validFlag = (index >= 0);
+    if (m_validFlag) m_item = lopm.getFileIndex().at(index);
+    init(packageHandle, lopm);
+}
+
+GmPackageEntryDevice::~GmPackageEntryDevice()
+{
+    endInflate();
+}
+
+void GmPackageEntryDevice::init(const QSharedPointer<GmPackageFileHandle> & packageHandle, const GmPackageManager & lopm)
+{
+    m_packageHandle = packageHandle;
+    m_dataStartPosition = lopm.getFileDataStartPosition(m_item);
+    m_cipher = lopm.getCipher();
+    m_dictionary = lopm.getDictionary();
+    m_extentDataPosition = 0;
+
+    m_streamPosition = 0;
+    m_zstream = NULL;
+    m_inflatePosition = 0;
+    m_compressedPosition = 0;
+}
+
+bool GmPackageEntryDevice::open(OpenMode mode)
+{
+    if ((mode & QIODevice::WriteOnly) || !(mode & QIODevice::ReadOnly)) {
+        setErrorString(QString("Package file data can only be opened for read."));
+        return false;
+    }
+    if (!m_validFlag || m_item.deleteFlag) {
+        setErrorString(QString("File %1 not exists.").arg(m_item.filename));
+        return false;
+    }
+    if (m_packageHandle.isNull() || !m_packageHandle->isOpen()) {
+        setErrorString(QString("Package file is not opened."));
+        return false;
+    }
+
+    endInflate();
+    m_streamPosition = 0;
+    if (m_item.compressFlag & GmPackageManager::SparseDataFlag) {
+        bool ok = readSparseMap();
+        if (!ok) return false;
+    }
+
+    // the device positions are managed here, so disable QIODevice read buffer
+    return QIODevice::open(mode | QIODevice::Unbuffered);
+}
+
+void GmPackageEntryDevice::close()
+{
+    endInflate();
+    m_inflateBuffer.clear();
+    m_skipBuffer.clear();
+    QIODevice::close();
+}
+
+bool GmPackageEntryDevice::isSequential() const
+{
+    return false;
+}
+
+qint64 GmPackageEntryDevice::size() const
+{
+    return m_item.originalDataLength;
+}
+
+bool GmPackageEntryDevice::seek(qint64 pos)
+{
+    if (pos < 0 || pos > size()) return false;
+    bool ok = QIODevice::seek(pos);
+    if (!ok) return false;
+    m_streamPosition = pos;
+    return true;
+}
+
+const GmPackageFileInfoItem & GmPackageEntryDevice::getFileInfo() const
+{
+    return m_item;
+}
+
+qint64 GmPackageEntryDevice::readData(char *data, qint64 maxSize)
+{
+    qint64 remainLength = m_item.originalDataLength - m_streamPosition;
+    if (remainLength <= 0 || maxSize <= 0) return 0;
+    qint64 dataLength = qMin(maxSize, remainLength);
+
+    // file data of solid block starts at block offset of uncompressed block
+    qint64 blockPosition = m_item.blockOffset + m_streamPosition;
+
+    bool ok = false;
+    if (m_item.compressFlag & GmPackageManager::SparseDataFlag) {
+        ok = readSparseData(data, blockPosition, dataLength);
+    } else {
+        ok = readExtentData(data, blockPosition, dataLength);
+    }
+    if (!ok) return -1;
+
+    m_streamPosition += dataLength;
+    return dataLength;
+}
+
+qint64 GmPackageEntryDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+bool GmPackageEntryDevice::readStoredData(char *data, qint64 offset, qint64 dataLength)
+{
+    if (offset < 0 || offset + dataLength > m_item.compressedDataLength) {
+        setErrorString(QString("Reads data out of range of file %1.").arg(m_item.filename));
+        return false;
+    }
+
+    qint64 nb = m_packageHandle->read(data, dataLength, m_dataStartPosition + offset, m_item.volume);
+    if (nb != dataLength) {
+        setErrorString(QString("Reads data from file %1 failure.").arg(m_packageHandle->getPackageFilename()));
+        return false;
+    }
+    m_cipher.process(data, dataLength, m_item.volume, m_item.position, offset);
+    return true;
+}
+
+bool GmPackageEntryDevice::readSparseData(char *data, qint64 blockPosition, qint64 dataLength)
+{
+    qint64 endPosition = blockPosition + dataLength;
+    if (endPosition > m_sparseMap.getOriginalDataLength()) {
+        setErrorString(QString("Reads data out of range of file %1.").arg(m_item.filename));
+        return false;
+    }
+
+    const QList<GmPackageDataExtent> & extentList = m_sparseMap.getExtentList();
+    qint64 position = blockPosition;
+    for (int i = m_sparseMap.findExtent(blockPosition); i < extentList.size() && position < endPosition; i++) {
+        const GmPackageDataExtent & extent = extentList.at(i);
+        qint64 extentStart = qMax(position, extent.offset);
+        qint64 extentEnd = qMin(endPosition, extent.offset + extent.length);
+        if (extentStart >= extentEnd) break;
+
+        // hole before extent
+        memset(data + (position - blockPosition), 0, (size_t) (extentStart - position));
+        bool ok = readExtentData(data + (extentStart - blockPosition),
+                extent.dataPosition + (extentStart - extent.offset), extentEnd - extentStart);
+        if (!ok) return false;
+        position = extentEnd;
+    }
+    memset(data + (position - blockPosition), 0, (size_t) (endPosition - position));
+    return true;
+}
+
+bool GmPackageEntryDevice::readSparseMap()
+{
+    QByteArray mapData(GmPackageSparseMap::HeaderSize, '\0');
+    bool ok = readStoredData(mapData.data(), 0, mapData.size());
+    if (!ok) return false;
+    qint64 mapSize = GmPackageSparseMap::getSerializedSize(mapData.constData());
+    if (mapSize < 0 || mapSize > m_item.compressedDataLength) {
+        setErrorString(QString("Sparse map of file %1 is invalid.").arg(m_item.filename));
+        return false;
+    }
+    mapData.resize((int) mapSize);
+    ok = readStoredData(mapData.data() + GmPackageSparseMap::HeaderSize, GmPackageSparseMap::HeaderSize,
+            mapSize - GmPackageSparseMap::HeaderSize);
+    if (!ok) return false;
+
+    ok = m_sparseMap.read(mapData.constData(), mapData.size());
+    if (!ok || m_sparseMap.getOriginalDataLength() < m_item.blockOffset + m_item.originalDataLength) {
+        setErrorString(QString("Sparse map of file %1 is invalid.").arg(m_item.filename));
+        return false;
+    }
+    m_extentDataPosition = mapSize;
+    return true;
+}
+
+bool GmPackageEntryDevice::readExtentData(char *data, qint64 position, qint64 dataLength)
+{
+    if (m_item.compressFlag & GmPackageManager::CompressMethodMask) {
+        return readCompressedData(data, position, dataLength);
+    }
+    return readStoredData(data, m_extentDataPosition + position, dataLength);
+}
+
+bool GmPackageEntryDevice::readCompressedData(char *data, qint64 blockPosition, qint64 dataLength)
+{
+    // restart uncompress from data start when seek backward
+    if (m_zstream == NULL || blockPosition < m_inflatePosition) {
+        bool ok = resetInflate();
+        if (!ok) return false;
+    }
+
+    // skip uncompressed data before current position
+    while (m_inflatePosition < blockPosition) {
+        if (m_skipBuffer.isEmpty()) m_skipBuffer.resize(InflateWindowSize);
+        qint64 skipLength = qMin(blockPosition - m_inflatePosition, (qint64) m_skipBuffer.size());
+        bool ok = inflateData(m_skipBuffer.data(), skipLength);
+        if (!ok) {
+            endInflate();
+            return false;
+        }
+    }
+
+    bool ok = inflateData(data, dataLength);
+    if (!ok) endInflate(); // uncompress state is unknown, restart at next read
+    return ok;
+}
+
+bool GmPackageEntryDevice::resetInflate()
+{
+    endInflate();
+
+    m_zstream = new z_stream;
+    memset(m_zstream, 0, sizeof(z_stream));
+    int err = inflateInit(m_zstream);
+    if (err != Z_OK) {
+        delete m_zstream;
+        m_zstream = NULL;
+        setErrorString(QString("Initializes uncompress of file %1 failure.").arg(m_item.filename));
+        return false;
+    }
+    m_inflatePosition = 0;
+    m_compressedPosition = m_extentDataPosition + CompressHeaderSize;
+    return true;
+}
+
+void GmPackageEntryDevice::endInflate()
+{
+    if (m_zstream) {
+        inflateEnd(m_zstream);
+        delete m_zstream;
+        m_zstream = NULL;
+    }
+}
+
+bool GmPackageEntryDevice::inflateData(char *data, qint64 dataLength)
+{
+    if (m_inflateBuffer.isEmpty()) m_inflateBuffer.resize(InflateWindowSize);
+
+    qint64 outLength = 0;
+    while (outLength < dataLength) {
+        // avail_out is 32 bits, uncompress large requests in parts
+        uInt partLength = (uInt) qMin(dataLength - outLength, (qint64) 0x40000000);
+        m_zstream->next_out = (Bytef *) (data + outLength);
+        m_zstream->avail_out = partLength;
+
+        while (m_zstream->avail_out > 0) {
+            // read next compressed data window from package
+            if (m_zstream->avail_in == 0) {
+                qint64 windowLength = qMin(m_item.compressedDataLength - m_compressedPosition, (qint64) m_inflateBuffer.size());
+                if (windowLength <= 0) {
+                    setErrorString(QString("Compressed data of file %1 is truncated.").arg(m_item.filename));
+                    return false;
+                }
+                bool ok = readStoredData(m_inflateBuffer.data(), m_compressedPosition, windowLength);
+                if (!ok) return false;
+                m_compressedPosition += windowLength;
+                m_zstream->next_in = (Bytef *) m_inflateBuffer.data();
+                m_zstream->avail_in = (uInt) windowLength;
+            }
+
+            int err = inflate(m_zstream, Z_NO_FLUSH);
+            if (err == Z_NEED_DICT && !m_dictionary.isEmpty()) {
+                // data compressed with package dictionary
+                err = inflateSetDictionary(m_zstream, (const Bytef *) m_dictionary.constData(), (uInt) m_dictionary.size());
+                if (err == Z_OK) continue;
+            }
+            if (err == Z_STREAM_END && m_zstream->avail_out > 0) {
+                setErrorString(QString("Uncompressed data of file %1 is shorter than original.").arg(m_item.filename));
+                return false;
+            }
+            if (err != Z_OK && err != Z_STREAM_END) {
+                setErrorString(QString("Uncompress data of file %1 failure.").arg(m_item.filename));
+                return false;
+            }
+        }
+        outLength += partLength;
+    }
+
+    m_inflatePosition += dataLength;
+    return true;
+}
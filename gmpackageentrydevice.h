@@ -0,0 +1,78 @@
+#pragma once
+
+#include "gmpackagemanager.h"
+#include "gmpackagefilehandle.h"
+#include "gmpackagesparsemap.h"
+
+#include <QIODevice>
+#include <QByteArray>
+#include <QSharedPointer>
+
+struct z_stream_s;
+
+// read only device of one file data in package,
+// the file data is read from package and uncompressed incrementally with a small window,
+// so the data is never materialized as a whole buffer.
+// all devices of one package can share the same opened package file handle.
+class GmPackageEntryDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    GmPackageEntryDevice(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+            const GmPackageManager & lopm, const GmPackageFileInfoItem & item, QObject *parent = 0);
+    GmPackageEntryDevice(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+            const GmPackageManager & lopm, const QString & filename, QObject *parent = 0);
+    virtual ~GmPackageEntryDevice();
+
+public:
+    // only QIODevice::ReadOnly is supported, the device is always opened unbuffered
+    bool open(OpenMode mode);
+    void close();
+
+    bool isSequential() const;
+    qint64 size() const;
+    // seek on uncompressed data is direct, on compressed data seeks forward by skipping
+    // uncompressed data, seeks backward by restarting uncompress from data start
+    bool seek(qint64 pos);
+
+    // file information item of the device
+    const GmPackageFileInfoItem & getFileInfo() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+private:
+    void init(const QSharedPointer<GmPackageFileHandle> & packageHandle, const GmPackageManager & lopm);
+    // read stored data block (compressed or not) from offset of the file data
+    bool readStoredData(char *data, qint64 offset, qint64 dataLength);
+    // read uncompressed data of sparse data block, holes are zero filled and extents are read by readExtentData
+    bool readSparseData(char *data, qint64 blockPosition, qint64 dataLength);
+    // read sparse map at start of stored data block
+    bool readSparseMap();
+    // read data of extents (whole data block if it isn't sparse) from position of uncompressed data
+    bool readExtentData(char *data, qint64 position, qint64 dataLength);
+    // read uncompressed data of compressed file data from position of uncompressed data
+    bool readCompressedData(char *data, qint64 blockPosition, qint64 dataLength);
+    bool resetInflate();
+    void endInflate();
+    bool inflateData(char *data, qint64 dataLength);
+
+private:
+    QSharedPointer<GmPackageFileHandle> m_packageHandle;
+    GmPackageFileInfoItem m_item;
+    bool m_validFlag; // the file is found in package
+    qint64 m_dataStartPosition; // file data start position in package file or data volume
+    GmPackageCipher m_cipher; // cipher of package data
+    QByteArray m_dictionary; // zlib preset dictionary of package
+    GmPackageSparseMap m_sparseMap; // sparse map of data block (version >= 11)
+    qint64 m_extentDataPosition; // start of data of extents in stored data block, after sparse map
+
+    qint64 m_streamPosition; // current position of uncompressed data
+    z_stream_s *m_zstream;
+    qint64 m_inflatePosition; // uncompressed data length by m_zstream
+    qint64 m_compressedPosition; // compressed data length read into m_zstream
+    QByteArray m_inflateBuffer; // compressed data window
+    QByteArray m_skipBuffer;
+};
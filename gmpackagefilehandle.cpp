@@ -0,0 +1,147 @@
+#include "gmpackagefilehandle.h"
+#include "gmpackagemanager.h"
+
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+GmPackageFileHandle::GmPackageFileHandle()
+{
+    m_sequentialFlag = false;
+}
+
+GmPackageFileHandle::GmPackageFileHandle(const QString & packageFilename)
+{
+    m_sequentialFlag = false;
+    open(packageFilename);
+}
+
+GmPackageFileHandle::~GmPackageFileHandle()
+{
+    close();
+}
+
+bool GmPackageFileHandle::open(const QString & packageFilename)
+{
+    close();
+    QMutexLocker locker(&m_mutex);
+
+    m_packageFilename = packageFilename;
+    if (m_packageFilename.isEmpty()) return false;
+
+    m_packageFile.setFileName(m_packageFilename);
+    bool ok = m_packageFile.open(QIODevice::ReadOnly);
+    return ok;
+}
+
+void GmPackageFileHandle::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_packageFile.isOpen()) m_packageFile.close();
+    qDeleteAll(m_volumeFileHash);
+    m_volumeFileHash.clear();
+    m_sequentialFlag = false;
+}
+
+bool GmPackageFileHandle::isOpen() const
+{
+    return m_packageFile.isOpen();
+}
+
+const QString & GmPackageFileHandle::getPackageFilename() const
+{
+    return m_packageFilename;
+}
+
+QFile *GmPackageFileHandle::getFile(int volume)
+{
+    if (volume == 0) return &m_packageFile;
+    if (volume < 0) return NULL;
+
+    QMutexLocker locker(&m_mutex);
+    QFile *file = m_volumeFileHash.value(volume, NULL);
+    if (file) return file;
+
+    file = new QFile(GmPackageManager::getVolumeFilename(m_packageFilename, volume));
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return NULL;
+    }
+#ifdef Q_OS_LINUX
+    if (m_sequentialFlag) posix_fadvise(file->handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    m_volumeFileHash.insert(volume, file);
+    return file;
+}
+
+qint64 GmPackageFileHandle::read(char *data, qint64 dataLength, qint64 position, int volume)
+{
+    if (data == NULL || dataLength < 0 || position < 0) return -1;
+    if (dataLength == 0) return 0;
+
+    QFile *file = getFile(volume);
+    if (file == NULL) return -1;
+
+#ifdef Q_OS_UNIX
+    // positional read doesn't change the file position, no lock is needed
+    int fd = file->handle();
+    if (fd < 0) return -1;
+
+    qint64 nb = 0;
+    while (nb < dataLength) {
+        ssize_t n = ::pread(fd, data + nb, (size_t) (dataLength - nb), (off_t) (position + nb));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break; // end of file
+        nb += n;
+    }
+    return nb;
+#else
+    // the file position is shared by all readers of the handle
+    QMutexLocker locker(&m_mutex);
+    if (!file->isOpen()) return -1;
+
+    bool ok = file->seek(position);
+    if (!ok) return -1;
+
+    qint64 nb = file->read(data, dataLength);
+    return nb;
+#endif
+}
+
+void GmPackageFileHandle::adviseSequential()
+{
+#ifdef Q_OS_LINUX
+    QMutexLocker locker(&m_mutex);
+    m_sequentialFlag = true;
+    int fd = m_packageFile.handle();
+    if (fd >= 0) posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    QHash<int, QFile*>::const_iterator it;
+    for (it = m_volumeFileHash.constBegin(); it != m_volumeFileHash.constEnd(); ++it) {
+        posix_fadvise(it.value()->handle(), 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void GmPackageFileHandle::adviseWillNeed(qint64 position, qint64 dataLength, int volume)
+{
+#ifdef Q_OS_LINUX
+    QFile *file = getFile(volume);
+    int fd = file ? file->handle() : -1;
+    if (fd >= 0 && position >= 0 && dataLength > 0) {
+        posix_fadvise(fd, (off_t) position, (off_t) dataLength, POSIX_FADV_WILLNEED);
+    }
+#else
+    Q_UNUSED(position);
+    Q_UNUSED(dataLength);
+    Q_UNUSED(volume);
+#endif
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QString>
+#include <QFile>
+#include <QMutex>
+#include <QHash>
+
+// read handle of an opened package file,
+// one handle can be shared by many readers (entry devices, readers, threads) at the same time,
+// data is read by positional read (pread), so readers never lock each other.
+// data volumes of split package are opened on demand when they are read first.
+class GmPackageFileHandle
+{
+public:
+    GmPackageFileHandle();
+    GmPackageFileHandle(const QString & packageFilename);
+    virtual ~GmPackageFileHandle();
+
+public:
+    // open package file packageFilename for read
+    bool open(const QString & packageFilename);
+    void close();
+    bool isOpen() const;
+    const QString & getPackageFilename() const;
+
+    // read data block from position of package file or its data volume (volume 0 is package file),
+    // return bytes number of read data, -1 when failure
+    qint64 read(char *data, qint64 dataLength, qint64 position, int volume = 0);
+
+    // access pattern hints to system, ignored when unsupported
+    // the package file will be read sequentially, enlarge system read ahead
+    void adviseSequential();
+    // the data block will be read soon, start read ahead of it in background
+    void adviseWillNeed(qint64 position, qint64 dataLength, int volume = 0);
+
+private:
+    // get opened package file or data volume file, open volume if it isn't opened
+    QFile *getFile(int volume);
+
+private:
+    QString m_packageFilename;
+    QFile m_packageFile;
+    QHash<int, QFile*> m_volumeFileHash; // opened data volumes
+    bool m_sequentialFlag; // sequential advice is applied to volumes opened later
+    QMutex m_mutex; // locks open and close, volumes, and read when positional read is unsupported
+};
@@ -0,0 +1,614 @@
+#include "gmpackagefileindex.h"
+#include "gmpackagemanager.h"
+
+#include <QtEndian>
+
+#include <string.h>
+
+// null string in serialized data of QDataStream
+static const quint32 NullStringLength = 0xFFFFFFFF;
+
+const int GmPackageFileIndex::FieldsRecordSize;
+const int GmPackageFileIndex::SortFieldOffset;
+const int GmPackageFileIndex::DeleteFlagFieldOffset;
+
+// reader of serialized file information data in package byte order (little endian),
+// a read past data end fails and all later reads fail
+class GmPackageIndexDataReader
+{
+public:
+    GmPackageIndexDataReader(const QByteArray & data)
+        : m_data((const uchar *) data.constData()), m_size(data.size()), m_position(0), m_ok(true) { }
+    GmPackageIndexDataReader(const char *data, int dataLength)
+        : m_data((const uchar *) data), m_size(dataLength), m_position(0), m_ok(true) { }
+
+    template <typename T> T read()
+    {
+        if (!m_ok || m_size - m_position < (int) sizeof (T)) {
+            m_ok = false;
+            return 0;
+        }
+        T value = qFromLittleEndian<T>(m_data + m_position);
+        m_position += (int) sizeof (T);
+        return value;
+    }
+
+    // read unsigned LEB128 variable length integer, at most 5 bytes
+    quint32 readVarint()
+    {
+        quint32 value = 0;
+        for (int shift = 0; shift < 35; shift += 7) {
+            quint8 byte = read<quint8>();
+            if (!m_ok) return 0;
+            value |= (quint32) (byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        m_ok = false;
+        return 0;
+    }
+
+    // read length bytes, return NULL if data is truncated
+    const uchar *readBytes(quint32 length)
+    {
+        if (!m_ok || length > (quint32) (m_size - m_position)) {
+            m_ok = false;
+            return NULL;
+        }
+        const uchar *bytes = m_data + m_position;
+        m_position += (int) length;
+        return bytes;
+    }
+
+    // read string of QDataStream, return character number, -1 for null string,
+    // chars points to little endian UTF-16 characters in data
+    int readString(const uchar *& chars)
+    {
+        chars = NULL;
+        quint32 byteLength = read<quint32>();
+        if (!m_ok || byteLength == NullStringLength) return -1;
+        if (byteLength > (quint32) (m_size - m_position) || (byteLength & 1)) {
+            m_ok = false;
+            return -1;
+        }
+        chars = m_data + m_position;
+        m_position += (int) byteLength;
+        return (int) (byteLength / 2);
+    }
+
+    bool isOk() const { return m_ok; }
+    int getPosition() const { return m_position; }
+
+private:
+    const uchar *m_data;
+    int m_size;
+    int m_position;
+    bool m_ok;
+};
+
+template <typename T> static void appendValue(QByteArray & data, T value)
+{
+    uchar buffer[sizeof (T)];
+    qToLittleEndian<T>(value, buffer);
+    data.append((const char *) buffer, (int) sizeof (T));
+}
+
+static void appendVarint(QByteArray & data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append((char) ((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    data.append((char) value);
+}
+
+// UTF-8 of UTF-16 characters, a lone surrogate is encoded as a 3 bytes sequence,
+// so every QString is restored exactly
+static void appendUtf8(QByteArray & data, const QChar *chars, int length)
+{
+    for (int i = 0; i < length; i++) {
+        uint code = chars[i].unicode();
+        if (QChar::isHighSurrogate(code) && i + 1 < length && QChar::isLowSurrogate(chars[i + 1].unicode())) {
+            code = QChar::surrogateToUcs4(code, chars[++i].unicode());
+        }
+        if (code < 0x80) {
+            data.append((char) code);
+        } else if (code < 0x800) {
+            data.append((char) (0xC0 | (code >> 6)));
+            data.append((char) (0x80 | (code & 0x3F)));
+        } else if (code < 0x10000) {
+            data.append((char) (0xE0 | (code >> 12)));
+            data.append((char) (0x80 | ((code >> 6) & 0x3F)));
+            data.append((char) (0x80 | (code & 0x3F)));
+        } else {
+            data.append((char) (0xF0 | (code >> 18)));
+            data.append((char) (0x80 | ((code >> 12) & 0x3F)));
+            data.append((char) (0x80 | ((code >> 6) & 0x3F)));
+            data.append((char) (0x80 | (code & 0x3F)));
+        }
+    }
+}
+
+// decode UTF-8 bytes of appendUtf8 to chars, chars must have space of length characters,
+// return character number, -1 if bytes are invalid
+static int decodeUtf8(const uchar *bytes, int length, QChar *chars)
+{
+    int count = 0;
+    int i = 0;
+    while (i < length) {
+        uint code = bytes[i];
+        int extra = 0;
+        if (code < 0x80) {
+            extra = 0;
+        } else if ((code & 0xE0) == 0xC0) {
+            code &= 0x1F;
+            extra = 1;
+        } else if ((code & 0xF0) == 0xE0) {
+            code &= 0x0F;
+            extra = 2;
+        } else if ((code & 0xF8) == 0xF0) {
+            code &= 0x07;
+            extra = 3;
+        } else {
+            return -1;
+        }
+        if (extra > length - i - 1) return -1;
+        for (int j = 1; j <= extra; j++) {
+            if ((bytes[i + j] & 0xC0) != 0x80) return -1;
+            code = (code << 6) | (bytes[i + j] & 0x3F);
+        }
+        i += extra + 1;
+        if (code >= 0x10000) {
+            if (code > 0x10FFFF) return -1;
+            chars[count++] = QChar(QChar::highSurrogate(code));
+            chars[count++] = QChar(QChar::lowSurrogate(code));
+        } else {
+            chars[count++] = QChar((ushort) code);
+        }
+    }
+    return count;
+}
+
+// append string in format of QDataStream
+static void appendString(QByteArray & data, const QChar *chars, int length)
+{
+    if (length < 0) {
+        appendValue<quint32>(data, NullStringLength);
+        return;
+    }
+    appendValue<quint32>(data, (quint32) length * 2);
+    int start = data.size();
+    data.resize(start + length * 2);
+    uchar *buffer = (uchar *) data.data() + start;
+    for (int i = 0; i < length; i++) qToLittleEndian<quint16>(chars[i].unicode(), buffer + i * 2);
+}
+
+GmPackageFileIndex::GmPackageFileIndex()
+{
+}
+
+void GmPackageFileIndex::clear()
+{
+    m_records.clear();
+    m_nameArena.clear();
+    m_lookupTable.clear();
+}
+
+void GmPackageFileIndex::reserve(int count, int nameArenaSize)
+{
+    m_records.reserve(count);
+    if (nameArenaSize > 0) m_nameArena.reserve(nameArenaSize);
+}
+
+int GmPackageFileIndex::size() const
+{
+    return m_records.size();
+}
+
+bool GmPackageFileIndex::isEmpty() const
+{
+    return m_records.isEmpty();
+}
+
+void GmPackageFileIndex::append(const GmPackageFileInfoItem & item)
+{
+    GmPackageFileIndexRecord record;
+    record.position = item.position;
+    record.compressedDataLength = item.compressedDataLength;
+    record.originalDataLength = item.originalDataLength;
+    record.blockOffset = item.blockOffset;
+    appendName(item.filename, record.nameOffset, record.nameLength);
+    appendName(item.symLinkTarget, record.targetOffset, record.targetLength);
+    record.permissions = (qint32) item.permissions;
+    record.sort = item.sort;
+    record.blockIndex = item.blockIndex;
+    record.volume = item.volume;
+    record.checksum = item.checksum;
+    record.compressFlag = item.compressFlag;
+    record.deleteFlag = item.deleteFlag;
+    record.isSymLink = item.isSymLink;
+    m_records.append(record);
+    insertLookup(m_records.size() - 1);
+}
+
+GmPackageFileInfoItem GmPackageFileIndex::at(int index) const
+{
+    const GmPackageFileIndexRecord & record = m_records.at(index);
+    GmPackageFileInfoItem item;
+    if (record.nameLength >= 0) item.filename = QString(m_nameArena.unicode() + record.nameOffset, record.nameLength);
+    if (record.targetLength >= 0) item.symLinkTarget = QString(m_nameArena.unicode() + record.targetOffset, record.targetLength);
+    item.position = record.position;
+    item.compressedDataLength = record.compressedDataLength;
+    item.originalDataLength = record.originalDataLength;
+    item.blockOffset = record.blockOffset;
+    item.permissions = (QFile::Permissions) record.permissions;
+    item.sort = record.sort;
+    item.blockIndex = record.blockIndex;
+    item.volume = record.volume;
+    item.checksum = record.checksum;
+    item.compressFlag = record.compressFlag;
+    item.deleteFlag = record.deleteFlag;
+    item.isSymLink = record.isSymLink;
+    return item;
+}
+
+const GmPackageFileIndexRecord & GmPackageFileIndex::record(int index) const
+{
+    return m_records.at(index);
+}
+
+QStringRef GmPackageFileIndex::filenameRef(int index) const
+{
+    const GmPackageFileIndexRecord & record = m_records.at(index);
+    return QStringRef(&m_nameArena, record.nameOffset, qMax(0, record.nameLength));
+}
+
+QString GmPackageFileIndex::filename(int index) const
+{
+    const GmPackageFileIndexRecord & record = m_records.at(index);
+    if (record.nameLength < 0) return QString();
+    return QString(m_nameArena.unicode() + record.nameOffset, record.nameLength);
+}
+
+void GmPackageFileIndex::setDeleteFlag(int index, bool deleteFlag)
+{
+    m_records[index].deleteFlag = deleteFlag ? 0x01 : 0x0;
+}
+
+void GmPackageFileIndex::setSort(int index, qint32 sort)
+{
+    m_records[index].sort = sort;
+}
+
+int GmPackageFileIndex::indexOf(const QString & filename) const
+{
+    if (m_lookupTable.isEmpty()) return -1;
+    const QChar *name = filename.unicode();
+    int length = filename.length();
+    int mask = m_lookupTable.size() - 1;
+    int slot = (int) (getNameHash(name, length) & (uint) mask);
+    const qint32 *table = m_lookupTable.constData();
+    while (table[slot] >= 0) {
+        const GmPackageFileIndexRecord & record = m_records.at(table[slot]);
+        if (!record.deleteFlag && qMax(0, record.nameLength) == length &&
+                memcmp(m_nameArena.unicode() + record.nameOffset, name, length * sizeof (QChar)) == 0) {
+            return table[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+bool GmPackageFileIndex::read(const QByteArray & data, int count, int version)
+{
+    QList<QByteArray> segmentList;
+    segmentList.append(data);
+    QList<int> countList;
+    countList.append(count);
+    return read(segmentList, countList, version);
+}
+
+bool GmPackageFileIndex::read(const QList<QByteArray> & segmentList, const QList<int> & countList, int version)
+{
+    if (segmentList.size() != countList.size()) return false;
+    int oldCount = m_records.size();
+    int oldArenaSize = m_nameArena.size();
+
+    // UTF-16 names are at most a half of characters of serialized data, front coded names may be longer
+    // than data, the arena is reserved once and squeezed after reading
+    int count = 0;
+    int dataSize = 0;
+    for (int i = 0; i < segmentList.size(); i++) {
+        if (countList.at(i) < 0) return false;
+        count += countList.at(i);
+        dataSize += segmentList.at(i).size();
+    }
+    if (count == 0) return true;
+    m_records.reserve(oldCount + count);
+    m_nameArena.reserve(oldArenaSize + (version >= 9 ? dataSize : dataSize / 2));
+
+    bool ok = true;
+    for (int i = 0; i < segmentList.size() && ok; i++) {
+        const QByteArray & data = segmentList.at(i);
+        ok = (version >= 9) ? readFrontCodedItems(data, countList.at(i)) : readItems(data, countList.at(i), version);
+    }
+    if (!ok) {
+        m_records.resize(oldCount);
+        m_nameArena.resize(oldArenaSize);
+    }
+    m_nameArena.squeeze();
+
+    // lookup table is built once for all read items
+    rehash(m_lookupTable.size());
+    return ok;
+}
+
+bool GmPackageFileIndex::readItems(const QByteArray & data, int count, int version)
+{
+    GmPackageIndexDataReader reader(data);
+    for (int i = 0; i < count; i++) {
+        GmPackageFileIndexRecord record;
+        const uchar *chars = NULL;
+        record.nameLength = reader.readString(chars);
+        record.nameOffset = m_nameArena.size();
+        if (record.nameLength > 0) {
+            m_nameArena.resize(record.nameOffset + record.nameLength);
+            QChar *arena = m_nameArena.data() + record.nameOffset;
+            for (int j = 0; j < record.nameLength; j++) arena[j] = QChar(qFromLittleEndian<quint16>(chars + j * 2));
+        }
+        record.position = reader.read<qint64>();
+        record.compressedDataLength = reader.read<qint64>();
+        record.originalDataLength = reader.read<qint64>();
+        record.permissions = reader.read<qint32>();
+        record.sort = reader.read<qint32>();
+        record.compressFlag = reader.read<quint8>();
+        record.deleteFlag = reader.read<quint8>();
+        record.isSymLink = reader.read<quint8>();
+        record.targetLength = reader.readString(chars);
+        record.targetOffset = m_nameArena.size();
+        if (record.targetLength > 0) {
+            m_nameArena.resize(record.targetOffset + record.targetLength);
+            QChar *arena = m_nameArena.data() + record.targetOffset;
+            for (int j = 0; j < record.targetLength; j++) arena[j] = QChar(qFromLittleEndian<quint16>(chars + j * 2));
+        }
+        record.blockIndex = -1;
+        record.blockOffset = 0;
+        if (version >= 3) {
+            record.blockIndex = reader.read<qint32>();
+            record.blockOffset = reader.read<qint64>();
+        }
+        record.volume = (version >= 5) ? reader.read<qint32>() : 0;
+        record.checksum = (version >= 6) ? reader.read<quint32>() : 0;
+
+        if (!reader.isOk()) return false;
+        m_records.append(record);
+    }
+    return true;
+}
+
+bool GmPackageFileIndex::readFrontCodedItems(const QByteArray & data, int count)
+{
+    GmPackageIndexDataReader reader(data);
+    int firstIndex = m_records.size();
+
+    // names of all items, filename shares a prefix with filename of previous item
+    qint32 prevOffset = 0, prevLength = 0;
+    for (int i = 0; i < count; i++) {
+        GmPackageFileIndexRecord record;
+        quint32 sharedLength = reader.readVarint();
+        quint32 suffixSize = reader.readVarint();
+        const uchar *suffix = reader.readBytes(suffixSize);
+        if (!reader.isOk() || sharedLength > (quint32) prevLength) return false;
+
+        // prefix is copied from previous filename in arena, suffix is decoded after it
+        record.nameOffset = m_nameArena.size();
+        m_nameArena.resize(record.nameOffset + (int) sharedLength + (int) suffixSize);
+        QChar *arena = m_nameArena.data();
+        memcpy(arena + record.nameOffset, arena + prevOffset, sharedLength * sizeof (QChar));
+        int suffixLength = decodeUtf8(suffix, (int) suffixSize, arena + record.nameOffset + sharedLength);
+        if (suffixLength < 0) return false;
+        record.nameLength = (qint32) sharedLength + suffixLength;
+        m_nameArena.resize(record.nameOffset + record.nameLength);
+        prevOffset = record.nameOffset;
+        prevLength = record.nameLength;
+
+        // symbolic link target size is saved with 1 added, 0 is null target
+        quint32 targetSize = reader.readVarint();
+        record.targetOffset = m_nameArena.size();
+        record.targetLength = -1;
+        if (targetSize > 0) {
+            const uchar *target = reader.readBytes(targetSize - 1);
+            if (!reader.isOk()) return false;
+            m_nameArena.resize(record.targetOffset + (int) targetSize - 1);
+            record.targetLength = decodeUtf8(target, (int) targetSize - 1, m_nameArena.data() + record.targetOffset);
+            if (record.targetLength < 0) return false;
+            m_nameArena.resize(record.targetOffset + record.targetLength);
+        }
+        m_records.append(record);
+    }
+
+    // fixed size fields of all items
+    for (int i = 0; i < count; i++) {
+        GmPackageFileIndexRecord & record = m_records[firstIndex + i];
+        record.position = reader.read<qint64>();
+        record.compressedDataLength = reader.read<qint64>();
+        record.originalDataLength = reader.read<qint64>();
+        record.permissions = reader.read<qint32>();
+        record.sort = reader.read<qint32>();
+        record.compressFlag = reader.read<quint8>();
+        record.deleteFlag = reader.read<quint8>();
+        record.isSymLink = reader.read<quint8>();
+        record.blockIndex = reader.read<qint32>();
+        record.blockOffset = reader.read<qint64>();
+        record.volume = reader.read<qint32>();
+        record.checksum = reader.read<quint32>();
+    }
+    return reader.isOk();
+}
+
+void GmPackageFileIndex::write(QByteArray & data, int version) const
+{
+    write(data, version, 0, m_records.size());
+}
+
+void GmPackageFileIndex::write(QByteArray & data, int version, int first, int count) const
+{
+    if (version >= 9) {
+        writeFrontCodedItems(data, first, count);
+    } else {
+        writeItems(data, version, first, count);
+    }
+}
+
+void GmPackageFileIndex::writeItems(QByteArray & data, int version, int first, int count) const
+{
+    const QChar *arena = m_nameArena.unicode();
+    for (int i = first; i < first + count; i++) {
+        const GmPackageFileIndexRecord & record = m_records.at(i);
+        appendString(data, arena + record.nameOffset, record.nameLength);
+        appendValue<qint64>(data, record.position);
+        appendValue<qint64>(data, record.compressedDataLength);
+        appendValue<qint64>(data, record.originalDataLength);
+        appendValue<qint32>(data, record.permissions);
+        appendValue<qint32>(data, record.sort);
+        appendValue<quint8>(data, record.compressFlag);
+        appendValue<quint8>(data, record.deleteFlag);
+        appendValue<quint8>(data, record.isSymLink);
+        appendString(data, arena + record.targetOffset, record.targetLength);
+        if (version >= 3) {
+            appendValue<qint32>(data, record.blockIndex);
+            appendValue<qint64>(data, record.blockOffset);
+        }
+        if (version >= 5) appendValue<qint32>(data, record.volume);
+        if (version >= 6) appendValue<quint32>(data, record.checksum);
+    }
+}
+
+void GmPackageFileIndex::writeFrontCodedItems(QByteArray & data, int first, int count) const
+{
+    const QChar *arena = m_nameArena.unicode();
+
+    // names of items, items keep their order, files of one directory are adjacent when package is built,
+    // so the shared prefix is usually the directory path. the first filename has no shared prefix,
+    // so items of a segment are read alone
+    const QChar *prevName = arena;
+    int prevLength = 0;
+    QByteArray buffer;
+    for (int i = first; i < first + count; i++) {
+        const GmPackageFileIndexRecord & record = m_records.at(i);
+        const QChar *name = arena + record.nameOffset;
+        int nameLength = qMax(0, record.nameLength);
+        int sharedLength = 0;
+        int maxLength = qMin(prevLength, nameLength);
+        while (sharedLength < maxLength && name[sharedLength] == prevName[sharedLength]) sharedLength++;
+        // a surrogate pair isn't split, so the suffix is valid UTF-16
+        if (sharedLength > 0 && sharedLength < nameLength && name[sharedLength - 1].isHighSurrogate()) sharedLength--;
+
+        buffer.clear();
+        appendUtf8(buffer, name + sharedLength, nameLength - sharedLength);
+        appendVarint(data, (quint32) sharedLength);
+        appendVarint(data, (quint32) buffer.size());
+        data.append(buffer);
+        prevName = name;
+        prevLength = nameLength;
+
+        if (record.targetLength < 0) {
+            appendVarint(data, 0);
+        } else {
+            buffer.clear();
+            appendUtf8(buffer, arena + record.targetOffset, record.targetLength);
+            appendVarint(data, (quint32) buffer.size() + 1);
+            data.append(buffer);
+        }
+    }
+
+    // fixed size fields of items
+    for (int i = first; i < first + count; i++) {
+        const GmPackageFileIndexRecord & record = m_records.at(i);
+        appendValue<qint64>(data, record.position);
+        appendValue<qint64>(data, record.compressedDataLength);
+        appendValue<qint64>(data, record.originalDataLength);
+        appendValue<qint32>(data, record.permissions);
+        appendValue<qint32>(data, record.sort);
+        appendValue<quint8>(data, record.compressFlag);
+        appendValue<quint8>(data, record.deleteFlag);
+        appendValue<quint8>(data, record.isSymLink);
+        appendValue<qint32>(data, record.blockIndex);
+        appendValue<qint64>(data, record.blockOffset);
+        appendValue<qint32>(data, record.volume);
+        appendValue<quint32>(data, record.checksum);
+    }
+}
+
+int GmPackageFileIndex::getFieldsOffset(const char *data, int dataLength, int count)
+{
+    // names are skipped
+    GmPackageIndexDataReader reader(data, dataLength);
+    for (int i = 0; i < count && reader.isOk(); i++) {
+        reader.readVarint();
+        reader.readBytes(reader.readVarint());
+        quint32 targetSize = reader.readVarint();
+        if (targetSize > 0) reader.readBytes(targetSize - 1);
+    }
+    return reader.isOk() ? reader.getPosition() : -1;
+}
+
+QList<GmPackageFileInfoItem> GmPackageFileIndex::toList() const
+{
+    QList<GmPackageFileInfoItem> fileInfoList;
+    fileInfoList.reserve(m_records.size());
+    for (int i = 0; i < m_records.size(); i++) fileInfoList.append(at(i));
+    return fileInfoList;
+}
+
+void GmPackageFileIndex::appendName(const QString & name, qint32 & offset, qint32 & length)
+{
+    offset = m_nameArena.size();
+    length = name.isNull() ? -1 : name.length();
+    if (length > 0) m_nameArena.append(name);
+}
+
+void GmPackageFileIndex::insertLookup(int index)
+{
+    // load factor of table is kept under a half
+    if (m_lookupTable.isEmpty() || m_records.size() * 2 > m_lookupTable.size()) {
+        rehash(qMax(16, m_lookupTable.size() * 2));
+        return;
+    }
+    const GmPackageFileIndexRecord & record = m_records.at(index);
+    int mask = m_lookupTable.size() - 1;
+    int slot = (int) (getNameHash(m_nameArena.unicode() + record.nameOffset, qMax(0, record.nameLength)) & (uint) mask);
+    qint32 *table = m_lookupTable.data();
+    while (table[slot] >= 0) slot = (slot + 1) & mask;
+    table[slot] = index;
+}
+
+void GmPackageFileIndex::rehash(int capacity)
+{
+    m_lookupTable.clear();
+    if (m_records.isEmpty()) return;
+    capacity = qMax(16, capacity);
+    while (capacity < m_records.size() * 2) capacity *= 2;
+    m_lookupTable.fill(-1, capacity);
+
+    // records are inserted in order of indexes, the first record of a filename is probed first
+    int mask = capacity - 1;
+    qint32 *table = m_lookupTable.data();
+    const QChar *arena = m_nameArena.unicode();
+    for (int i = 0; i < m_records.size(); i++) {
+        const GmPackageFileIndexRecord & record = m_records.at(i);
+        int slot = (int) (getNameHash(arena + record.nameOffset, qMax(0, record.nameLength)) & (uint) mask);
+        while (table[slot] >= 0) slot = (slot + 1) & mask;
+        table[slot] = i;
+    }
+}
+
+uint GmPackageFileIndex::getNameHash(const QChar *name, int length)
+{
+    // FNV-1a of UTF-16 characters
+    uint hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash ^= name[i].unicode();
+        hash *= 16777619u;
+    }
+    return hash;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <QString>
+#include <QVector>
+#include <QList>
+#include <QByteArray>
+
+struct GmPackageFileInfoItem;
+
+// packed file information item of file index, names are in the name arena of the index
+struct GmPackageFileIndexRecord
+{
+    qint64 position;
+    qint64 compressedDataLength;
+    qint64 originalDataLength;
+    qint64 blockOffset;
+    qint32 nameOffset; // filename offset in name arena
+    qint32 nameLength; // filename length, -1: null string
+    qint32 targetOffset; // symbolic link target offset in name arena
+    qint32 targetLength; // symbolic link target length, -1: null string
+    qint32 permissions;
+    qint32 sort;
+    qint32 blockIndex;
+    qint32 volume;
+    quint32 checksum;
+    quint8 compressFlag;
+    quint8 deleteFlag;
+    quint8 isSymLink;
+};
+
+Q_DECLARE_TYPEINFO(GmPackageFileIndexRecord, Q_PRIMITIVE_TYPE);
+
+// file information list of package stored contiguously,
+// items are packed records in one vector and all names are in one string arena, so a package of
+// millions of files is loaded without allocations per item. a lookup table of filenames is kept
+// with the records, it is updated when items are appended, so lookup is reentrant
+class GmPackageFileIndex
+{
+public:
+    GmPackageFileIndex();
+
+    void clear();
+    // reserve records and characters of name arena
+    void reserve(int count, int nameArenaSize = 0);
+    int size() const;
+    bool isEmpty() const;
+
+    // append item, lookup table is updated
+    void append(const GmPackageFileInfoItem & item);
+    // get item of index, names are copied from name arena
+    GmPackageFileInfoItem at(int index) const;
+    const GmPackageFileIndexRecord & record(int index) const;
+    // filename of index, the reference is valid until items are appended or index is cleared
+    QStringRef filenameRef(int index) const;
+    QString filename(int index) const;
+
+    void setDeleteFlag(int index, bool deleteFlag);
+    void setSort(int index, qint32 sort);
+
+    // index of the first item of filename which isn't deleted, -1 if it isn't found
+    int indexOf(const QString & filename) const;
+
+    // append count items in format of package version from serialized file information data,
+    // the data is parsed directly into records and name arena. return false if data is truncated
+    // or invalid, then no item is appended
+    bool read(const QByteArray & data, int count, int version);
+    // like upper, items are read from every segment of countList items and lookup table is built once
+    bool read(const QList<QByteArray> & segmentList, const QList<int> & countList, int version);
+    // append serialized items in format of package version to data,
+    // version >= 9 names are front coded UTF-8, see GmPackageManager file format
+    void write(QByteArray & data, int version) const;
+    // append serialized count items from index first, front coding starts again from the first item,
+    // so items of a segment are read without other segments. it is reentrant
+    void write(QByteArray & data, int version, int first, int count) const;
+
+    // list of all items
+    QList<GmPackageFileInfoItem> toList() const;
+
+    // fixed size fields of front coded items (version >= 9), size of fields of one item
+    // and offsets of sort and delete flag in it, so they can be changed in place
+    static const int FieldsRecordSize = 55;
+    static const int SortFieldOffset = 28;
+    static const int DeleteFlagFieldOffset = 33;
+    // offset of fixed size fields of count front coded items in serialized data, -1 if data is invalid
+    static int getFieldsOffset(const char *data, int dataLength, int count);
+
+private:
+    // items of QDataStream format (version < 9) and front coded items (version >= 9)
+    bool readItems(const QByteArray & data, int count, int version);
+    bool readFrontCodedItems(const QByteArray & data, int count);
+    void writeItems(QByteArray & data, int version, int first, int count) const;
+    void writeFrontCodedItems(QByteArray & data, int first, int count) const;
+    // copy name to name arena, set offset and length of it
+    void appendName(const QString & name, qint32 & offset, qint32 & length);
+    void insertLookup(int index);
+    void rehash(int capacity);
+    static uint getNameHash(const QChar *name, int length);
+
+private:
+    QVector<GmPackageFileIndexRecord> m_records;
+    QString m_nameArena;
+    // open addressing table of record indexes by filename hash, -1 is empty slot,
+    // records of one filename are in probe order of their indexes
+    QVector<qint32> m_lookupTable;
+};
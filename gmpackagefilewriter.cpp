@@ -0,0 +1,346 @@
+#include "gmpackagefilewriter.h"
+#include "gmpackagestatistics.h"
+
+#include <QThread>
+#include <QMutexLocker>
+
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+const int GmPackageFileWriter::DefaultThreadCount;
+const qint64 GmPackageFileWriter::DefaultQueueSize;
+const qint64 GmPackageFileWriter::PreallocateMinSize;
+
+// writer thread of write-behind queue
+class GmPackageFileWriterThread : public QThread
+{
+public:
+    GmPackageFileWriterThread(GmPackageFileWriter *writer) : m_writer(writer) { }
+
+protected:
+    void run()
+    {
+        m_writer->runWriter();
+    }
+
+private:
+    GmPackageFileWriter *m_writer;
+};
+
+#ifdef Q_OS_UNIX
+// file mode of Qt permissions, user permissions are same as owner permissions on unix
+static mode_t toFileMode(QFile::Permissions permissions)
+{
+    int perm = (int) permissions;
+    return (mode_t) ((((perm >> 12) & 07) << 6) | (((perm >> 4) & 07) << 3) | (perm & 07));
+}
+
+// buffer size of copying file data when a file can't be cloned
+static const qint64 CopyBufferSize = 1024 * 1024;
+
+// open file for write, an existing file is truncated, existing read only file is made writable by owner
+static int openFile(const QByteArray & path)
+{
+    int fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0 && errno == EACCES) {
+        struct stat fileStat;
+        if (::stat(path.constData(), &fileStat) == 0 && ::chmod(path.constData(), fileStat.st_mode | S_IWUSR) == 0) {
+            fd = ::open(path.constData(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        }
+    }
+    return fd;
+}
+
+// write all data at offset of file
+static bool writeData(int fd, const char *data, qint64 dataLength, qint64 offset)
+{
+    qint64 nb = 0;
+    while (nb < dataLength) {
+        ssize_t n = ::pwrite(fd, data + nb, (size_t) (dataLength - nb), (off_t) (offset + nb));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        nb += n;
+    }
+    return (nb == dataLength);
+}
+#endif
+
+GmPackageFileWriter::GmPackageFileWriter(int threadCount, qint64 queueSize)
+{
+    m_queueSize = qMax((qint64) 1, queueSize);
+    m_queuedBytes = 0;
+    m_pendingCount = 0;
+    m_writtenBytes = 0;
+    m_writtenCount = 0;
+    m_stopFlag = false;
+    m_failFlag = false;
+    m_sparseFlag = false;
+    m_statistics = NULL;
+
+    threadCount = qMax(1, threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        QThread *thread = new GmPackageFileWriterThread(this);
+        m_threadList.append(thread);
+        thread->start();
+    }
+}
+
+GmPackageFileWriter::~GmPackageFileWriter()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopFlag = true;
+        m_taskQueue.clear();
+        m_taskCondition.wakeAll();
+    }
+    for (int i = 0; i < m_threadList.size(); i++) {
+        m_threadList.at(i)->wait();
+        delete m_threadList.at(i);
+    }
+}
+
+void GmPackageFileWriter::setStatistics(GmPackageStatistics *statistics)
+{
+    m_statistics = statistics;
+}
+
+void GmPackageFileWriter::setSparseFlag(bool sparseFlag)
+{
+    m_sparseFlag = sparseFlag;
+}
+
+bool GmPackageFileWriter::write(const QString & filename, const QByteArray & data, QFile::Permissions permissions,
+        const GmPackageSparseMap & sparseMap)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // a file larger than queue size is queued alone
+    while (!m_failFlag && m_queuedBytes > 0 && m_queuedBytes + data.size() > m_queueSize) {
+        m_spaceCondition.wait(&m_mutex);
+    }
+    if (m_failFlag) return false;
+
+    GmPackageFileWriteTask task;
+    task.filename = filename;
+    task.data = data; // shared, data isn't copied
+    task.permissions = permissions;
+    task.sparseMap = sparseMap;
+    m_taskQueue.enqueue(task);
+    m_queuedBytes += data.size();
+    m_pendingCount++;
+    m_taskCondition.wakeOne();
+    return true;
+}
+
+bool GmPackageFileWriter::finish()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_pendingCount > 0) m_idleCondition.wait(&m_mutex);
+    return (!m_failFlag);
+}
+
+QStringList GmPackageFileWriter::getErrorMessageList() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_errorMessageList;
+}
+
+void GmPackageFileWriter::getWrittenProgress(qint64 & writtenBytes, int & writtenCount, QString & lastFilename) const
+{
+    QMutexLocker locker(&m_mutex);
+    writtenBytes = m_writtenBytes;
+    writtenCount = m_writtenCount;
+    lastFilename = m_lastWrittenFilename;
+}
+
+void GmPackageFileWriter::runWriter()
+{
+    for (;;) {
+        GmPackageFileWriteTask task;
+        bool skipFlag = false;
+        {
+            QMutexLocker locker(&m_mutex);
+            while (m_taskQueue.isEmpty() && !m_stopFlag) m_taskCondition.wait(&m_mutex);
+            if (m_taskQueue.isEmpty()) return;
+            task = m_taskQueue.dequeue();
+            skipFlag = m_failFlag; // files after a failure aren't written
+        }
+
+        QString errorMessage;
+        bool ok = true;
+        if (!skipFlag) {
+            GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::FileWritePhase, task.data.size());
+            ok = writeFile(task.filename, task.data.constData(), task.data.size(), task.permissions,
+                    m_sparseFlag ? &task.sparseMap : NULL, &errorMessage);
+        }
+
+        QMutexLocker locker(&m_mutex);
+        if (!ok) {
+            m_failFlag = true;
+            m_errorMessageList.append(errorMessage);
+        } else if (!skipFlag) {
+            m_writtenBytes += task.data.size();
+            m_writtenCount++;
+            m_lastWrittenFilename = task.filename;
+        }
+        m_queuedBytes -= task.data.size();
+        m_pendingCount--;
+        m_spaceCondition.wakeAll();
+        if (m_pendingCount == 0) m_idleCondition.wakeAll();
+    }
+}
+
+bool GmPackageFileWriter::writeFile(const QString & filename, const char *data, qint64 dataLength,
+        QFile::Permissions permissions, const GmPackageSparseMap *sparseMap, QString *errorMessage)
+{
+    // holes of sparse data are left by seeking over them in the new empty file
+    bool holeFlag = (sparseMap && sparseMap->hasHole() && sparseMap->getOriginalDataLength() == dataLength);
+
+#ifdef Q_OS_UNIX
+    int fd = openFile(QFile::encodeName(filename));
+    if (fd < 0) {
+        if (errorMessage) *errorMessage = QString("Opens file %1 failure.").arg(filename);
+        return false;
+    }
+
+    bool ok = true;
+    if (holeFlag) {
+        const QList<GmPackageDataExtent> & extentList = sparseMap->getExtentList();
+        for (int i = 0; ok && i < extentList.size(); i++) {
+            const GmPackageDataExtent & extent = extentList.at(i);
+            ok = writeData(fd, data + extent.offset, extent.length, extent.offset);
+        }
+        // a hole at end of file
+        if (ok) ok = (::ftruncate(fd, (off_t) dataLength) == 0);
+    } else {
+#ifdef Q_OS_LINUX
+        // allocate all blocks of a large file at once, it is only a hint, so the result is ignored,
+        // data is written anyway if the file system doesn't support it
+        if (dataLength >= PreallocateMinSize) ::fallocate(fd, 0, 0, (off_t) dataLength);
+#endif
+        ok = writeData(fd, data, dataLength, 0);
+    }
+    if (!ok && errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(filename);
+
+    // set file permissions on the opened file
+    if (ok) ::fchmod(fd, toFileMode(permissions));
+    if (::close(fd) != 0 && ok) {
+        if (errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(filename);
+        ok = false;
+    }
+    return ok;
+#else
+    QFile file(filename);
+    if (file.exists() && !(file.permissions() & QFile::WriteOwner)) file.setPermissions(file.permissions() | QFile::WriteOwner);
+    if (!file.open(QIODevice::WriteOnly)) {
+        if (errorMessage) *errorMessage = QString("Opens file %1 failure.").arg(filename);
+        return false;
+    }
+    bool ok = true;
+    if (holeFlag) {
+        const QList<GmPackageDataExtent> & extentList = sparseMap->getExtentList();
+        for (int i = 0; ok && i < extentList.size(); i++) {
+            const GmPackageDataExtent & extent = extentList.at(i);
+            ok = file.seek(extent.offset) && file.write(data + extent.offset, extent.length) == extent.length;
+        }
+        if (ok) ok = file.resize(dataLength);
+    } else {
+        ok = (file.write(data, dataLength) == dataLength);
+    }
+    if (!ok) {
+        if (errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(filename);
+        return false;
+    }
+    file.close();
+    file.setPermissions(permissions);
+    return true;
+#endif
+}
+
+bool GmPackageFileWriter::cloneFile(const QString & sourceFilename, const QString & filename,
+        QFile::Permissions permissions, QString *errorMessage)
+{
+#ifdef Q_OS_UNIX
+    int sourceFd = ::open(QFile::encodeName(sourceFilename).constData(), O_RDONLY);
+    if (sourceFd < 0) {
+        if (errorMessage) *errorMessage = QString("Opens file %1 failure.").arg(sourceFilename);
+        return false;
+    }
+    int fd = openFile(QFile::encodeName(filename));
+    if (fd < 0) {
+        ::close(sourceFd);
+        if (errorMessage) *errorMessage = QString("Opens file %1 failure.").arg(filename);
+        return false;
+    }
+
+    // share data extents of source file, data is copied if file system doesn't support it
+    bool ok = false;
+#if defined(Q_OS_LINUX) && defined(FICLONE)
+    ok = (::ioctl(fd, FICLONE, sourceFd) == 0);
+#endif
+    if (!ok) {
+        QByteArray buffer((int) CopyBufferSize, '\0');
+        qint64 offset = 0;
+        ok = true;
+        for (;;) {
+            ssize_t n = ::read(sourceFd, buffer.data(), (size_t) buffer.size());
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) ok = false;
+            if (n <= 0) break;
+            ok = writeData(fd, buffer.constData(), n, offset);
+            if (!ok) break;
+            offset += n;
+        }
+    }
+    if (!ok && errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(filename);
+
+    if (ok) ::fchmod(fd, toFileMode(permissions));
+    ::close(sourceFd);
+    if (::close(fd) != 0 && ok) {
+        if (errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(filename);
+        ok = false;
+    }
+    return ok;
+#else
+    QFile file(filename);
+    if (file.exists()) {
+        file.setPermissions(file.permissions() | QFile::WriteOwner);
+        file.remove();
+    }
+    if (!QFile::copy(sourceFilename, filename)) {
+        if (errorMessage) *errorMessage = QString("Copies file %1 to %2 failure.").arg(sourceFilename).arg(filename);
+        return false;
+    }
+    file.setPermissions(permissions);
+    return true;
+#endif
+}
+
+bool GmPackageFileWriter::linkFile(const QString & sourceFilename, const QString & filename, QString *errorMessage)
+{
+#ifdef Q_OS_UNIX
+    QByteArray path = QFile::encodeName(filename);
+    if (::unlink(path.constData()) != 0 && errno != ENOENT) {
+        if (errorMessage) *errorMessage = QString("Removes file %1 failure.").arg(filename);
+        return false;
+    }
+    if (::link(QFile::encodeName(sourceFilename).constData(), path.constData()) != 0) {
+        if (errorMessage) *errorMessage = QString("Links file %1 to %2 failure.").arg(filename).arg(sourceFilename);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(sourceFilename);
+    if (errorMessage) *errorMessage = QString("Hard link of file %1 is not supported.").arg(filename);
+    return false;
+#endif
+}
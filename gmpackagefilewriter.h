@@ -0,0 +1,96 @@
+#pragma once
+
+#include "gmpackagesparsemap.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+
+class QThread;
+class GmPackageStatistics;
+
+// file of write-behind queue
+struct GmPackageFileWriteTask
+{
+    QString filename;
+    QByteArray data;
+    QFile::Permissions permissions;
+    GmPackageSparseMap sparseMap; // holes of data, stored with the data block
+};
+
+// write-behind writer of installed files, files are queued by install thread and written by writer threads,
+// so uncompress of next data blocks and file system metadata work (create, truncate, chmod, close) overlap.
+// queued data is bounded by queue size, write blocks when the queue is full
+class GmPackageFileWriter
+{
+public:
+    static const int DefaultThreadCount = 4;
+    static const qint64 DefaultQueueSize = 64 * 1024 * 1024;
+    // files of at least this size are preallocated before they are written, smaller files aren't
+    static const qint64 PreallocateMinSize = 1024 * 1024;
+
+    GmPackageFileWriter(int threadCount = DefaultThreadCount, qint64 queueSize = DefaultQueueSize);
+    // files not written yet are dropped if finish isn't called
+    virtual ~GmPackageFileWriter();
+
+    // write time and bytes are added to file write phase of statistics if it isn't NULL
+    void setStatistics(GmPackageStatistics *statistics);
+    // holes of sparse maps of queued files are left unwritten, it must be set before files are queued
+    void setSparseFlag(bool sparseFlag);
+
+    // queue file data, directory of file must exist, an existing file is truncated and made writable.
+    // sparse map is the map stored with the data block, data isn't searched for holes again.
+    // return false if a queued file failed, then no more file is queued
+    bool write(const QString & filename, const QByteArray & data, QFile::Permissions permissions,
+            const GmPackageSparseMap & sparseMap = GmPackageSparseMap());
+    // wait until all queued files are written, return false if a file failed
+    bool finish();
+
+    // messages of failed files
+    QStringList getErrorMessageList() const;
+    // bytes and number of files written by writer threads, and the last written file, progress of install
+    // is reported by written files, queued files may not be written yet
+    void getWrittenProgress(qint64 & writtenBytes, int & writtenCount, QString & lastFilename) const;
+
+    // write file synchronously, open, write, chmod and close are done together on one descriptor.
+    // if sparseMap isn't NULL and has holes, holes are skipped, otherwise a file of at least PreallocateMinSize
+    // is preallocated on linux, so it isn't fragmented, failure of preallocation is ignored.
+    // return false and set errorMessage if it isn't NULL
+    static bool writeFile(const QString & filename, const char *data, qint64 dataLength,
+            QFile::Permissions permissions, const GmPackageSparseMap *sparseMap = NULL, QString *errorMessage = NULL);
+    // write file of same data as written source file, data extents of source are shared by FICLONE
+    // on linux, data is copied from source if it isn't supported, no data is uncompressed again
+    static bool cloneFile(const QString & sourceFilename, const QString & filename,
+            QFile::Permissions permissions, QString *errorMessage = NULL);
+    // replace file by a hard link of source file, the links share data and permissions of source
+    static bool linkFile(const QString & sourceFilename, const QString & filename, QString *errorMessage = NULL);
+
+private:
+    friend class GmPackageFileWriterThread;
+    // loop of writer thread
+    void runWriter();
+
+private:
+    QList<QThread*> m_threadList;
+    QQueue<GmPackageFileWriteTask> m_taskQueue;
+    qint64 m_queueSize;
+    qint64 m_queuedBytes; // bytes of queued and writing files
+    int m_pendingCount; // number of queued and writing files
+    qint64 m_writtenBytes;
+    int m_writtenCount;
+    QString m_lastWrittenFilename;
+    bool m_stopFlag;
+    bool m_failFlag;
+    bool m_sparseFlag;
+    QStringList m_errorMessageList;
+    GmPackageStatistics *m_statistics;
+    mutable QMutex m_mutex;
+    QWaitCondition m_taskCondition; // a task is queued or writer is stopped
+    QWaitCondition m_spaceCondition; // queued bytes are reduced
+    QWaitCondition m_idleCondition; // all queued files are written
+};
@@ -1,16 +1,38 @@
 #include "gmpackageinstaller.h"
+#include "gmpackagefilewriter.h"
 
 #include <QDir>
+#include <QThreadPool>
+#include <QScopedPointer>
+#include <QSet>
+#include <QHash>
+#include <QPair>
+
+#include <algorithm>
 
 GmPackageInstaller::GmPackageInstaller(const QString & startDirName)
 {
     m_startDirName = startDirName;
+    m_verifyFlag = false;
+    m_writerThreadCount = GmPackageFileWriter::DefaultThreadCount;
+    m_sparseFlag = false;
+    m_duplicateMode = DuplicateWriteMode;
+    m_progressDevice = NULL;
+    qRegisterMetaType<GmPackageStatistics>("GmPackageStatistics");
+    qRegisterMetaType<GmPackageProgressInfo>("GmPackageProgressInfo");
 }
 
 GmPackageInstaller::GmPackageInstaller(const QString & startDirName, const QString & packageFilename)
 {
     m_startDirName = startDirName;
     m_packageFilename = packageFilename;
+    m_verifyFlag = false;
+    m_writerThreadCount = GmPackageFileWriter::DefaultThreadCount;
+    m_sparseFlag = false;
+    m_duplicateMode = DuplicateWriteMode;
+    m_progressDevice = NULL;
+    qRegisterMetaType<GmPackageStatistics>("GmPackageStatistics");
+    qRegisterMetaType<GmPackageProgressInfo>("GmPackageProgressInfo");
 }
 
 GmPackageInstaller::~GmPackageInstaller() { }
@@ -43,7 +65,7 @@ bool GmPackageInstaller::setPackageFilename(const QString & packageFilename)
 int GmPackageInstaller::getPackageFileNumber()
 {
     if (m_packageFilename.isEmpty()) return 0;
-    GmPackageManager lopm(m_packageFilename);
+    GmPackageManager lopm(m_packageFilename, m_encryptionKey);
     bool ok = lopm.isValid();
     if (ok) {
         return lopm.getFileNumber();
@@ -54,7 +76,7 @@ int GmPackageInstaller::getPackageFileNumber()
 int GmPackageInstaller::getPackageFileNumber(int sort)
 {
     if (m_packageFilename.isEmpty()) return 0;
-    GmPackageManager lopm(m_packageFilename);
+    GmPackageManager lopm(m_packageFilename, m_encryptionKey);
     bool ok = lopm.isValid();
     if (ok) {
         return lopm.getFileNumber(sort);
@@ -65,7 +87,7 @@ int GmPackageInstaller::getPackageFileNumber(int sort)
 int GmPackageInstaller::getPackageFileNumber(const QList<int> & sortList)
 {
     if (m_packageFilename.isEmpty()) return 0;
-    GmPackageManager lopm(m_packageFilename);
+    GmPackageManager lopm(m_packageFilename, m_encryptionKey);
     bool ok = lopm.isValid();
     if (ok) {
         return lopm.getFileNumber(sortList);
@@ -152,10 +174,11 @@ void GmPackageInstaller::clearFilenameList()
     m_filenameList.clear();
 }
 
-char *GmPackageInstaller::getFileData(const QString & packageFilename, const QString & filename, qint64 & fileSize)
+char *GmPackageInstaller::getFileData(const QString & packageFilename, const QString & filename, qint64 & fileSize,
+        const QByteArray & userKey)
 {
     // package manager
-    GmPackageManager lopm(packageFilename);
+    GmPackageManager lopm(packageFilename, userKey);
     bool ok = lopm.isValid();
     if (!ok) return NULL;
 
@@ -167,6 +190,80 @@ char *GmPackageInstaller::getFileData(const QString & packageFilename, const QSt
     return fileData;
 }
 
+void GmPackageInstaller::setEncryptionKey(const QByteArray & userKey)
+{
+    m_encryptionKey = userKey;
+}
+
+void GmPackageInstaller::setVerifyFlag(bool verifyFlag)
+{
+    m_verifyFlag = verifyFlag;
+}
+
+bool GmPackageInstaller::getVerifyFlag() const
+{
+    return m_verifyFlag;
+}
+
+bool GmPackageInstaller::verifyPackage(const QString & packageFilename, bool printInfo)
+{
+    return verifyPackage(packageFilename, QStringList(), printInfo);
+}
+
+bool GmPackageInstaller::verifyPackage(const QString & packageFilename, const QStringList & filenames, bool printInfo)
+{
+    clearErrorMessage();
+    if (packageFilename.isEmpty()) return false;
+    bool ok = false;
+
+    GmPackageFileHandle packageHandle(packageFilename);
+    ok = packageHandle.isOpen();
+    if (!ok) {
+        QString errInfo = QString("Opens package file %1 failure.").arg(packageFilename);
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
+
+    // checksum of file information is verified when package is loaded
+    GmPackageManager lopm;
+    lopm.setEncryptionKey(m_encryptionKey);
+    lopm.setStatistics(&m_statistics);
+    ok = lopm.load(packageFilename);
+    if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
+        QString errInfo = QString("Loads package file %1 failure.").arg(packageFilename);
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
+
+    // all files of package if filenames is empty, otherwise the first item of every filename
+    QList<GmPackageFileInfoItem> lopFileInfoList;
+    if (filenames.isEmpty()) {
+        lopFileInfoList = lopm.getFileInfoList();
+    } else {
+        for (int i = 0; i < filenames.size(); i++) {
+            GmPackageFileInfoItem item;
+            int index = lopm.indexOf(filenames.at(i));
+            if (index < 0 || !lopm.getFileInfo(index, item)) {
+                m_errorMessageList.append(QString("File %1 isn't found in package %2.").arg(filenames.at(i)).arg(packageFilename));
+                continue;
+            }
+            lopFileInfoList.append(item);
+        }
+        if (lopFileInfoList.size() != filenames.size()) return false;
+    }
+
+    if (printInfo) {
+        QByteArray ba = packageFilename.toLocal8Bit();
+        printf("Verifying %d files of %s\n", lopFileInfoList.size(), ba.data());
+        if (!lopm.getManifestRoot().isEmpty()) printf("Manifest root: %s\n", lopm.getManifestRoot().toHex().constData());
+        fflush(0);
+    }
+    ok = lopm.verifyDataFiles(packageHandle, lopFileInfoList, m_errorMessageList);
+    emit statisticsReady(m_statistics);
+    return ok;
+}
+
 bool GmPackageInstaller::installPackage(bool printInfo)
 {
     return installPackage(m_packageFilename, printInfo);
@@ -178,26 +275,29 @@ bool GmPackageInstaller::installPackage(const QString & packageFilename, bool pr
     if (packageFilename.isEmpty()) return false;
     bool ok = false;
 
-    QFile packageFile(packageFilename);
-    ok = packageFile.open(QIODevice::ReadOnly);
+    GmPackageFileHandle packageHandle(packageFilename);
+    ok = packageHandle.isOpen();
     if (!ok) {
         QString errInfo = QString("Opens package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package manager
-    GmPackageManager lopm(packageFilename);
+    // package manager, load time is added to statistics
+    GmPackageManager lopm;
+    lopm.setEncryptionKey(m_encryptionKey);
+    lopm.setStatistics(&m_statistics);
+    ok = lopm.load(packageFilename);
 
     // load package information
-    ok = lopm.isValid();
     if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
         QString errInfo = QString("Loads package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package information data m_fileInfoList or part list filtered by sort list
+    // package information data or part list filtered by sort list
     QList<GmPackageFileInfoItem> lopFileInfoFullList;
     ok = getFilteredFileInfoFullList(lopm, lopFileInfoFullList);
     if (!ok) {
@@ -205,7 +305,7 @@ bool GmPackageInstaller::installPackage(const QString & packageFilename, bool pr
         m_errorMessageList.append(errInfo);
         return false;
     } else {
-        ok = installDataFiles(lopm, packageFile, lopFileInfoFullList, printInfo);
+        ok = installDataFiles(lopm, packageHandle, lopFileInfoFullList, printInfo);
     }
     return ok;
 }
@@ -213,59 +313,41 @@ bool GmPackageInstaller::installPackage(const QString & packageFilename, bool pr
 bool GmPackageInstaller::getFilteredFileInfoFullList(GmPackageManager & lopm, QList<GmPackageFileInfoItem> & lopFileInfoFullList)
 {
     lopFileInfoFullList.clear();
-    bool ok = true;
-    QList<GmPackageFileInfoItem> filteredFileInfoList = lopm.getFileInfoList();
-    QList<GmPackageFileInfoItem> filteredFileInfoListTmp;
-
-    // filter by sort
-    if (!m_sortList.isEmpty()) {
-        ok = GmPackageManager::getFileInfoList(filteredFileInfoList, m_sortList, filteredFileInfoListTmp);
-        if (!ok) return false;
-        filteredFileInfoList = filteredFileInfoListTmp;
-    }
-
-    // filter by directory name list
-    QList<GmPackageFileInfoItem> filteredDirFileInfoList;
-    if (!m_dirNameList.isEmpty()) {
-        for (int i = 0; i < m_dirNameList.size(); i++) {
-            QList<GmPackageFileInfoItem> fileInfoList;
-            ok = GmPackageManager::getFileInfoList(filteredFileInfoList, m_dirNameList.at(i), true, fileInfoList);
-            if (ok) filteredDirFileInfoList << fileInfoList;
-        }
-    }
+    const GmPackageFileIndex & fileIndex = lopm.getFileIndex();
 
-    // filter by filename list
-    QList<GmPackageFileInfoItem> filteredFilenameFileInfoList;
+    // items of filename list are found by lookup table of file index
+    QVector<bool> filenameFlags;
     if (!m_filenameList.isEmpty()) {
-        QStringList filenames;
-        ok = GmPackageManager::getFilenames(filteredFileInfoList, filenames);
-        if (ok) {
-            for (int i = 0; i < m_filenameList.size(); i++) {
-                int index = filenames.indexOf(m_filenameList.at(i));
-                if (index >= 0) {
-                    const GmPackageFileInfoItem & item = filteredFileInfoList.at(index);
-                    filteredFilenameFileInfoList.append(item);
-                }
-            }
+        filenameFlags.fill(false, fileIndex.size());
+        for (int i = 0; i < m_filenameList.size(); i++) {
+            int index = fileIndex.indexOf(m_filenameList.at(i));
+            if (index >= 0) filenameFlags[index] = true;
         }
     }
-    if (!filteredDirFileInfoList.isEmpty() || !filteredFilenameFileInfoList.isEmpty()) {
-        QStringList filenames;
-        ok = GmPackageManager::getFilenames(filteredDirFileInfoList, filenames);
-        if (ok) {
-            filteredFileInfoList = filteredDirFileInfoList;
-            for (int i = 0; i < filteredFilenameFileInfoList.size(); i++) {
-                const GmPackageFileInfoItem & item = filteredFileInfoList.at(i);
-                if (!filenames.contains(item.filename)) {
-                    filteredFileInfoList.append(item);
-                }
+    // empty directory name contains all files
+    QStringList dirNameSepList;
+    for (int i = 0; i < m_dirNameList.size(); i++) {
+        QString dirNameSep = m_dirNameList.at(i);
+        if (!dirNameSep.isEmpty() && !dirNameSep.endsWith(QDir::separator())) dirNameSep += QDir::separator();
+        dirNameSepList.append(dirNameSep);
+    }
+
+    // items are filtered in file index by sort, then by directory name or filename, only matched items are copied
+    bool nameFilterFlag = (!dirNameSepList.isEmpty() || !filenameFlags.isEmpty());
+    for (int i = 0; i < fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = fileIndex.record(i);
+        if (record.deleteFlag) continue;
+        if (!m_sortList.isEmpty() && !m_sortList.contains(record.sort)) continue;
+        if (nameFilterFlag) {
+            bool matched = (!filenameFlags.isEmpty() && filenameFlags.at(i));
+            QStringRef filename = fileIndex.filenameRef(i);
+            for (int j = 0; j < dirNameSepList.size() && !matched; j++) {
+                matched = filename.startsWith(dirNameSepList.at(j));
             }
-        } else {
-            filteredFileInfoList << filteredFilenameFileInfoList;
+            if (!matched) continue;
         }
+        lopFileInfoFullList.append(fileIndex.at(i));
     }
-
-    lopFileInfoFullList = filteredFileInfoList;
     return (!lopFileInfoFullList.isEmpty());
 }
 
@@ -295,26 +377,29 @@ bool GmPackageInstaller::installFile(const QString & packageFilename, const QStr
     if (packageFilename.isEmpty()) return false;
     bool ok = false;
 
-    QFile packageFile(packageFilename);
-    ok = packageFile.open(QIODevice::ReadOnly);
+    GmPackageFileHandle packageHandle(packageFilename);
+    ok = packageHandle.isOpen();
     if (!ok) {
         QString errInfo = QString("Opens package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package manager
-    GmPackageManager lopm(packageFilename);
+    // package manager, load time is added to statistics
+    GmPackageManager lopm;
+    lopm.setEncryptionKey(m_encryptionKey);
+    lopm.setStatistics(&m_statistics);
+    ok = lopm.load(packageFilename);
 
     // load package information
-    ok = lopm.isValid();
     if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
         QString errInfo = QString("Loads package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package information data m_fileInfoList or part list filtered by sort list
+    // package information data or part list filtered by sort list
     QList<GmPackageFileInfoItem> lopFileInfoList;
     GmPackageFileInfoItem item;
     ok = lopm.getFileInfo(filename, item);
@@ -324,7 +409,7 @@ bool GmPackageInstaller::installFile(const QString & packageFilename, const QStr
         return false;
     }
     lopFileInfoList.append(item);
-    ok = installDataFiles(lopm, packageFile, lopFileInfoList, printInfo);
+    ok = installDataFiles(lopm, packageHandle, lopFileInfoList, printInfo);
     return ok;
 }
 
@@ -339,26 +424,29 @@ bool GmPackageInstaller::installFilesInDir(const QString & packageFilename, cons
     if (packageFilename.isEmpty()) return false;
     bool ok = false;
 
-    QFile packageFile(packageFilename);
-    ok = packageFile.open(QIODevice::ReadOnly);
+    GmPackageFileHandle packageHandle(packageFilename);
+    ok = packageHandle.isOpen();
     if (!ok) {
         QString errInfo = QString("Opens package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // package manager
-    GmPackageManager lopm(packageFilename);
+    // package manager, load time is added to statistics
+    GmPackageManager lopm;
+    lopm.setEncryptionKey(m_encryptionKey);
+    lopm.setStatistics(&m_statistics);
+    ok = lopm.load(packageFilename);
 
     // load package information
-    ok = lopm.isValid();
     if (!ok) {
+        m_errorMessageList.append(lopm.getErrorMessage());
         QString errInfo = QString("Loads package file %1 failure.").arg(packageFilename);
         m_errorMessageList.append(errInfo);
         return false;
     }
 
-    // part of package information data m_fileInfoList filtered by directory name
+    // part of package information data filtered by directory name
     QList<GmPackageFileInfoItem> lopFileInfoSortList;
     ok = lopm.getFileInfoList(dirName, containsSubdir, lopFileInfoSortList);
     if (!ok) {
@@ -366,32 +454,37 @@ bool GmPackageInstaller::installFilesInDir(const QString & packageFilename, cons
         m_errorMessageList.append(errInfo);
         return false;
     }
-    ok = installDataFiles(lopm, packageFile, lopFileInfoSortList, printInfo);
+    ok = installDataFiles(lopm, packageHandle, lopFileInfoSortList, printInfo);
     return ok;
 }
 
-bool GmPackageInstaller::installDataFiles(GmPackageManager & lopm, QFile & packageFile, const QList<GmPackageFileInfoItem> & lopFileInfoList, bool printInfo)
+bool GmPackageInstaller::installDataFiles(GmPackageManager & lopm, GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & lopFileInfoList, bool printInfo)
 {
     bool ok = false;
     QDir startDir(m_startDirName);
-    int percent = 0;
     int fileNumber = lopFileInfoList.size();
+    int fileIndex = 0;
+    lopm.setVerifyFlag(m_verifyFlag);
+    m_progress.start(fileNumber, GmPackageManager::getFileDataSize(lopFileInfoList));
+
+    // all directories of files are created at first, then paths of files are found in directory cache
+    ok = createDirs(startDir, lopFileInfoList);
+    if (!ok) return false;
+
+    // install symbolic links and empty files first, files with data are installed later by data position
+    QList<GmPackageFileInfoItem> dataFileInfoList;
     for (int i = 0; i < fileNumber; i++) {
-        // get file information item (filename, position, compressed length, original length) from package file information list
         const GmPackageFileInfoItem & item = lopFileInfoList.at(i);
-        if (item.deleteFlag) continue;
+        if (item.deleteFlag) {
+            fileIndex++;
+            continue;
+        }
+        if (!item.isSymLink && item.originalDataLength > 0) {
+            dataFileInfoList.append(item);
+            continue;
+        }
 
-        // current file
         QString filename = startDir.absoluteFilePath(item.filename);
-        percent = (int) (1.0 * (i + 1) / fileNumber * 100);
-
-        if (printInfo) {
-            QByteArray ba = filename.toLocal8Bit();
-            if (i == 0) printf("\n");
-            printf("\r%5d of %5d, %s", i + 1, fileNumber, ba.data());
-            if (i == fileNumber - 1) printf("\n");
-            fflush(0);
-        }
 
         ok = createPath(filename);
         if (!ok) return false;
@@ -399,7 +492,6 @@ bool GmPackageInstaller::installDataFiles(GmPackageManager & lopm, QFile & packa
         ok = setFile2Writable(filename);
         if (!ok) return false;
 
-        // input compressed data from package
         if (item.isSymLink) {
             // create symbolic link
             ok = createSymbolicLink(filename, item);
@@ -408,7 +500,7 @@ bool GmPackageInstaller::installDataFiles(GmPackageManager & lopm, QFile & packa
                 m_errorMessageList.append(errInfo);
                 //return false; // maybe symbolic created before source file or directory
             }
-        } else if (item.originalDataLength == 0) {
+        } else {
             // create empty file to destination dir
             ok = createEmptyFile(filename, item);
             if (!ok) {
@@ -416,47 +508,231 @@ bool GmPackageInstaller::installDataFiles(GmPackageManager & lopm, QFile & packa
                 m_errorMessageList.append(errInfo);
                 return false;
             }
-        } else {
-            // input data file from package file
-            char *data = lopm.readDataFile(packageFile, item);
-            if (data == NULL) {
-                m_errorMessageList.append(lopm.getErrorMessage());
-                return false;
+        }
+        updateProgress(filename, fileIndex, 0, printInfo);
+        fileIndex++;
+    }
+
+    // files of same data as a previous file aren't read, they are cloned or linked after files are written,
+    // file data is same if data block, offset in block and length are same
+    QList<GmPackageFileInfoItem> duplicateFileInfoList;
+    QList<GmPackageFileInfoItem> sourceFileInfoList; // installed copy of duplicate file
+    if (m_duplicateMode != DuplicateWriteMode) {
+        typedef QPair<QPair<qint32, qint64>, QPair<qint64, qint64> > DataKey;
+        QHash<DataKey, int> sourceIndexHash;
+        QList<GmPackageFileInfoItem> uniqueFileInfoList;
+        for (int i = 0; i < dataFileInfoList.size(); i++) {
+            const GmPackageFileInfoItem & item = dataFileInfoList.at(i);
+            DataKey key(QPair<qint32, qint64>(item.volume, item.position), QPair<qint64, qint64>(item.blockOffset, item.originalDataLength));
+            int sourceIndex = sourceIndexHash.value(key, -1);
+            if (sourceIndex >= 0) {
+                duplicateFileInfoList.append(item);
+                sourceFileInfoList.append(uniqueFileInfoList.at(sourceIndex));
+                continue;
             }
+            sourceIndexHash.insert(key, uniqueFileInfoList.size());
+            uniqueFileInfoList.append(item);
+        }
+        dataFileInfoList = uniqueFileInfoList;
+    }
 
-            // open file for write and delete original and compressed data buffer
-            ok = createDataFile(filename, data, item);
-            if (!ok) {
-                if (data) delete []data;
-                m_errorMessageList.append(lopm.getErrorMessage());
+    // files with data are sorted by data position, and adjacent data blocks are read at once,
+    // so the package file and every data volume are read forward sequentially
+    QList<GmPackageReadRun> runList = lopm.getReadRunList(dataFileInfoList);
+    packageHandle.adviseSequential();
+
+    // uncompressed files are written behind by writer threads, while next runs are read and uncompressed,
+    // progress of them is updated by written files
+    QScopedPointer<GmPackageFileWriter> writer;
+    int writerStartIndex = fileIndex;
+    qint64 writtenBytes = 0;
+    int writtenCount = 0;
+    if (m_writerThreadCount > 0 && !dataFileInfoList.isEmpty()) {
+        writer.reset(new GmPackageFileWriter(m_writerThreadCount));
+        writer->setStatistics(&m_statistics);
+        writer->setSparseFlag(m_sparseFlag);
+    }
+
+    // runs are read and uncompressed in parallel by windows of thread number runs,
+    // runs of data volumes are interleaved, so one window reads several volumes at the same time
+    int windowSize = qMax(1, QThreadPool::globalInstance()->maxThreadCount());
+    for (int i = 0; i < runList.size(); i += windowSize) {
+        QList<GmPackageReadRun> windowRunList = runList.mid(i, windowSize);
+
+        // read ahead data blocks of next window while files of current window are installed
+        for (int j = i + windowSize; j < i + 2 * windowSize && j < runList.size(); j++) {
+            const GmPackageReadRun & nextRun = runList.at(j);
+            packageHandle.adviseWillNeed(nextRun.position, nextRun.length, nextRun.volume);
+        }
+
+        // input and uncompress data of files from package file
+        QList<QList<GmPackageReadResult> > runResultList;
+        lopm.readDataRuns(packageHandle, windowRunList, dataFileInfoList, runResultList);
+
+        QList<GmPackageReadResult> resultList;
+        for (int j = 0; j < runResultList.size(); j++) resultList.append(runResultList.at(j));
+
+        for (int j = 0; j < resultList.size(); j++) {
+            const GmPackageReadResult & result = resultList.at(j);
+            const GmPackageFileInfoItem & item = result.item;
+
+            // current file
+            QString filename = startDir.absoluteFilePath(item.filename);
+
+            if (!result.ok) {
+                m_errorMessageList.append(result.errorMessage);
                 return false;
             }
-            if (data) delete []data;
+
+            ok = createPath(filename);
+            if (!ok) return false;
+
+            if (result.streamFlag) {
+                // large data block is copied now, progress of writer is counted behind it
+                ok = createLargeDataFile(filename, lopm, packageHandle, item);
+                if (!ok) return false;
+                updateProgress(filename, fileIndex, item.originalDataLength, printInfo);
+                writerStartIndex++;
+            } else if (writer) {
+                // queue file, data is shared with the result
+                ok = writer->write(filename, result.data, item.permissions, result.sparseMap);
+                if (!ok) {
+                    m_errorMessageList.append(writer->getErrorMessageList());
+                    return false;
+                }
+                updateWriterProgress(*writer, writerStartIndex, writtenBytes, writtenCount, printInfo);
+            } else {
+                // open file for write and output data, existing read only file is made writable by file writer
+                ok = createDataFile(filename, result.data.constData(), item, result.sparseMap);
+                if (!ok) return false;
+                updateProgress(filename, fileIndex, item.originalDataLength, printInfo);
+            }
+            fileIndex++;
+        }
+    }
+    if (writer) {
+        ok = writer->finish();
+        if (!ok) {
+            m_errorMessageList.append(writer->getErrorMessageList());
+            return false;
         }
-        emit currentProgress(filename, percent);
-        emit currentFile(filename, i);
+        updateWriterProgress(*writer, writerStartIndex, writtenBytes, writtenCount, printInfo);
     }
+
+    // all source files are written, duplicate files are created from them
+    for (int i = 0; i < duplicateFileInfoList.size(); i++) {
+        const GmPackageFileInfoItem & item = duplicateFileInfoList.at(i);
+        const GmPackageFileInfoItem & sourceItem = sourceFileInfoList.at(i);
+        QString filename = startDir.absoluteFilePath(item.filename);
+
+        ok = createPath(filename);
+        if (!ok) return false;
+
+        ok = createDuplicateFile(filename, startDir.absoluteFilePath(sourceItem.filename), item, sourceItem);
+        if (!ok) return false;
+
+        updateProgress(filename, fileIndex, item.originalDataLength, printInfo);
+        fileIndex++;
+    }
+    m_progress.finish();
+    reportProgress(printInfo);
+    emit statisticsReady(m_statistics);
     return true;
 }
 
+void GmPackageInstaller::updateProgress(const QString & filename, int index, qint64 bytes, bool printInfo)
+{
+    m_progress.addBytes(bytes);
+    if (m_progress.update(filename, index)) reportProgress(printInfo);
+}
+
+void GmPackageInstaller::updateWriterProgress(const GmPackageFileWriter & writer, int startIndex,
+        qint64 & writtenBytes, int & writtenCount, bool printInfo)
+{
+    qint64 bytes = 0;
+    int count = 0;
+    QString filename;
+    writer.getWrittenProgress(bytes, count, filename);
+    if (count == writtenCount) return;
+
+    m_progress.addBytes(bytes - writtenBytes);
+    writtenBytes = bytes;
+    writtenCount = count;
+    if (m_progress.update(filename, startIndex + count - 1)) reportProgress(printInfo);
+}
+
+void GmPackageInstaller::reportProgress(bool printInfo)
+{
+    const GmPackageProgressInfo & info = m_progress.getInfo();
+    int percent = info.getPercent();
+    if (percent >= 0) emit currentProgress(info.filename, percent);
+    emit currentFile(info.filename, info.fileIndex);
+    emit progressReport(info);
+
+    if (m_progressDevice) {
+        QByteArray line = info.toJson().toUtf8();
+        line.append('\n');
+        m_progressDevice->write(line);
+    }
+    if (printInfo) {
+        QByteArray ba = info.filename.toLocal8Bit();
+        double mbPerSecond = info.bytesPerSecond / (1024.0 * 1024.0);
+        printf("\r%5d of %5d, %7.2f MB/s, ETA %5.0f s, %s", info.fileIndex + 1, info.fileNumber, mbPerSecond, qMax(0.0, info.etaSeconds), ba.data());
+        if (info.finished) printf("\n");
+        fflush(stdout);
+    }
+}
+
 bool GmPackageInstaller::createPath(const QString & filename)
 {
     if (filename.isEmpty()) return false;
 
     QFileInfo info(filename);
-    QString filePath = info.absolutePath();
+    return createDir(info.absolutePath());
+}
+
+bool GmPackageInstaller::createDir(const QString & filePath)
+{
+    if (m_createdDirSet.contains(filePath)) return true;
+
     QFileInfo pathInfo(filePath);
-    if (pathInfo.exists() && !pathInfo.isDir()) {
+    bool existFlag = pathInfo.exists();
+    if (existFlag && !pathInfo.isDir()) {
         QString errInfo = QString("Exists same name as %1, but that is not a directory path.").arg(filePath);
         m_errorMessageList.append(errInfo);
         return false;
     }
-    QDir fileDir;
-    bool ok = fileDir.mkpath(filePath);
-    if (!ok) {
-        QString errInfo = QString("Creates the directory path %1 failure.").arg(filePath);
-        m_errorMessageList.append(errInfo);
-        return false;
+    if (!existFlag) {
+        QDir fileDir;
+        bool ok = fileDir.mkpath(filePath);
+        if (!ok) {
+            QString errInfo = QString("Creates the directory path %1 failure.").arg(filePath);
+            m_errorMessageList.append(errInfo);
+            return false;
+        }
+    }
+    m_createdDirSet.insert(filePath);
+    return true;
+}
+
+bool GmPackageInstaller::createDirs(const QDir & startDir, const QList<GmPackageFileInfoItem> & fileInfoList)
+{
+    m_createdDirSet.clear();
+
+    // unique directories of files, a parent directory is sorted before its subdirectories
+    QSet<QString> dirSet;
+    for (int i = 0; i < fileInfoList.size(); i++) {
+        const GmPackageFileInfoItem & item = fileInfoList.at(i);
+        if (item.deleteFlag) continue;
+        QFileInfo info(startDir.absoluteFilePath(item.filename));
+        dirSet.insert(info.absolutePath());
+    }
+    QStringList dirList(dirSet.begin(), dirSet.end());
+    std::sort(dirList.begin(), dirList.end());
+
+    for (int i = 0; i < dirList.size(); i++) {
+        bool ok = createDir(dirList.at(i));
+        if (!ok) return false;
     }
     return true;
 }
@@ -515,35 +791,120 @@ bool GmPackageInstaller::createEmptyFile(const QString & filename, const GmPacka
     return false;
 }
 
-bool GmPackageInstaller::createDataFile(const QString & filename, const char *data, const GmPackageFileInfoItem & item)
+bool GmPackageInstaller::createDataFile(const QString & filename, const char *data, const GmPackageFileInfoItem & item,
+        const GmPackageSparseMap & sparseMap)
 {
     if (filename.isEmpty()) return false;
     qint64 dataLength = item.originalDataLength;
     if (data == NULL || dataLength == 0) return false;
     bool ok = false;
+    GmPackageStatisticsTimer timer(&m_statistics, GmPackageStatistics::FileWritePhase, dataLength);
+
+    // open, write and set permissions on one file descriptor
+    QString errInfo;
+    ok = GmPackageFileWriter::writeFile(filename, data, dataLength, item.permissions, m_sparseFlag ? &sparseMap : NULL, &errInfo);
+    if (!ok) {
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
+
+    return true;
+}
+
+bool GmPackageInstaller::createLargeDataFile(const QString & filename, GmPackageManager & lopm,
+        GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item)
+{
+    if (filename.isEmpty()) return false;
+    bool ok = setFile2Writable(filename);
+    if (!ok) return false;
 
     QFile file(filename);
     ok = file.open(QIODevice::WriteOnly);
     if (!ok) {
-        QString errInfo = QString("Opens file %1 failure.").arg(filename);
-        m_errorMessageList.append(errInfo);
+        m_errorMessageList.append(QString("Opens file %1 failure.").arg(filename));
         return false;
     }
 
-    // write all data to file
-    qint64 nb = file.write(data, dataLength);
-    if (nb != dataLength) {
-        QString errInfo = QString("Outputs data to file %1 failure.").arg(filename);
+    // data is read, verified and decrypted in chunks by package manager
+    QString errInfo;
+    ok = lopm.copyDataFile(packageHandle, item, file, &errInfo);
+    if (!ok) {
         m_errorMessageList.append(errInfo);
         return false;
     }
-
-    // set file permissions
     file.setPermissions(item.permissions);
+    file.close();
+    return true;
+}
+
+bool GmPackageInstaller::createDuplicateFile(const QString & filename, const QString & sourceFilename,
+        const GmPackageFileInfoItem & item, const GmPackageFileInfoItem & sourceItem)
+{
+    GmPackageStatisticsTimer timer(&m_statistics, GmPackageStatistics::FileWritePhase, item.originalDataLength);
 
+    // hard link shares permissions of source, file system without hard links falls back to clone
+    QString errInfo;
+    if (m_duplicateMode == DuplicateHardLinkMode && item.permissions == sourceItem.permissions) {
+        if (GmPackageFileWriter::linkFile(sourceFilename, filename, &errInfo)) return true;
+    }
+    bool ok = GmPackageFileWriter::cloneFile(sourceFilename, filename, item.permissions, &errInfo);
+    if (!ok) {
+        m_errorMessageList.append(errInfo);
+        return false;
+    }
     return true;
 }
 
+void GmPackageInstaller::setWriterThreadCount(int threadCount)
+{
+    m_writerThreadCount = qMax(0, threadCount);
+}
+
+int GmPackageInstaller::getWriterThreadCount() const
+{
+    return m_writerThreadCount;
+}
+
+void GmPackageInstaller::setSparseFlag(bool sparseFlag)
+{
+    m_sparseFlag = sparseFlag;
+}
+
+bool GmPackageInstaller::getSparseFlag() const
+{
+    return m_sparseFlag;
+}
+
+void GmPackageInstaller::setDuplicateMode(int duplicateMode)
+{
+    m_duplicateMode = duplicateMode;
+}
+
+int GmPackageInstaller::getDuplicateMode() const
+{
+    return m_duplicateMode;
+}
+
+void GmPackageInstaller::setProgressInterval(int msecs)
+{
+    m_progress.setInterval(msecs);
+}
+
+void GmPackageInstaller::setProgressDevice(QIODevice *device)
+{
+    m_progressDevice = device;
+}
+
+const GmPackageStatistics & GmPackageInstaller::getStatistics() const
+{
+    return m_statistics;
+}
+
+void GmPackageInstaller::clearStatistics()
+{
+    m_statistics.clear();
+}
+
 void GmPackageInstaller::clearErrorMessage()
 {
     m_errorMessageList.clear();
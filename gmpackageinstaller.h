@@ -1,9 +1,15 @@
 #pragma once
 
 #include "gmpackagemanager.h"
+#include "gmpackagefilehandle.h"
+#include "gmpackagestatistics.h"
+#include "gmpackageprogress.h"
+#include "gmpackagefilewriter.h"
 
 #include <QThread>
 #include <QStringList>
+#include <QSet>
+#include <QDir>
 
 class GmPackageInstaller : public QThread
 {
@@ -18,9 +24,14 @@ protected:
     void run();
 
 signals:
+    // progress signals are emitted at most once every progress interval, and for the last file
     void currentProgress(const QString & filename, int percent); // percent value from 0 to 100
     void currentFile(const QString & filename, int index); // index is file index number, from 0 to n-1
+    void progressReport(const GmPackageProgressInfo & info); // bytes, throughput and ETA
     void finished(bool ok);
+    // cumulative statistics at the end of install or verify, time of phases run by many threads
+    // (uncompress, file write by writer threads) is summed over the threads, not wall time
+    void statisticsReady(const GmPackageStatistics & statistics);
 
 public:
     // set start directory name
@@ -46,8 +57,10 @@ public:
     bool setFilenameList(const QStringList & filenameList);
     void clearFilenameList();
 
-    // get data file, failure return NULL, otherwise return data buffer and set file data length to fileSize
-    static char *getFileData(const QString & packageFilename, const QString & filename, qint64 & fileSize);
+    // get data file, failure return NULL, otherwise return data buffer and set file data length to fileSize,
+    //   the package is loaded for every call, use GmPackageReader to get many files from one package
+    static char *getFileData(const QString & packageFilename, const QString & filename, qint64 & fileSize,
+            const QByteArray & userKey = QByteArray());
 
     // release package m_packageFilename
     bool installPackage(bool printInfo = false);
@@ -55,6 +68,45 @@ public:
     bool installPackage(const QString & packageFilename, int sort, bool printInfo = false);
     bool installPackage(const QString & packageFilename, const QList<int> & sortList, bool printInfo = false);
 
+    // user key of package encrypted by ChaCha20, data blocks are decrypted before they are uncompressed
+    void setEncryptionKey(const QByteArray & userKey);
+
+    // progress is reported at most once every interval milliseconds by signals, console output of printInfo
+    // and JSON lines written to progress device. device isn't owned, NULL means no JSON lines,
+    // total bytes are data size of installed files
+    void setProgressInterval(int msecs = GmPackageProgress::DefaultInterval);
+    void setProgressDevice(QIODevice *device);
+
+    // number of write-behind threads of files with data, files are queued and written by the threads
+    // while next data blocks are uncompressed, 0 means files are written by install thread
+    void setWriterThreadCount(int threadCount = GmPackageFileWriter::DefaultThreadCount);
+    int getWriterThreadCount() const;
+
+    // holes of sparse data blocks (see GmPackageSparseMap) are left in installed files, default is false,
+    // only the sparse map stored in the package is used, files of data blocks without a map are written fully.
+    // files of at least 1 MiB without holes are preallocated on linux, preallocation failure is ignored
+    void setSparseFlag(bool sparseFlag = true);
+    bool getSparseFlag() const;
+
+    // install mode of files sharing one data block with a previous file (see GmPackageBuilder deduplicate mode),
+    // write mode writes data of every file, clone mode clones the first installed copy by reflink (data is
+    // copied if file system can't clone), hard link mode links the first copy if permissions are same, otherwise
+    // clones it. files linked by a previous install share data, so reinstall over them changes all links
+    enum DuplicateMode { DuplicateWriteMode, DuplicateCloneMode, DuplicateHardLinkMode };
+    void setDuplicateMode(int duplicateMode = DuplicateCloneMode);
+    int getDuplicateMode() const;
+
+    // verify checksum of file data when it is installed (package version >= 6)
+    void setVerifyFlag(bool verifyFlag = true);
+    bool getVerifyFlag() const;
+
+    // verify checksums of file information and all data blocks of package, data aren't uncompressed,
+    // data blocks are read in parallel, messages of wrong blocks are in error message list
+    bool verifyPackage(const QString & packageFilename, bool printInfo = false);
+    // like upper, but only data of the files are verified, with merkle tree manifest (version >= 7)
+    // verify time is proportional to data of the files
+    bool verifyPackage(const QString & packageFilename, const QStringList & filenames, bool printInfo = false);
+
     // release one file in package
     bool installFile(const QString & filename, bool printInfo = false);
     bool installFile(const QString & packageFilename, const QString & filename, bool printInfo = false);
@@ -63,22 +115,45 @@ public:
     bool installFilesInDir(const QString & dirName, bool containsSubdir, bool printInfo = false);
     bool installFilesInDir(const QString & packageFilename, const QString & dirName, bool containsSubdir, bool printInfo = false);
 
+    // per-phase time and bytes of installs and verifies, counters are cumulative until they are cleared
+    const GmPackageStatistics & getStatistics() const;
+    void clearStatistics();
+
     // error message
     void clearErrorMessage(); // clear error message list
     const QStringList & getErrorMessage() const;
 
 private:
-    // fetch file data from package
-    bool installDataFiles(GmPackageManager & lopm, QFile & packageFile, const QList<GmPackageFileInfoItem> & lopFileInfoList, bool printInfo = false);
-    // create dir by filename
+    // fetch file data from package, data blocks are read by data position order with read coalescing,
+    // coalesced reads are uncompressed in parallel, data volumes of split package are opened on demand
+    bool installDataFiles(GmPackageManager & lopm, GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & lopFileInfoList, bool printInfo = false);
+    // file of index is installed, progress is reported if a report is due
+    void updateProgress(const QString & filename, int index, qint64 bytes, bool printInfo);
+    // update progress by files written by writer since last update, written files are counted from startIndex
+    void updateWriterProgress(const GmPackageFileWriter & writer, int startIndex, qint64 & writtenBytes, int & writtenCount, bool printInfo);
+    // emit progress signals, print progress and output JSON line of current progress
+    void reportProgress(bool printInfo);
+    // create dir by filename, created and existing directories are cached for current install
     bool createPath(const QString & filename);
+    // create dir path, cached directory is not checked again
+    bool createDir(const QString & filePath);
+    // create unique directories of all files in one pass, directory cache is cleared at first
+    bool createDirs(const QDir & startDir, const QList<GmPackageFileInfoItem> & fileInfoList);
     bool setFile2Writable(const QString & filename);
     // create symbolic link
     bool createSymbolicLink(const QString & linkName, const GmPackageFileInfoItem & item);
     // create empty file
     bool createEmptyFile(const QString & filename, const GmPackageFileInfoItem & item);
     // create data file with data block
-    bool createDataFile(const QString & filename, const char *data, const GmPackageFileInfoItem & item);
+    // holes of sparse map are left in sparse mode
+    bool createDataFile(const QString & filename, const char *data, const GmPackageFileInfoItem & item,
+            const GmPackageSparseMap & sparseMap);
+    // create data file with data block too large for buffer, it is copied from package in chunks
+    bool createLargeDataFile(const QString & filename, GmPackageManager & lopm, GmPackageFileHandle & packageHandle,
+            const GmPackageFileInfoItem & item);
+    // create file of same data as installed source file by duplicate mode
+    bool createDuplicateFile(const QString & filename, const QString & sourceFilename,
+            const GmPackageFileInfoItem & item, const GmPackageFileInfoItem & sourceItem);
     // filter file information list by sort, directory and filename list
     bool getFilteredFileInfoFullList(GmPackageManager & lopm, QList<GmPackageFileInfoItem> & lopFileInfoFullList);
 
@@ -89,4 +164,14 @@ private:
     QList<int> m_sortList;
     QStringList m_dirNameList;
     QStringList m_fileDirNameList, m_filenameList;
+    bool m_verifyFlag;
+    int m_writerThreadCount;
+    bool m_sparseFlag;
+    int m_duplicateMode;
+    QByteArray m_encryptionKey;
+    GmPackageStatistics m_statistics;
+    GmPackageProgress m_progress;
+    QIODevice *m_progressDevice;
+    // directories of files of current install
+    QSet<QString> m_createdDirSet;
 };
@@ -1,7 +1,157 @@
 #include "gmpackagemanager.h"
+#include "gmpackagedictionary.h"
+#include "gmpackagemanifest.h"
 #include "gmpackagebuilder.h"
+#include "gmpackagefilehandle.h"
+#include "gmpackagestatistics.h"
 
 #include <QDir>
+#include <QHash>
+#include <QSet>
+#include <QPair>
+#include <QVector>
+#include <QtEndian>
+#include <QtConcurrentMap>
+
+#include <zlib.h>
+#include <algorithm>
+
+// adjacent data blocks are coalesced into one read if the gap between them is not larger than the size
+static const qint64 ReadCoalesceGapSize = 64 * 1024;
+// max size of a coalesced read
+static const qint64 ReadCoalesceMaxSize = 8 * 1024 * 1024;
+// size of chunks of a data block which is too large for buffer
+static const qint64 StreamChunkSize = 16 * 1024 * 1024;
+
+// read coalesced data blocks and uncompress them in thread pool
+class GmPackageReadRunFunctor
+{
+public:
+    typedef QList<GmPackageReadResult> result_type;
+
+    GmPackageReadRunFunctor(const GmPackageManager *lopm, GmPackageFileHandle *packageHandle,
+            const QSharedPointer<GmPackageFileHandle> & sharedPackageHandle, const QList<GmPackageFileInfoItem> & fileInfoList)
+        : m_lopm(lopm), m_packageHandle(packageHandle), m_sharedPackageHandle(sharedPackageHandle), m_fileInfoList(fileInfoList) { }
+
+    QList<GmPackageReadResult> operator()(const GmPackageReadRun & run) const
+    {
+        QList<GmPackageReadResult> resultList;
+        m_lopm->readDataRun(*m_packageHandle, run, m_fileInfoList, resultList);
+        return resultList;
+    }
+
+private:
+    const GmPackageManager *m_lopm;
+    GmPackageFileHandle *m_packageHandle;
+    QSharedPointer<GmPackageFileHandle> m_sharedPackageHandle; // keeps handle for asynchronous read
+    QList<GmPackageFileInfoItem> m_fileInfoList;
+};
+
+// verify checksums of coalesced data blocks in thread pool
+class GmPackageVerifyRunFunctor
+{
+public:
+    typedef QStringList result_type;
+
+    GmPackageVerifyRunFunctor(const GmPackageManager *lopm, GmPackageFileHandle *packageHandle, const QList<GmPackageFileInfoItem> & fileInfoList)
+        : m_lopm(lopm), m_packageHandle(packageHandle), m_fileInfoList(fileInfoList) { }
+
+    QStringList operator()(const GmPackageReadRun & run) const
+    {
+        return m_lopm->verifyDataRun(*m_packageHandle, run, m_fileInfoList);
+    }
+
+private:
+    const GmPackageManager *m_lopm;
+    GmPackageFileHandle *m_packageHandle;
+    QList<GmPackageFileInfoItem> m_fileInfoList;
+};
+
+// stored segment of file information data (version >= 10)
+struct GmPackageIndexSegment
+{
+    qint64 position; // position of segment relative to package start, it is cipher position of segment
+    int offset; // offset in segment data
+    int size;
+};
+
+// serialize and compress items of a segment in thread pool
+class GmPackageIndexSegmentCompressFunctor
+{
+public:
+    typedef QByteArray result_type;
+
+    GmPackageIndexSegmentCompressFunctor(const GmPackageFileIndex *fileIndex, int version, int compressionLevel)
+        : m_fileIndex(fileIndex), m_version(version), m_compressionLevel(compressionLevel) { }
+
+    QByteArray operator()(const QPair<int, int> & range) const
+    {
+        QByteArray data;
+        m_fileIndex->write(data, m_version, range.first, range.second);
+        return qCompress((const uchar *) data.constData(), data.size(), m_compressionLevel);
+    }
+
+private:
+    const GmPackageFileIndex *m_fileIndex;
+    int m_version;
+    int m_compressionLevel;
+};
+
+// decrypt and uncompress a segment in thread pool, failure returns empty data
+class GmPackageIndexSegmentUncompressFunctor
+{
+public:
+    typedef QByteArray result_type;
+
+    GmPackageIndexSegmentUncompressFunctor(const char *segmentData, const GmPackageCipher *cipher)
+        : m_segmentData(segmentData), m_cipher(cipher) { }
+
+    QByteArray operator()(const GmPackageIndexSegment & segment) const
+    {
+        QByteArray data(m_segmentData + segment.offset, segment.size);
+        m_cipher->process(data.data(), data.size(), GmPackageManager::IndexCipherVolume, segment.position);
+        return qUncompress((const uchar *) data.constData(), data.size());
+    }
+
+private:
+    const char *m_segmentData;
+    const GmPackageCipher *m_cipher;
+};
+
+// sort indexes of file information items by data position
+class GmPackageDataPositionLessThan
+{
+public:
+    GmPackageDataPositionLessThan(const QList<GmPackageFileInfoItem> & fileInfoList) : m_fileInfoList(fileInfoList) { }
+
+    bool operator()(int i, int j) const
+    {
+        const GmPackageFileInfoItem & item1 = m_fileInfoList.at(i);
+        const GmPackageFileInfoItem & item2 = m_fileInfoList.at(j);
+        if (item1.volume != item2.volume) return (item1.volume < item2.volume);
+        return (item1.position < item2.position);
+    }
+
+private:
+    const QList<GmPackageFileInfoItem> & m_fileInfoList;
+};
+
+// check uncompressed data block length of file, solid block must contain the file data
+static bool isValidDataBlockLength(const GmPackageFileInfoItem & item, qint64 blockLength)
+{
+    if (item.isSolid()) {
+        return (item.blockOffset >= 0 && item.blockOffset + item.originalDataLength <= blockLength);
+    }
+    return (blockLength == item.originalDataLength);
+}
+
+const quint8 GmPackageManager::DictionaryCompressFlag;
+const quint8 GmPackageManager::SparseDataFlag;
+const quint8 GmPackageManager::CompressMethodMask;
+const quint32 GmPackageManager::IndexCipherVolume;
+const qint64 GmPackageManager::MaxBufferSize;
+const int GmPackageManager::IndexNonceSize;
+const int GmPackageManager::IndexSegmentSize;
 
 QDataStream::ByteOrder GmPackageManager::LoPackageByteOrder = QDataStream::LittleEndian;
 
@@ -57,6 +207,13 @@ GmPackageManager::GmPackageManager(const QString & packageFilename)
     setPackageFilename(packageFilename);
 }
 
+GmPackageManager::GmPackageManager(const QString & packageFilename, const QByteArray & userKey)
+{
+    init();
+    setEncryptionKey(userKey);
+    setPackageFilename(packageFilename);
+}
+
 GmPackageManager::~GmPackageManager() { }
 
 bool GmPackageManager::setPackageFilename(const QString & packageFilename)
@@ -90,14 +247,10 @@ bool GmPackageManager::load()
         return false;
     }
 
-    // load file information list
+    // load version, compress flag and file information list
     ok = loadFileInfo(packageFile);
     if (!ok) return false;
 
-    // load version and compress flag
-    ok = readPackageFileHeader(packageFile);
-    if (!ok) return false;
-
     return true;
 }
 
@@ -109,7 +262,7 @@ bool GmPackageManager::load(const QString & packageFilename)
 
 bool GmPackageManager::isValid()
 {
-    return (!m_fileInfoList.isEmpty());
+    return (!m_fileIndex.isEmpty());
 }
 
 const QString & GmPackageManager::getErrorMessage() const
@@ -142,6 +295,214 @@ bool GmPackageManager::setCompressionLevel(int compressionLevel)
     return true;
 }
 
+quint8 GmPackageManager::getEncryption() const
+{
+    return m_encryption;
+}
+
+void GmPackageManager::setEncryptionKey(const QByteArray & userKey)
+{
+    m_userKey = userKey;
+    m_encryption = userKey.isEmpty() ? GmPackageCipher::XorMode : GmPackageCipher::ChaCha20Mode;
+    m_cipher.setMode(m_encryption);
+}
+
+const GmPackageCipher & GmPackageManager::getCipher() const
+{
+    return m_cipher;
+}
+
+void GmPackageManager::setDictionary(const QByteArray & dictionary)
+{
+    m_dictionary = dictionary.left(GmPackageDictionary::MaxDictionarySize);
+}
+
+const QByteArray & GmPackageManager::getDictionary() const
+{
+    return m_dictionary;
+}
+
+void GmPackageManager::setVolumeSize(qint64 volumeSize)
+{
+    m_volumeSize = (volumeSize > 0) ? volumeSize : 0;
+}
+
+qint64 GmPackageManager::getVolumeSize() const
+{
+    return m_volumeSize;
+}
+
+int GmPackageManager::getVolumeCount() const
+{
+    return m_volumeCount;
+}
+
+QString GmPackageManager::getVolumeFilename(const QString & packageFilename, int volume)
+{
+    if (volume <= 0) return packageFilename;
+    return QString("%1.%2").arg(packageFilename).arg(volume, 3, 10, QChar('0'));
+}
+
+void GmPackageManager::setVerifyFlag(bool verifyFlag)
+{
+    m_verifyFlag = verifyFlag;
+}
+
+bool GmPackageManager::getVerifyFlag() const
+{
+    return m_verifyFlag;
+}
+
+quint32 GmPackageManager::updateChecksum(quint32 checksum, const char *data, qint64 dataLength)
+{
+    uLong crc = checksum;
+    // length of zlib crc32 is 32 bits, large data is checked in parts
+    while (dataLength > 0) {
+        uInt partLength = (uInt) qMin(dataLength, (qint64) 0x40000000);
+        crc = crc32(crc, (const Bytef *) data, partLength);
+        data += partLength;
+        dataLength -= partLength;
+    }
+    return (quint32) crc;
+}
+
+const QByteArray & GmPackageManager::getManifestRoot() const
+{
+    return m_manifestRoot;
+}
+
+QByteArray GmPackageManager::getDataBlockHashes(const GmPackageFileInfoItem & item) const
+{
+    return m_blockHashHash.value(QPair<qint32, qint64>(item.volume, item.position));
+}
+
+void GmPackageManager::setStatistics(GmPackageStatistics *statistics)
+{
+    m_statistics = statistics;
+}
+
+GmPackageStatistics *GmPackageManager::getStatistics() const
+{
+    return m_statistics;
+}
+
+bool GmPackageManager::verifyStoredData(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const
+{
+    GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::ChecksumPhase, dataLength);
+    if (m_version >= 7) {
+        QByteArray chunkHashes = GmPackageManifest::getChunkHashes(data, dataLength, m_manifestChunkSize);
+        return (!chunkHashes.isEmpty() && chunkHashes == getDataBlockHashes(item));
+    }
+    if (m_version >= 6) {
+        return (updateChecksum(0, data, dataLength) == item.checksum);
+    }
+    return true;
+}
+
+bool GmPackageManager::canStreamDataFile(const GmPackageFileInfoItem & item)
+{
+    return (item.compressFlag == 0 && !item.isSolid() && item.compressedDataLength == item.originalDataLength);
+}
+
+bool GmPackageManager::copyDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item, QFile & file,
+        QString *errorMessage) const
+{
+    if (!canStreamDataFile(item)) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is too large for buffer.").arg(item.filename);
+        return false;
+    }
+    return streamDataFile(packageHandle, item, &file, m_verifyFlag, errorMessage);
+}
+
+bool GmPackageManager::verifyDataFileStream(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+        QString *errorMessage) const
+{
+    return streamDataFile(packageHandle, item, NULL, true, errorMessage);
+}
+
+bool GmPackageManager::streamDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item, QFile *file,
+        bool verifyFlag, QString *errorMessage) const
+{
+    // chunks are aligned to manifest chunks, so leaf hashes of chunks are the leaf hashes of the block
+    qint64 chunkSize = qMax((qint64) m_manifestChunkSize, StreamChunkSize / m_manifestChunkSize * m_manifestChunkSize);
+    qint64 dataStartPosition = getFileDataStartPosition(item);
+    quint32 checksum = 0;
+    QByteArray chunkHashes;
+    QByteArray chunkData;
+    chunkData.resize((int) qMin(chunkSize, item.compressedDataLength));
+
+    for (qint64 offset = 0; offset < item.compressedDataLength; offset += chunkSize) {
+        qint64 length = qMin(chunkSize, item.compressedDataLength - offset);
+        qint64 nb = 0;
+        {
+            GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, length);
+            nb = packageHandle.read(chunkData.data(), length, dataStartPosition + offset, item.volume);
+        }
+        if (nb != length) {
+            if (errorMessage) *errorMessage = QString("Reads data from file %1 failure.").arg(getVolumeFilename(packageHandle.getPackageFilename(), item.volume));
+            return false;
+        }
+        if (verifyFlag && m_version >= 6) {
+            GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::ChecksumPhase, length);
+            if (m_version >= 7) {
+                chunkHashes.append(GmPackageManifest::getChunkHashes(chunkData.constData(), length, m_manifestChunkSize));
+            } else {
+                checksum = updateChecksum(checksum, chunkData.constData(), length);
+            }
+        }
+        if (file == NULL) continue;
+
+        // nonce of the block and offset of chunk in it
+        {
+            GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::DecryptPhase, length);
+            m_cipher.process(chunkData.data(), length, item.volume, item.position, offset);
+        }
+        if (file->write(chunkData.constData(), length) != length) {
+            if (errorMessage) *errorMessage = QString("Outputs data to file %1 failure.").arg(file->fileName());
+            return false;
+        }
+    }
+
+    bool ok = true;
+    if (verifyFlag && m_version >= 7) {
+        ok = (!chunkHashes.isEmpty() && chunkHashes == getDataBlockHashes(item));
+    } else if (verifyFlag && m_version >= 6) {
+        ok = (checksum == item.checksum);
+    }
+    if (!ok && errorMessage) *errorMessage = QString("Checksum of file %1 data is wrong.").arg(item.filename);
+    return ok;
+}
+
+QList<int> GmPackageManager::getDataBlockIndexList(const QList<GmPackageFileInfoItem> & fileInfoList)
+{
+    QList<int> indexList;
+    QSet<QPair<qint32, qint64> > blockSet;
+    for (int i = 0; i < fileInfoList.size(); i++) {
+        const GmPackageFileInfoItem & item = fileInfoList.at(i);
+        if (item.originalDataLength == 0 || item.compressedDataLength == 0) continue;
+        QPair<qint32, qint64> block(item.volume, item.position);
+        if (blockSet.contains(block)) continue;
+        blockSet.insert(block);
+        indexList.append(i);
+    }
+    return indexList;
+}
+
+QList<int> GmPackageManager::getDataBlockIndexList(const GmPackageFileIndex & fileIndex)
+{
+    QList<int> indexList;
+    QSet<QPair<qint32, qint64> > blockSet;
+    for (int i = 0; i < fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = fileIndex.record(i);
+        if (record.originalDataLength == 0 || record.compressedDataLength == 0) continue;
+        QPair<qint32, qint64> block(record.volume, record.position);
+        if (blockSet.contains(block)) continue;
+        blockSet.insert(block);
+        indexList.append(i);
+    }
+    return indexList;
+}
+
 QDataStream::ByteOrder GmPackageManager::getLoPackageByteOrder()
 {
     return LoPackageByteOrder;
@@ -184,12 +545,23 @@ void* GmPackageManager::transEndian(void *data, size_t size, size_t nitems)
 
 void GmPackageManager::init()
 {
-    m_version = 2;
+    m_version = 12;
     m_compressFlag = 0;
-    m_encryption = 1;
+    m_encryption = GmPackageCipher::XorMode;
+    m_cipher.setMode(m_encryption);
     strncpy(m_fileIdentification, "GMTOOLKITPACKAGEFILE", sizeof(m_fileIdentification));
 
     m_packageFileStartPosition = 0;
+    m_fileDataEndPosition = 0;
+    m_solidBlockCount = 0;
+    m_volumeSize = 0;
+    m_volumeCount = 0;
+    m_verifyFlag = false;
+    m_manifestChunkSize = GmPackageManifest::DefaultChunkSize;
+    m_statistics = NULL;
+    m_storedInfoCount = 0;
+    m_storedInfoDataSize = 0;
+    m_storedInfoCompressFlag = 0;
     m_compressionLevel = 9;
 }
 
@@ -198,10 +570,22 @@ char *GmPackageManager::readDataFile(QFile & packageFile, const GmPackageFileInf
     if (item.originalDataLength == 0 || item.compressedDataLength == 0) return NULL;
     if (!packageFile.isOpen()) return NULL;
 
+    // data of split package may be in data volume file
+    QFile volumeFile;
+    QFile *dataFile = &packageFile;
+    if (item.volume > 0) {
+        volumeFile.setFileName(getVolumeFilename(packageFile.fileName(), item.volume));
+        if (!volumeFile.open(QIODevice::ReadOnly)) {
+            m_errorMessage = QString("Opens data volume file %1 failure.").arg(volumeFile.fileName());
+            return NULL;
+        }
+        dataFile = &volumeFile;
+    }
+
     qint64 fileDataStartPosition = getFileDataStartPosition(item);
-    bool ok = packageFile.seek(fileDataStartPosition);
+    bool ok = dataFile->seek(fileDataStartPosition);
     if (!ok) {
-        m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(fileDataStartPosition).arg(packageFile.fileName());
+        m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(fileDataStartPosition).arg(dataFile->fileName());
         return NULL;
     }
 
@@ -210,23 +594,47 @@ char *GmPackageManager::readDataFile(QFile & packageFile, const GmPackageFileInf
     char *compressedData = new char[item.compressedDataLength];
     if (compressedData == NULL) return NULL;
 
-    ok = readDataBlock(compressedData, item.compressedDataLength, packageFile);
-    if (!ok) {
+    qint64 nb = 0;
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, item.compressedDataLength);
+        nb = dataFile->read(compressedData, item.compressedDataLength);
+    }
+    if (nb < 0 || nb != item.compressedDataLength) {
+        m_errorMessage = QString("Reads data from file %1 failure.").arg(dataFile->fileName());
+        if (compressedData) delete []compressedData;
+        return NULL;
+    }
+    if (m_verifyFlag && !verifyStoredData(item, compressedData, item.compressedDataLength)) {
+        m_errorMessage = QString("Checksum of file %1 data is wrong.").arg(item.filename);
         if (compressedData) delete []compressedData;
         return NULL;
     }
+    // decrypt data block, nonce of stream cipher is data volume and position of block
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::DecryptPhase, item.compressedDataLength);
+        m_cipher.process(compressedData, item.compressedDataLength, item.volume, item.position);
+    }
 
     if (item.compressFlag) {
         // uncompress data
-        QByteArray ucba = qUncompress((uchar*) compressedData, item.compressedDataLength);
-        if (ucba.size() != item.originalDataLength) {
+        QByteArray ucba = uncompressDataBlock(item, compressedData, item.compressedDataLength);
+        if (!isValidDataBlockLength(item, ucba.size())) {
             if (compressedData) delete []compressedData;
             return NULL;
         }
         if (compressedData) delete []compressedData;
         data = new char[item.originalDataLength];
         if (data == NULL) return NULL;
-        memcpy(data, ucba.constData(), item.originalDataLength);
+        memcpy(data, ucba.constData() + item.blockOffset, item.originalDataLength);
+    } else if (item.isSolid()) {
+        // copy file data from solid block
+        if (!isValidDataBlockLength(item, item.compressedDataLength)) {
+            if (compressedData) delete []compressedData;
+            return NULL;
+        }
+        data = new char[item.originalDataLength];
+        if (data != NULL) memcpy(data, compressedData + item.blockOffset, item.originalDataLength);
+        if (compressedData) delete []compressedData;
     } else {
         data = compressedData;
     }
@@ -236,19 +644,15 @@ char *GmPackageManager::readDataFile(QFile & packageFile, const GmPackageFileInf
 
 char *GmPackageManager::readDataFile(QFile & packageFile, const QString & filename, qint64 & fileSize)
 {
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-        if (item.deleteFlag) continue;
-        if (item.filename == filename) {
-            char *data = readDataFile(packageFile, item);
-            fileSize = item.originalDataLength;
-            return data;
-        }
-    }
-    return NULL;
+    int index = m_fileIndex.indexOf(filename);
+    if (index < 0) return NULL;
+    GmPackageFileInfoItem item = m_fileIndex.at(index);
+    char *data = readDataFile(packageFile, item);
+    fileSize = item.originalDataLength;
+    return data;
 }
 
-bool GmPackageManager::readDataBlock(char *data, qint64 dataLength, QFile & packageFile)
+bool GmPackageManager::readDataBlock(char *data, qint64 dataLength, QFile & packageFile, quint32 *checksum)
 {
     if (data == NULL || dataLength == 0) return false;
     if (!packageFile.isOpen()) return false;
@@ -260,15 +664,446 @@ bool GmPackageManager::readDataBlock(char *data, qint64 dataLength, QFile & pack
         m_errorMessage = QString("Reads data from file %1 failure.").arg(packageFile.fileName());
         return false;
     }
-    if (m_encryption) {
-        for (qint64 i = 0; i < dataLength; i++) data[i] ^= 0x62;
+    if (checksum) *checksum = updateChecksum(*checksum, data, dataLength);
+    m_cipher.process(data, dataLength, 0, oldPosition - m_packageFileStartPosition);
+
+    return true;
+}
+
+bool GmPackageManager::readDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+        QByteArray & data, QString *errorMessage) const
+{
+    data.clear();
+    if (item.originalDataLength == 0) return true;
+    if (item.compressedDataLength <= 0) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is invalid.").arg(item.filename);
+        return false;
+    }
+    if (item.compressedDataLength > 0x7FFFFFFF || item.originalDataLength > 0x7FFFFFFF) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is too large for buffer.").arg(item.filename);
+        return false;
+    }
+
+    QByteArray storedData;
+    storedData.resize((int) item.compressedDataLength);
+    qint64 fileDataStartPosition = getFileDataStartPosition(item);
+    qint64 nb = 0;
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, item.compressedDataLength);
+        nb = packageHandle.read(storedData.data(), item.compressedDataLength, fileDataStartPosition, item.volume);
+    }
+    if (nb != item.compressedDataLength) {
+        if (errorMessage) *errorMessage = QString("Reads data from file %1 failure.").arg(packageHandle.getPackageFilename());
+        return false;
+    }
+
+    bool ok = decodeDataFile(item, storedData, data, errorMessage);
+    return ok;
+}
+
+bool GmPackageManager::readFileDataBlock(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+        QByteArray & blockData, QString *errorMessage) const
+{
+    blockData.clear();
+    if (item.originalDataLength == 0) return true;
+    if (item.compressedDataLength <= 0) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is invalid.").arg(item.filename);
+        return false;
+    }
+    if (item.compressedDataLength > 0x7FFFFFFF) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is too large for buffer.").arg(item.filename);
+        return false;
+    }
+
+    QByteArray storedData;
+    storedData.resize((int) item.compressedDataLength);
+    qint64 fileDataStartPosition = getFileDataStartPosition(item);
+    qint64 nb = 0;
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, item.compressedDataLength);
+        nb = packageHandle.read(storedData.data(), item.compressedDataLength, fileDataStartPosition, item.volume);
+    }
+    if (nb != item.compressedDataLength) {
+        if (errorMessage) *errorMessage = QString("Reads data from file %1 failure.").arg(packageHandle.getPackageFilename());
+        return false;
+    }
+
+    bool ok = decodeDataBlock(item, storedData, blockData, errorMessage);
+    return ok;
+}
+
+bool GmPackageManager::readDataBlock(char *data, qint64 dataLength, qint64 position,
+        GmPackageFileHandle & packageHandle, QString *errorMessage) const
+{
+    if (data == NULL || dataLength == 0) return false;
+
+    qint64 nb = packageHandle.read(data, dataLength, position);
+    if (nb < 0 || nb != dataLength) {
+        if (errorMessage) *errorMessage = QString("Reads data from file %1 failure.").arg(packageHandle.getPackageFilename());
+        return false;
+    }
+    m_cipher.process(data, dataLength, 0, position - m_packageFileStartPosition);
+
+    return true;
+}
+
+bool GmPackageManager::decodeDataFile(const GmPackageFileInfoItem & item, QByteArray & storedData,
+        QByteArray & data, QString *errorMessage) const
+{
+    QByteArray blockData;
+    bool ok = decodeDataBlock(item, storedData, blockData, errorMessage);
+    if (!ok) return false;
+
+    ok = getFileDataFromBlock(item, blockData, data);
+    if (!ok && errorMessage) *errorMessage = QString("Data block of file %1 is invalid.").arg(item.filename);
+    return ok;
+}
+
+bool GmPackageManager::decodeDataBlock(const GmPackageFileInfoItem & item, QByteArray & storedData,
+        QByteArray & blockData, QString *errorMessage) const
+{
+    blockData.clear();
+    if (storedData.size() != item.compressedDataLength) {
+        if (errorMessage) *errorMessage = QString("Data of file %1 is invalid.").arg(item.filename);
+        return false;
+    }
+    if (m_verifyFlag && !verifyStoredData(item, storedData.constData(), storedData.size())) {
+        if (errorMessage) *errorMessage = QString("Checksum of file %1 data is wrong.").arg(item.filename);
+        return false;
+    }
+
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::DecryptPhase, storedData.size());
+        m_cipher.process(storedData.data(), storedData.size(), item.volume, item.position);
     }
 
+    if (item.compressFlag) {
+        // uncompress data
+        blockData = uncompressDataBlock(item, storedData.constData(), storedData.size());
+        if (!isValidDataBlockLength(item, blockData.size())) {
+            blockData.clear();
+            if (errorMessage) *errorMessage = QString("Uncompress data of file %1 failure.").arg(item.filename);
+            return false;
+        }
+    } else {
+        blockData = storedData;
+    }
     return true;
 }
 
+QByteArray GmPackageManager::uncompressDataBlock(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const
+{
+    if (dataLength > 0x7FFFFFFF) return QByteArray();
+    GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::UncompressPhase, item.originalDataLength);
+    if (item.compressFlag & SparseDataFlag) return uncompressSparseDataBlock(item, data, dataLength);
+    if (item.compressFlag == DictionaryCompressFlag) {
+        return GmPackageDictionary::uncompress(data, (int) dataLength, m_dictionary);
+    }
+    return qUncompress((const uchar *) data, (int) dataLength);
+}
+
+QByteArray GmPackageManager::uncompressSparseDataBlock(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const
+{
+    GmPackageSparseMap sparseMap;
+    if (!sparseMap.read(data, dataLength) || sparseMap.getOriginalDataLength() > 0x7FFFFFFF) return QByteArray();
+    qint64 mapSize = sparseMap.getSerializedSize();
+    const char *extentData = data + mapSize;
+    qint64 extentDataLength = dataLength - mapSize;
+
+    // data of extents is compressed by compress method of flag
+    QByteArray ucba;
+    quint8 compressMethod = item.compressFlag & CompressMethodMask;
+    if (compressMethod == DictionaryCompressFlag) {
+        ucba = GmPackageDictionary::uncompress(extentData, (int) extentDataLength, m_dictionary);
+    } else if (compressMethod) {
+        ucba = qUncompress((const uchar *) extentData, (int) extentDataLength);
+    } else {
+        ucba = QByteArray::fromRawData(extentData, (int) extentDataLength);
+    }
+
+    QByteArray blockData;
+    blockData.resize((int) sparseMap.getOriginalDataLength());
+    bool ok = sparseMap.scatter(ucba.constData(), ucba.size(), blockData.data(), blockData.size());
+    if (!ok) return QByteArray();
+    return blockData;
+}
+
+bool GmPackageManager::getFileDataFromBlock(const GmPackageFileInfoItem & item, const QByteArray & blockData, QByteArray & data)
+{
+    data.clear();
+    if (!isValidDataBlockLength(item, blockData.size())) return false;
+
+    if (item.isSolid()) {
+        data = blockData.mid((int) item.blockOffset, (int) item.originalDataLength);
+    } else {
+        data = blockData;
+    }
+    return true;
+}
+
+QList<GmPackageReadRun> GmPackageManager::getReadRunList(const QList<GmPackageFileInfoItem> & fileInfoList) const
+{
+    QList<GmPackageReadRun> runList;
+    GmPackageReadRun emptyRun;
+
+    QList<int> indexList;
+    for (int i = 0; i < fileInfoList.size(); i++) {
+        const GmPackageFileInfoItem & item = fileInfoList.at(i);
+        if (item.originalDataLength == 0 || item.compressedDataLength == 0) {
+            emptyRun.indexList.append(i);
+        } else {
+            indexList.append(i);
+        }
+    }
+    std::sort(indexList.begin(), indexList.end(), GmPackageDataPositionLessThan(fileInfoList));
+
+    // run lists of data volumes
+    QList<QList<GmPackageReadRun> > volumeRunList;
+    GmPackageReadRun run;
+    for (int i = 0; i < indexList.size(); i++) {
+        const GmPackageFileInfoItem & item = fileInfoList.at(indexList.at(i));
+        qint64 dataStartPosition = getFileDataStartPosition(item);
+        qint64 dataEndPosition = dataStartPosition + item.compressedDataLength;
+        if (!run.indexList.isEmpty()) {
+            qint64 runEndPosition = run.position + run.length;
+            qint64 length = qMax(dataEndPosition, runEndPosition) - run.position;
+            if (item.volume == run.volume && dataStartPosition <= runEndPosition + ReadCoalesceGapSize && length <= ReadCoalesceMaxSize) {
+                run.length = length;
+                run.indexList.append(indexList.at(i));
+                continue;
+            }
+            if (volumeRunList.isEmpty() || volumeRunList.last().first().volume != run.volume) {
+                volumeRunList.append(QList<GmPackageReadRun>());
+            }
+            volumeRunList.last().append(run);
+            run = GmPackageReadRun();
+        }
+        run.volume = item.volume;
+        run.position = dataStartPosition;
+        run.length = item.compressedDataLength;
+        run.indexList.append(indexList.at(i));
+    }
+    if (!run.indexList.isEmpty()) {
+        if (volumeRunList.isEmpty() || volumeRunList.last().first().volume != run.volume) {
+            volumeRunList.append(QList<GmPackageReadRun>());
+        }
+        volumeRunList.last().append(run);
+    }
+
+    // interleave runs of volumes, every volume is still read forward
+    for (int i = 0; ; i++) {
+        bool found = false;
+        for (int j = 0; j < volumeRunList.size(); j++) {
+            if (i < volumeRunList.at(j).size()) {
+                runList.append(volumeRunList.at(j).at(i));
+                found = true;
+            }
+        }
+        if (!found) break;
+    }
+    if (!emptyRun.indexList.isEmpty()) runList.append(emptyRun);
+
+    return runList;
+}
+
+bool GmPackageManager::verifyDataFiles(GmPackageFileHandle & packageHandle, QStringList & errorMessageList) const
+{
+    return verifyDataFiles(packageHandle, m_fileIndex.toList(), errorMessageList);
+}
+
+bool GmPackageManager::verifyDataFiles(GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & sourceFileInfoList,
+        QStringList & errorMessageList) const
+{
+    if (m_version < 6) {
+        errorMessageList.append(QString("Package version %1 has no checksum.").arg(m_version));
+        return false;
+    }
+
+    // data blocks of files, block of solid files is verified once
+    QList<GmPackageFileInfoItem> fileInfoList;
+    QList<int> blockIndexList = getDataBlockIndexList(sourceFileInfoList);
+    for (int i = 0; i < blockIndexList.size(); i++) fileInfoList.append(sourceFileInfoList.at(blockIndexList.at(i)));
+
+    QList<GmPackageReadRun> runList = getReadRunList(fileInfoList);
+    packageHandle.adviseSequential();
+    GmPackageVerifyRunFunctor functor(this, &packageHandle, fileInfoList);
+    QList<QStringList> runErrorMessageList = QtConcurrent::blockingMapped<QList<QStringList> >(runList, functor);
+
+    bool ok = true;
+    for (int i = 0; i < runErrorMessageList.size(); i++) {
+        if (runErrorMessageList.at(i).isEmpty()) continue;
+        errorMessageList.append(runErrorMessageList.at(i));
+        ok = false;
+    }
+    return ok;
+}
+
+QStringList GmPackageManager::verifyDataRun(GmPackageFileHandle & packageHandle, const GmPackageReadRun & run,
+        const QList<GmPackageFileInfoItem> & fileInfoList) const
+{
+    QStringList errorMessageList;
+    if (run.length <= 0) return errorMessageList;
+    if (run.length > MaxBufferSize) {
+        // a large data block isn't coalesced with other blocks, it is verified in chunks
+        for (int i = 0; i < run.indexList.size(); i++) {
+            QString errorMessage;
+            if (!verifyDataFileStream(packageHandle, fileInfoList.at(run.indexList.at(i)), &errorMessage)) {
+                errorMessageList.append(errorMessage);
+            }
+        }
+        return errorMessageList;
+    }
+
+    QByteArray runData;
+    runData.resize((int) run.length);
+    qint64 nb = 0;
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, run.length);
+        nb = packageHandle.read(runData.data(), run.length, run.position, run.volume);
+    }
+    if (nb != run.length) {
+        errorMessageList.append(QString("Reads data from file %1 failure.").arg(getVolumeFilename(packageHandle.getPackageFilename(), run.volume)));
+        return errorMessageList;
+    }
+
+    for (int i = 0; i < run.indexList.size(); i++) {
+        const GmPackageFileInfoItem & item = fileInfoList.at(run.indexList.at(i));
+        qint64 offset = getFileDataStartPosition(item) - run.position;
+        if (!verifyStoredData(item, runData.constData() + offset, item.compressedDataLength)) {
+            errorMessageList.append(QString("Checksum of file %1 data is wrong.").arg(item.filename));
+        }
+    }
+    return errorMessageList;
+}
+
+bool GmPackageManager::readDataRuns(GmPackageFileHandle & packageHandle, const QList<GmPackageReadRun> & runList,
+        const QList<GmPackageFileInfoItem> & fileInfoList, QList<QList<GmPackageReadResult> > & runResultList) const
+{
+    GmPackageReadRunFunctor functor(this, &packageHandle, QSharedPointer<GmPackageFileHandle>(), fileInfoList);
+    runResultList = QtConcurrent::blockingMapped<QList<QList<GmPackageReadResult> > >(runList, functor);
+
+    for (int i = 0; i < runResultList.size(); i++) {
+        const QList<GmPackageReadResult> & runResult = runResultList.at(i);
+        for (int j = 0; j < runResult.size(); j++) {
+            if (!runResult.at(j).ok) return false;
+        }
+    }
+    return true;
+}
+
+bool GmPackageManager::readDataRun(GmPackageFileHandle & packageHandle, const GmPackageReadRun & run,
+        const QList<GmPackageFileInfoItem> & fileInfoList, QList<GmPackageReadResult> & resultList) const
+{
+    resultList.clear();
+
+    if (run.length > MaxBufferSize) {
+        // a large data block isn't coalesced with other blocks, not compressed data is copied by copyDataFile
+        bool allOk = true;
+        for (int i = 0; i < run.indexList.size(); i++) {
+            GmPackageReadResult result;
+            result.index = run.indexList.at(i);
+            result.item = fileInfoList.at(result.index);
+            result.ok = canStreamDataFile(result.item);
+            result.streamFlag = result.ok;
+            if (!result.ok) {
+                result.errorMessage = QString("Data of file %1 is too large for buffer.").arg(result.item.filename);
+                allOk = false;
+            }
+            resultList.append(result);
+        }
+        return allOk;
+    }
+
+    QByteArray runData;
+    QString errorMessage;
+    bool ok = true;
+    if (run.length > 0) {
+        // stored data is decrypted by decodeDataFile for every file
+        runData.resize((int) run.length);
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::PackageReadPhase, run.length);
+        qint64 nb = packageHandle.read(runData.data(), run.length, run.position, run.volume);
+        if (nb != run.length) {
+            ok = false;
+            errorMessage = QString("Reads data from file %1 failure.").arg(packageHandle.getPackageFilename());
+        }
+    }
+
+    // files of solid block are adjacent in run, the block is uncompressed once for all of them
+    qint64 blockPosition = -1;
+    QByteArray blockData;
+    GmPackageSparseMap blockSparseMap;
+    bool blockOk = false;
+    QString blockErrorMessage;
+
+    bool allOk = ok;
+    for (int i = 0; i < run.indexList.size(); i++) {
+        GmPackageReadResult result;
+        result.index = run.indexList.at(i);
+        result.item = fileInfoList.at(result.index);
+        if (!ok) {
+            result.errorMessage = errorMessage;
+        } else if (result.item.originalDataLength == 0) {
+            result.ok = true;
+        } else {
+            qint64 dataStartPosition = getFileDataStartPosition(result.item);
+            if (dataStartPosition != blockPosition) {
+                QByteArray storedData = runData.mid((int) (dataStartPosition - run.position), (int) result.item.compressedDataLength);
+                blockOk = decodeDataBlock(result.item, storedData, blockData, &blockErrorMessage);
+                blockPosition = dataStartPosition;
+                // stored data is decrypted now, sparse map at its head is kept for file writer
+                blockSparseMap = GmPackageSparseMap();
+                if (blockOk && (result.item.compressFlag & SparseDataFlag)) blockSparseMap.read(storedData.constData(), storedData.size());
+            }
+            if (blockOk) {
+                result.ok = getFileDataFromBlock(result.item, blockData, result.data);
+                if (!result.item.isSolid()) result.sparseMap = blockSparseMap;
+                if (!result.ok) result.errorMessage = QString("Data block of file %1 is invalid.").arg(result.item.filename);
+            } else {
+                result.errorMessage = blockErrorMessage;
+            }
+            if (!result.ok) allOk = false;
+        }
+        resultList.append(result);
+    }
+    return allOk;
+}
+
+bool GmPackageManager::readDataFiles(GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & fileInfoList,
+        QList<GmPackageReadResult> & resultList) const
+{
+    resultList.clear();
+    QList<GmPackageReadRun> runList = getReadRunList(fileInfoList);
+
+    // read and uncompress coalesced data blocks in thread pool
+    QList<QList<GmPackageReadResult> > runResultList;
+    readDataRuns(packageHandle, runList, fileInfoList, runResultList);
+
+    // sort results by index of item in the batch
+    for (int i = 0; i < fileInfoList.size(); i++) resultList.append(GmPackageReadResult());
+    bool ok = true;
+    for (int i = 0; i < runResultList.size(); i++) {
+        const QList<GmPackageReadResult> & runResult = runResultList.at(i);
+        for (int j = 0; j < runResult.size(); j++) {
+            const GmPackageReadResult & result = runResult.at(j);
+            resultList[result.index] = result;
+            if (!result.ok) ok = false;
+        }
+    }
+    return ok;
+}
+
+QFuture<QList<GmPackageReadResult> > GmPackageManager::readDataFilesAsync(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+        const QList<GmPackageFileInfoItem> & fileInfoList) const
+{
+    QList<GmPackageReadRun> runList = getReadRunList(fileInfoList);
+    GmPackageReadRunFunctor functor(this, packageHandle.data(), packageHandle, fileInfoList);
+    return QtConcurrent::mapped(runList, functor);
+}
+
 qint64 GmPackageManager::getFileDataStartPosition(const GmPackageFileInfoItem & item) const
 {
+    // data volume doesn't have header
+    if (item.volume > 0) return item.position;
     return item.position + m_packageFileStartPosition;
 }
 
@@ -282,52 +1117,157 @@ bool GmPackageManager::writeDataFile(const char *data, qint64 dataLength, QFile
     if (data == NULL || dataLength == 0) return false;
     if (!packageFile.isOpen()) return false;
 
-    item.position = packageFile.pos();
     item.originalDataLength = dataLength;
-    item.compressedDataLength = dataLength;
     item.compressFlag = m_compressFlag;
 
+    // holes of sparse data aren't stored (version >= 11), only data of extents is compressed
+    GmPackageSparseMap sparseMap;
+    QByteArray extentData;
+    if (m_version >= 11 && dataLength >= GmPackageSparseMap::MinHoleSize && dataLength <= MaxBufferSize) {
+        sparseMap = GmPackageSparseMap::fromData(data, dataLength);
+        if (sparseMap.hasHole()) extentData = sparseMap.gather(data);
+        if ((qint64) extentData.size() != sparseMap.getExtentDataLength()) sparseMap = GmPackageSparseMap();
+    }
+    if (sparseMap.hasHole()) {
+        data = extentData.constData();
+        dataLength = extentData.size();
+    }
+
     char *data2 = (char*) data;
     qint64 dataLength2 = dataLength;
     QByteArray cba;
 
     if (m_compressFlag) {
-        if (dataLength > 0x7FFFFFFF) {
+        if (dataLength > 0x7FFFFFFF || dataLength == 0) {
             item.setCompressFlag(false);
         } else {
-            // compress data
-            cba = qCompress((const uchar *) data, (int) dataLength, m_compressionLevel);
+            // compress data, with package dictionary if it is set
+            GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::CompressPhase, dataLength);
+            if (m_dictionary.isEmpty()) {
+                cba = qCompress((const uchar *) data, (int) dataLength, m_compressionLevel);
+            } else {
+                cba = GmPackageDictionary::compress(data, (int) dataLength, m_dictionary, m_compressionLevel);
+                item.compressFlag = DictionaryCompressFlag;
+            }
             if (cba.size() == 0) {
                 item.setCompressFlag(false);
             } else {
                 data2 = (char*) cba.constData();
                 dataLength2 = (qint64) cba.size();
-                item.compressedDataLength = dataLength2;
             }
         }
     }
 
-    // output compressed data to package and free compressed data buffer
-    bool ok = writeDataBlock(data2, dataLength2, packageFile);
+    // sparse map is stored before data of extents
+    QByteArray sparseData;
+    if (sparseMap.hasHole()) {
+        sparseData = sparseMap.toByteArray();
+        sparseData.append(data2, (int) dataLength2);
+        data2 = (char*) sparseData.constData();
+        dataLength2 = (qint64) sparseData.size();
+        item.compressFlag |= SparseDataFlag;
+    }
+    item.compressedDataLength = dataLength2;
+
+    // output compressed data to package or data volume
+    QFile *dataFile = getDataOutputFile(packageFile, dataLength2, item.volume);
+    if (dataFile == NULL) return false;
+    item.position = dataFile->pos();
+    if (item.volume == 0) item.position -= m_packageFileStartPosition;
+
+    item.checksum = 0;
+    QByteArray chunkHashes;
+    bool ok = writeDataBlock(data2, dataLength2, *dataFile, &item.checksum, m_version >= 7 ? &chunkHashes : NULL);
     if (!ok) return false;
+    if (m_version >= 7) m_blockHashHash.insert(QPair<qint32, qint64>(item.volume, item.position), chunkHashes);
+    if (item.volume == 0) m_fileDataEndPosition = packageFile.pos();
     return true;
 }
 
-bool GmPackageManager::writeDataBlock(const char *data, qint64 dataLength, QFile & packageFile)
+QFile *GmPackageManager::getDataOutputFile(QFile & packageFile, qint64 dataLength, qint32 & volume)
+{
+    volume = 0;
+    if (m_volumeSize <= 0) return &packageFile;
+    if (m_version < 5) {
+        m_errorMessage = QString("Data volume is not supported by package version %1.").arg(m_version);
+        return NULL;
+    }
+
+    // start next volume when current volume can't contain the data block
+    if (m_volumeFile.isNull() || (m_volumeFile->pos() > 0 && m_volumeFile->pos() + dataLength > m_volumeSize)) {
+        if (!m_volumeFile.isNull()) m_volumeFile->close();
+        m_volumeCount++;
+        m_volumeFile = QSharedPointer<QFile>(new QFile(getVolumeFilename(packageFile.fileName(), m_volumeCount)));
+        if (!m_volumeFile->open(QIODevice::WriteOnly)) {
+            m_errorMessage = QString("Opens data volume file %1 failure.").arg(m_volumeFile->fileName());
+            m_volumeFile.clear();
+            return NULL;
+        }
+    }
+    volume = m_volumeCount;
+    return m_volumeFile.data();
+}
+
+bool GmPackageManager::writeSolidBlock(const QByteArray & blockData, QFile & packageFile, QList<GmPackageFileInfoItem> & itemList)
+{
+    if (blockData.isEmpty() || itemList.isEmpty()) return false;
+    if (m_version < 3) {
+        m_errorMessage = QString("Solid block is not supported by package version %1.").arg(m_version);
+        return false;
+    }
+
+    GmPackageFileInfoItem blockItem;
+    bool ok = writeDataFile(blockData, packageFile, blockItem);
+    if (!ok) return false;
+
+    // all files of the block have the data position of block
+    qint32 blockIndex = m_solidBlockCount++;
+    for (int i = 0; i < itemList.size(); i++) {
+        GmPackageFileInfoItem & item = itemList[i];
+        item.volume = blockItem.volume;
+        item.position = blockItem.position;
+        item.compressedDataLength = blockItem.compressedDataLength;
+        item.compressFlag = blockItem.compressFlag;
+        item.checksum = blockItem.checksum;
+        item.blockIndex = blockIndex;
+        ok = appendFileInfo(item);
+        if (!ok) {
+            m_errorMessage = QString("File %1 exists in package.").arg(item.filename);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GmPackageManager::writeDataBlock(const char *data, qint64 dataLength, QFile & packageFile, quint32 *checksum,
+        QByteArray *chunkHashes)
 {
     if (data == NULL || dataLength == 0) return false;
     if (!packageFile.isOpen()) return false;
 
     qint64 oldPosition = packageFile.pos();
-    qint64 nb = 0;
+    // stored data is encrypted data or data itself
+    const char *storedData = data;
+    QByteArray ba;
     if (m_encryption) {
-        QByteArray ba;
+        // nonce of stream cipher is data volume and position of block
+        qint32 volume = (!m_volumeFile.isNull() && &packageFile == m_volumeFile.data()) ? m_volumeCount : 0;
+        qint64 position = (volume == 0) ? oldPosition - m_packageFileStartPosition : oldPosition;
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::EncryptPhase, dataLength);
         ba.setRawData(data, dataLength);
         char *edata = ba.data();
-        for (qint64 i = 0; i < dataLength; i++) edata[i] ^= 0x62;
-        nb = packageFile.write(edata, dataLength);
-    } else {
-        nb = packageFile.write(data, dataLength);
+        m_cipher.process(edata, dataLength, volume, position);
+        storedData = edata;
+    }
+    qint64 nb = 0;
+    {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::WritePhase, dataLength);
+        nb = packageFile.write(storedData, dataLength);
+    }
+    if (checksum || chunkHashes) {
+        GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::ChecksumPhase, dataLength);
+        if (checksum) *checksum = updateChecksum(*checksum, storedData, dataLength);
+        if (chunkHashes) *chunkHashes = GmPackageManifest::getChunkHashes(storedData, dataLength, m_manifestChunkSize);
     }
     if (nb < 0 || nb != dataLength) {
         packageFile.seek(oldPosition);
@@ -356,8 +1296,33 @@ bool GmPackageManager::writePackageFileHeader(QFile & packageFile)
     out << m_encryption;
     int err = out.writeRawData(m_fileIdentification, sizeof(m_fileIdentification));
     if (err < 0) ok = false;
+    if (m_version >= 4) {
+        out << (qint32) m_dictionary.size();
+        err = out.writeRawData(m_dictionary.constData(), m_dictionary.size());
+        if (err < 0) ok = false;
+    }
+    if (m_encryption == GmPackageCipher::ChaCha20Mode) {
+        if (m_version < 8) {
+            m_errorMessage = QString("ChaCha20 encryption is not supported by package version %1.").arg(m_version);
+            return false;
+        }
+        // package key of new salt, key check is saved to check user key when package is loaded
+        m_keySalt = GmPackageCipher::getRandomData(GmPackageCipher::SaltSize);
+        if (m_keySalt.size() != GmPackageCipher::SaltSize) {
+            m_errorMessage = QString("Gets random key salt of package %1 failure.").arg(packageFile.fileName());
+            return false;
+        }
+        QByteArray key = GmPackageCipher::deriveKey(m_userKey, m_keySalt);
+        m_cipher.setKey(key);
+        QByteArray keyCheck = GmPackageCipher::getKeyCheck(key);
+        out.writeRawData(m_keySalt.constData(), m_keySalt.size());
+        out.writeRawData(keyCheck.constData(), keyCheck.size());
+    }
     if (ok) ok = out.status() == QDataStream::Ok;
 
+    // file data blocks are output after header
+    m_fileDataEndPosition = packageFile.pos();
+
     return ok;
 }
 
@@ -381,10 +1346,42 @@ bool GmPackageManager::readPackageFileHeader(QFile & packageFile)
     // input package file version and compress flag
     in >> m_version;
     in >> m_compressFlag;
-    if (m_version == 2) {
+    if (m_version >= 2) {
         in >> m_encryption;
         in.readRawData(m_fileIdentification, sizeof(m_fileIdentification));
     }
+    m_dictionary.clear();
+    if (m_version >= 4) {
+        qint32 dictionaryLength = 0;
+        in >> dictionaryLength;
+        if (dictionaryLength < 0 || dictionaryLength > GmPackageDictionary::MaxDictionarySize) {
+            m_errorMessage = QString("Dictionary of package %1 is invalid.").arg(packageFile.fileName());
+            return false;
+        }
+        m_dictionary.resize(dictionaryLength);
+        if (dictionaryLength > 0) in.readRawData(m_dictionary.data(), dictionaryLength);
+    }
+    m_cipher.setMode(m_encryption);
+    if (m_encryption == GmPackageCipher::ChaCha20Mode) {
+        if (m_version < 8) {
+            m_errorMessage = QString("Encryption of package %1 is invalid.").arg(packageFile.fileName());
+            return false;
+        }
+        m_keySalt.resize(GmPackageCipher::SaltSize);
+        QByteArray savedKeyCheck(GmPackageCipher::KeyCheckSize, '\0');
+        in.readRawData(m_keySalt.data(), m_keySalt.size());
+        in.readRawData(savedKeyCheck.data(), savedKeyCheck.size());
+        if (m_userKey.isEmpty()) {
+            m_errorMessage = QString("Package %1 is encrypted, the key is required.").arg(packageFile.fileName());
+            return false;
+        }
+        QByteArray key = GmPackageCipher::deriveKey(m_userKey, m_keySalt);
+        if (GmPackageCipher::getKeyCheck(key) != savedKeyCheck) {
+            m_errorMessage = QString("Key of package %1 is wrong.").arg(packageFile.fileName());
+            return false;
+        }
+        m_cipher.setKey(key);
+    }
     ok = in.status() == QDataStream::Ok;
 
     return ok;
@@ -392,28 +1389,27 @@ bool GmPackageManager::readPackageFileHeader(QFile & packageFile)
 
 size_t GmPackageManager::getPackageFileHeaderSize() const
 {
-    size_t headerSize = 0;
-    if (m_version == 1) headerSize = sizeof (int) + sizeof (quint8);
+    size_t headerSize = sizeof (int) + sizeof (quint8);
+    if (m_version >= 2) headerSize += sizeof (quint8) + sizeof (m_fileIdentification);
+    if (m_version >= 4) headerSize += sizeof (qint32) + m_dictionary.size();
+    if (m_encryption == GmPackageCipher::ChaCha20Mode) headerSize += GmPackageCipher::SaltSize + GmPackageCipher::KeyCheckSize;
     return headerSize;
 }
 
 qint64 GmPackageManager::getPackageFileHeaderStartPosition()
 {
-    if (!isValid()) {
-        m_errorMessage = QString("The package is invalid.");
-        return -1;
-    }
-
-    size_t headerSize = getPackageFileHeaderSize();
+    // header is at package start
+    return m_packageFileStartPosition;
+}
 
-    const GmPackageFileInfoItem & item = m_fileInfoList.first();
-    qint64 pos = getFileDataStartPosition(item) - (qint64) headerSize;
-    return pos;
+const GmPackageFileIndex & GmPackageManager::getFileIndex() const
+{
+    return m_fileIndex;
 }
 
-const QList<GmPackageFileInfoItem> & GmPackageManager::getFileInfoList() const
+QList<GmPackageFileInfoItem> GmPackageManager::getFileInfoList() const
 {
-    return m_fileInfoList;
+    return m_fileIndex.toList();
 }
 
 bool GmPackageManager::getFileInfoList(int sort, QList<GmPackageFileInfoItem> & fileInfoList) const
@@ -425,7 +1421,15 @@ bool GmPackageManager::getFileInfoList(int sort, QList<GmPackageFileInfoItem> &
 
 bool GmPackageManager::getFileInfoList(const QList<int> & sortList, QList<GmPackageFileInfoItem> & fileInfoList) const
 {
-    return getFileInfoList(m_fileInfoList, sortList, fileInfoList);
+    fileInfoList.clear();
+    for (int i = 0; i < m_fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = m_fileIndex.record(i);
+        if (record.deleteFlag) continue;
+        if (sortList.contains(record.sort)) {
+            fileInfoList.append(m_fileIndex.at(i));
+        }
+    }
+    return (!fileInfoList.isEmpty());
 }
 
 bool GmPackageManager::getFileInfoList(const QList<GmPackageFileInfoItem> & sourceFileInfoList,
@@ -444,7 +1448,25 @@ bool GmPackageManager::getFileInfoList(const QList<GmPackageFileInfoItem> & sour
 
 bool GmPackageManager::getFileInfoList(const QString & startDirName, bool containsSubdir, QList<GmPackageFileInfoItem> & fileInfoList) const
 {
-    return getFileInfoList(m_fileInfoList, startDirName, containsSubdir, fileInfoList);
+    fileInfoList.clear();
+
+    // names are compared in name arena of index, only matched items are copied
+    QString dirNameSep = startDirName;
+    if (!dirNameSep.isEmpty() && !dirNameSep.endsWith(QDir::separator())) dirNameSep += QDir::separator();
+    for (int i = 0; i < m_fileIndex.size(); i++) {
+        if (m_fileIndex.record(i).deleteFlag) continue;
+        QStringRef filename = m_fileIndex.filenameRef(i);
+        if (!filename.startsWith(dirNameSep)) continue;
+        if (containsSubdir) {
+            fileInfoList.append(m_fileIndex.at(i));
+        } else {
+            QStringRef name(filename.string(), filename.position() + dirNameSep.length(), filename.length() - dirNameSep.length());
+            if (!name.contains(QDir::separator())) {
+                fileInfoList.append(m_fileIndex.at(i));
+            }
+        }
+    }
+    return (!fileInfoList.isEmpty());
 }
 
 bool GmPackageManager::getFileInfoList(const QList<GmPackageFileInfoItem> & sourceFileInfoList,
@@ -486,28 +1508,23 @@ bool GmPackageManager::getFilenames(const QString & startDirName, bool containsS
 {
     filenames.clear();
     if (startDirName.isEmpty()) {
-        for (int i = 0; i < m_fileInfoList.size(); i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            if (item.deleteFlag) continue;
-            if (containsSubdir) {
-                filenames.append(item.filename);
-            } else if (!item.filename.contains(QDir::separator())) {
-                filenames.append(item.filename);
+        for (int i = 0; i < m_fileIndex.size(); i++) {
+            if (m_fileIndex.record(i).deleteFlag) continue;
+            QStringRef filename = m_fileIndex.filenameRef(i);
+            if (containsSubdir || !filename.contains(QDir::separator())) {
+                filenames.append(m_fileIndex.filename(i));
             }
         }
     } else {
         QString dirNameSep = startDirName;
         if (!dirNameSep.endsWith(QDir::separator())) dirNameSep += QDir::separator();
-        for (int i = 0; i < m_fileInfoList.size(); i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            if (item.deleteFlag) continue;
-            if (item.filename.startsWith(dirNameSep) &&
-                    item.filename.length() > dirNameSep.length()) {
-                QString filename = item.filename.mid(dirNameSep.length());
-                if (containsSubdir) {
-                    filenames.append(filename);
-                } else if (!filename.contains(QDir::separator())) {
-                    filenames.append(filename);
+        for (int i = 0; i < m_fileIndex.size(); i++) {
+            if (m_fileIndex.record(i).deleteFlag) continue;
+            QStringRef filename = m_fileIndex.filenameRef(i);
+            if (filename.startsWith(dirNameSep) && filename.length() > dirNameSep.length()) {
+                QStringRef name(filename.string(), filename.position() + dirNameSep.length(), filename.length() - dirNameSep.length());
+                if (containsSubdir || !name.contains(QDir::separator())) {
+                    filenames.append(name.toString());
                 }
             }
         }
@@ -530,27 +1547,26 @@ bool GmPackageManager::getDirNames(const QString & startDirName, QStringList & d
 {
     dirNames.clear();
     if (startDirName.isEmpty()) {
-        for (int i = 0; i < m_fileInfoList.size(); i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            if (item.deleteFlag) continue;
-            int index = item.filename.indexOf(QDir::separator());
+        for (int i = 0; i < m_fileIndex.size(); i++) {
+            if (m_fileIndex.record(i).deleteFlag) continue;
+            QStringRef filename = m_fileIndex.filenameRef(i);
+            int index = filename.indexOf(QDir::separator());
             if (index > 0) {
-                QString dirName = item.filename.mid(0, index);
+                QString dirName(filename.unicode(), index);
                 if (!dirNames.contains(dirName)) dirNames.append(dirName);
             }
         }
     } else {
         QString dirNameSep = startDirName;
         if (!dirNameSep.endsWith(QDir::separator())) dirNameSep += QDir::separator();
-        for (int i = 0; i < m_fileInfoList.size(); i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            if (item.deleteFlag) continue;
-            if (item.filename.startsWith(dirNameSep) &&
-                    item.filename.length() > dirNameSep.length()) {
-                QString filename = item.filename.mid(dirNameSep.length());
-                int index = filename.indexOf(QDir::separator());
+        for (int i = 0; i < m_fileIndex.size(); i++) {
+            if (m_fileIndex.record(i).deleteFlag) continue;
+            QStringRef filename = m_fileIndex.filenameRef(i);
+            if (filename.startsWith(dirNameSep) && filename.length() > dirNameSep.length()) {
+                QStringRef name(filename.string(), filename.position() + dirNameSep.length(), filename.length() - dirNameSep.length());
+                int index = name.indexOf(QDir::separator());
                 if (index > 0) {
-                    QString dirName = item.filename.mid(0, index);
+                    QString dirName(filename.unicode(), index);
                     if (!dirNames.contains(dirName)) dirNames.append(dirName);
                 }
             }
@@ -581,16 +1597,16 @@ qint64 GmPackageManager::getFileDataSize(const QList<GmPackageFileInfoItem> & fi
 
 int GmPackageManager::getFileNumber() const
 {
-    return m_fileInfoList.size();
+    return m_fileIndex.size();
 }
 
 int GmPackageManager::getFileNumber(int sort) const
 {
     int fileNumber = 0;
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-        if (item.deleteFlag) continue;
-        if (item.sort == sort) fileNumber++;
+    for (int i = 0; i < m_fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = m_fileIndex.record(i);
+        if (record.deleteFlag) continue;
+        if (record.sort == sort) fileNumber++;
     }
     return fileNumber;
 }
@@ -598,43 +1614,31 @@ int GmPackageManager::getFileNumber(int sort) const
 int GmPackageManager::getFileNumber(const QList<int> & sortList) const
 {
     int fileNumber = 0;
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-        if (item.deleteFlag) continue;
-        if (sortList.contains(item.sort)) fileNumber++;
+    for (int i = 0; i < m_fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = m_fileIndex.record(i);
+        if (record.deleteFlag) continue;
+        if (sortList.contains(record.sort)) fileNumber++;
     }
     return fileNumber;
 }
 
 bool GmPackageManager::fileExists(const QString & filename) const
 {
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-        if (item.deleteFlag) continue;
-        if (item.filename == filename)
-            return true;
-    }
-    return false;
+    return (m_fileIndex.indexOf(filename) >= 0);
 }
 
 int GmPackageManager::indexOf(const QString & filename) const
 {
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-        if (item.deleteFlag) continue;
-        if (item.filename == filename)
-            return i;
-    }
-    return -1;
+    return m_fileIndex.indexOf(filename);
 }
 
 bool GmPackageManager::getFileInfo(int index, GmPackageFileInfoItem & item)
 {
-    if (index < 0 || index >= m_fileInfoList.size()) {
-        m_errorMessage = QString("Index is out of range (0...%1)").arg(m_fileInfoList.size() - 1);
+    if (index < 0 || index >= m_fileIndex.size()) {
+        m_errorMessage = QString("Index is out of range (0...%1)").arg(m_fileIndex.size() - 1);
         return false;
     }
-    item = m_fileInfoList.at(index);
+    item = m_fileIndex.at(index);
     return true;
 }
 
@@ -644,21 +1648,6 @@ bool GmPackageManager::getFileInfo(const QString & filename, GmPackageFileInfoIt
     return getFileInfo(index, item);
 }
 
-GmPackageFileInfoItem * GmPackageManager::getFileInfo(int index)
-{
-    if (index < 0 || index >= m_fileInfoList.size()) {
-        m_errorMessage = QString("Index is out of range (0...%1)").arg(m_fileInfoList.size() - 1);
-        return NULL;
-    }
-    return &m_fileInfoList[index];
-}
-
-GmPackageFileInfoItem * GmPackageManager::getFileInfo(const QString & filename)
-{
-    int index = indexOf(filename);
-    return getFileInfo(index);
-}
-
 qint64 GmPackageManager::getFileInfoStartPosition()
 {
     if (!isValid()) {
@@ -666,40 +1655,54 @@ qint64 GmPackageManager::getFileInfoStartPosition()
         return -1;
     }
 
-    const GmPackageFileInfoItem & item = m_fileInfoList.last();
-    qint64 pos = getFileDataStartPosition(item) + item.compressedDataLength;
-    return pos;
+    // the last item may be empty file, symbolic link or in solid block, so use data end position
+    return m_fileDataEndPosition;
 }
 
 bool GmPackageManager::removeDataFile(const QString & filename)
 {
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        GmPackageFileInfoItem & item = m_fileInfoList[i];
-        if (item.deleteFlag) continue;
-        if (item.filename == filename) {
-            item.setDeleteFlag(true);
-            return true;
-        }
+    int index = m_fileIndex.indexOf(filename);
+    if (index < 0) {
+        m_errorMessage = QString("File %1 not exists.").arg(filename);
+        return false;
     }
-    m_errorMessage = QString("File %1 not exists.").arg(filename);
-    return false;
+    m_fileIndex.setDeleteFlag(index, true);
+    return true;
 }
 
 bool GmPackageManager::removeDataFile(const QString & filename, QFile & packageFile)
 {
-    bool ok = false;
+    GmPackageFileInfoBatch batch;
+    batch.removeFile(filename);
+    return applyFileInfoBatch(batch, packageFile);
+}
 
-    if (!isValid()) ok = load();
-    if (!ok) return false;
+bool GmPackageManager::removeDataFile(const QString & filename, const QString & packageFilename, const QByteArray & userKey)
+{
+    bool ok = false;
 
-    ok = removeDataFile(filename);
+    QFile packageFile(packageFilename);
+    ok = packageFile.open(QIODevice::ReadWrite);
     if (!ok) return false;
 
-    ok = saveFileInfo(packageFile);
+    GmPackageManager lopm(packageFilename, userKey);
+    ok = lopm.removeDataFile(filename, packageFile);
     return ok;
 }
 
-bool GmPackageManager::removeDataFile(const QString & filename, const QString & packageFilename)
+void GmPackageManager::setPackageFileSort(int sort)
+{
+    for (int i = 0; i < m_fileIndex.size(); i++) m_fileIndex.setSort(i, sort);
+}
+
+bool GmPackageManager::setPackageFileSort(int sort, QFile & packageFile)
+{
+    GmPackageFileInfoBatch batch;
+    batch.allSort = sort;
+    return applyFileInfoBatch(batch, packageFile);
+}
+
+bool GmPackageManager::setPackageFileSort(int sort, const QString & packageFilename, const QByteArray & userKey)
 {
     bool ok = false;
 
@@ -707,33 +1710,85 @@ bool GmPackageManager::removeDataFile(const QString & filename, const QString &
     ok = packageFile.open(QIODevice::ReadWrite);
     if (!ok) return false;
 
-    GmPackageManager lopm(packageFilename);
-    ok = lopm.removeDataFile(filename, packageFile);
+    GmPackageManager lopm(packageFilename, userKey);
+    ok = lopm.setPackageFileSort(sort, packageFile);
     return ok;
 }
 
-void GmPackageManager::setPackageFileSort(int sort)
+bool GmPackageManager::applyFileInfoBatch(const GmPackageFileInfoBatch & batch, QList<int> *changedIndexList)
 {
-    for (int i = 0; i < m_fileInfoList.size(); i++) {
-        GmPackageFileInfoItem & item = m_fileInfoList[i];
-        item.sort = sort;
+    if (changedIndexList) changedIndexList->clear();
+
+    // all files are found before any item is changed
+    QList<int> sortIndexList;
+    for (int i = 0; i < batch.sortList.size(); i++) {
+        int index = m_fileIndex.indexOf(batch.sortList.at(i).first);
+        if (index < 0) {
+            m_errorMessage = QString("File %1 not exists.").arg(batch.sortList.at(i).first);
+            return false;
+        }
+        sortIndexList.append(index);
+    }
+    QList<int> removeIndexList;
+    for (int i = 0; i < batch.removeFilenames.size(); i++) {
+        int index = m_fileIndex.indexOf(batch.removeFilenames.at(i));
+        if (index < 0) {
+            m_errorMessage = QString("File %1 not exists.").arg(batch.removeFilenames.at(i));
+            return false;
+        }
+        removeIndexList.append(index);
+    }
+
+    // flags of changed items
+    QVector<bool> changedFlags(m_fileIndex.size(), false);
+    if (batch.allSort >= 0) {
+        for (int i = 0; i < m_fileIndex.size(); i++) {
+            if (m_fileIndex.record(i).sort == batch.allSort) continue;
+            m_fileIndex.setSort(i, batch.allSort);
+            changedFlags[i] = true;
+        }
+    }
+    for (int i = 0; i < sortIndexList.size(); i++) {
+        int index = sortIndexList.at(i);
+        qint32 sort = batch.sortList.at(i).second;
+        if (m_fileIndex.record(index).sort == sort) continue;
+        m_fileIndex.setSort(index, sort);
+        changedFlags[index] = true;
+    }
+    for (int i = 0; i < removeIndexList.size(); i++) {
+        int index = removeIndexList.at(i);
+        if (m_fileIndex.record(index).deleteFlag) continue;
+        m_fileIndex.setDeleteFlag(index, true);
+        changedFlags[index] = true;
+    }
+
+    if (changedIndexList) {
+        for (int i = 0; i < changedFlags.size(); i++) {
+            if (changedFlags.at(i)) changedIndexList->append(i);
+        }
     }
+    return true;
 }
 
-bool GmPackageManager::setPackageFileSort(int sort, QFile & packageFile)
+bool GmPackageManager::applyFileInfoBatch(const GmPackageFileInfoBatch & batch, QFile & packageFile)
 {
-    bool ok = false;
+    if (!isValid()) {
+        bool ok = load();
+        if (!ok) return false;
+    }
 
-    if (!isValid()) ok = load();
+    bool patchFlag = canPatchFileInfo();
+    QList<int> changedIndexList;
+    bool ok = applyFileInfoBatch(batch, &changedIndexList);
     if (!ok) return false;
+    if (patchFlag && changedIndexList.isEmpty()) return true;
 
-    setPackageFileSort(sort);
-
-    ok = saveFileInfo(packageFile);
-    return ok;
+    if (patchFlag) return patchFileInfo(packageFile, changedIndexList);
+    return saveFileInfo(packageFile);
 }
 
-bool GmPackageManager::setPackageFileSort(int sort, const QString & packageFilename)
+bool GmPackageManager::applyFileInfoBatch(const GmPackageFileInfoBatch & batch, const QString & packageFilename,
+                                          const QByteArray & userKey)
 {
     bool ok = false;
 
@@ -741,22 +1796,110 @@ bool GmPackageManager::setPackageFileSort(int sort, const QString & packageFilen
     ok = packageFile.open(QIODevice::ReadWrite);
     if (!ok) return false;
 
-    GmPackageManager lopm(packageFilename);
-    ok = lopm.setPackageFileSort(sort, packageFile);
+    GmPackageManager lopm(packageFilename, userKey);
+    ok = lopm.applyFileInfoBatch(batch, packageFile);
     return ok;
 }
 
+bool GmPackageManager::canPatchFileInfo() const
+{
+    // encrypted file information is saved again with a new index nonce
+    return (m_version >= 9 && m_storedInfoCompressFlag == 0 && !isPlainFileInfoEncrypted() && m_storedInfoDataSize > 0 &&
+            m_storedInfoCount == m_fileIndex.size() && m_volumeFile.isNull());
+}
+
+bool GmPackageManager::isPlainFileInfoEncrypted() const
+{
+    return (m_version >= 12 && m_encryption == GmPackageCipher::ChaCha20Mode);
+}
+
+bool GmPackageManager::patchFileInfo(QFile & packageFile, const QList<int> & indexList)
+{
+    GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::IndexSavePhase);
+    qint64 packageInfoDataStartPos = m_fileDataEndPosition;
+
+    // stored file information is read again, it is needed for checksum and manifest hashes
+    QByteArray storedInfoData;
+    storedInfoData.resize((int) m_storedInfoDataSize);
+    bool ok = packageFile.seek(packageInfoDataStartPos);
+    ok = ok && (packageFile.read(storedInfoData.data(), storedInfoData.size()) == storedInfoData.size());
+    if (!ok) {
+        m_errorMessage = QString("Reads file information from package %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+
+    // compress flag is the first byte, fixed size fields of items are after front coded names
+    int infoCount = m_fileIndex.size();
+    int fieldsOffset = GmPackageFileIndex::getFieldsOffset(storedInfoData.constData() + sizeof (quint8),
+            storedInfoData.size() - (int) sizeof (quint8), infoCount);
+    if (fieldsOffset < 0 || storedInfoData.at(0) != 0 ||
+            (qint64) sizeof (quint8) + fieldsOffset + (qint64) infoCount * GmPackageFileIndex::FieldsRecordSize != storedInfoData.size()) {
+        m_errorMessage = QString("File information of package %1 is invalid.").arg(packageFile.fileName());
+        return false;
+    }
+    fieldsOffset += (int) sizeof (quint8);
+
+    int firstIndex = infoCount, lastIndex = -1;
+    for (int i = 0; i < indexList.size(); i++) {
+        int index = indexList.at(i);
+        const GmPackageFileIndexRecord & record = m_fileIndex.record(index);
+        uchar *fields = (uchar *) storedInfoData.data() + fieldsOffset + index * GmPackageFileIndex::FieldsRecordSize;
+        qToLittleEndian<qint32>(record.sort, fields + GmPackageFileIndex::SortFieldOffset);
+        fields[GmPackageFileIndex::DeleteFlagFieldOffset] = record.deleteFlag;
+        firstIndex = qMin(firstIndex, index);
+        lastIndex = qMax(lastIndex, index);
+    }
+    if (lastIndex < 0) return true;
+
+    // one write from the first to the last changed item
+    int patchOffset = fieldsOffset + firstIndex * GmPackageFileIndex::FieldsRecordSize;
+    int patchLength = (lastIndex - firstIndex + 1) * GmPackageFileIndex::FieldsRecordSize;
+    ok = packageFile.seek(packageInfoDataStartPos + patchOffset);
+    ok = ok && (packageFile.write(storedInfoData.constData() + patchOffset, patchLength) == patchLength);
+    if (!ok) {
+        m_errorMessage = QString("Writes file information to package %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+    timer.setBytes(patchLength);
+
+    // checksum and manifest are after stored file information, their sizes aren't changed
+    ok = packageFile.seek(packageInfoDataStartPos + storedInfoData.size());
+    if (!ok) {
+        m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(packageInfoDataStartPos + storedInfoData.size()).arg(packageFile.fileName());
+        return false;
+    }
+    QDataStream out(&packageFile);
+    out.setByteOrder(GmPackageManager::getLoPackageByteOrder());
+    out << updateChecksum(0, storedInfoData.constData(), storedInfoData.size());
+    ok = writeManifest(out, storedInfoData);
+    if (!ok) return false;
+
+    ok = packageFile.flush();
+    if (!ok) {
+        m_errorMessage = QString("Writes file information to package %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+    return true;
+}
+
 bool GmPackageManager::appendFileInfo(const GmPackageFileInfoItem & item)
 {
     if (fileExists(item.filename)) return false;
-    m_fileInfoList.append(item);
+    m_fileIndex.append(item);
     return true;
 }
 
 bool GmPackageManager::loadFileInfo(QFile & packageFile)
 {
-    m_fileInfoList.clear();
+    m_fileIndex.clear();
+    m_storedInfoCount = 0;
+    m_storedInfoDataSize = 0;
+    m_blockHashHash.clear();
+    m_manifestRoot.clear();
+    m_solidBlockCount = 0;
+    m_volumeCount = 0;
     bool ok = false;
+    GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::IndexLoadPhase);
 
     QDataStream in(&packageFile);
     in.setByteOrder(GmPackageManager::getLoPackageByteOrder());
@@ -764,6 +1907,10 @@ bool GmPackageManager::loadFileInfo(QFile & packageFile)
     qint64 fsize = packageFile.size();
     qint64 infoTailSize = (qint64) (sizeof (int) + sizeof (qint64) * 2);
     qint64 infoTailStartPosition = fsize - infoTailSize;
+    if (infoTailStartPosition < 0) {
+        m_errorMessage = QString("File %1 is not a package.").arg(packageFile.fileName());
+        return false;
+    }
     ok = packageFile.seek(infoTailStartPosition);
     if (!ok) {
         m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(infoTailStartPosition).arg(packageFile.fileName());
@@ -777,72 +1924,247 @@ bool GmPackageManager::loadFileInfo(QFile & packageFile)
     in >> packageInfoDataStartPos;
     in >> packageFileSize;
 
-    if (fsize < packageFileSize) return false;
-
-    qint64 fileInfoDataSize = packageFileSize - packageInfoDataStartPos - infoTailSize;
+    if (fsize < packageFileSize) {
+        m_errorMessage = QString("File %1 is not a package.").arg(packageFile.fileName());
+        return false;
+    }
 
+    m_packageFileStartPosition = 0;
     if (fsize > packageFileSize) {
         m_packageFileStartPosition = fsize - packageFileSize;
-        packageInfoDataStartPos += m_packageFileStartPosition;
     }
+    packageInfoDataStartPos += m_packageFileStartPosition;
+    m_fileDataEndPosition = packageInfoDataStartPos;
+
+    if (infoCount == 0) {
+        m_errorMessage = QString("Package %1 has no file.").arg(packageFile.fileName());
+        return false;
+    }
+
+    // load version and compress flag, format of file information item depends on version
+    ok = readPackageFileHeader(packageFile);
+    if (!ok) return false;
+
+    // manifest and checksum are saved after file information list data
+    qint64 storedInfoEndPosition = infoTailStartPosition;
+    QByteArray dataHashes, indexHashes;
+    if (m_version >= 7) {
+        ok = readManifest(packageFile, infoTailStartPosition, storedInfoEndPosition, dataHashes, indexHashes);
+        if (!ok) return false;
+    }
+    if (m_version >= 6) storedInfoEndPosition -= (qint64) sizeof (quint32);
+
+    // size of stored file information blocks data with compress flag
+    qint64 storedInfoDataSize = storedInfoEndPosition - packageInfoDataStartPos;
+    if (storedInfoDataSize <= (qint64) sizeof (quint8) || storedInfoDataSize > 0x7FFFFFFF) {
+        m_errorMessage = QString("File information of package %1 is invalid.").arg(packageFile.fileName());
+        return false;
+    }
+    timer.setBytes(storedInfoDataSize);
 
-    if (infoCount == 0) return false;
     ok = packageFile.seek(packageInfoDataStartPos);
     if (!ok) {
         m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(packageInfoDataStartPos).arg(packageFile.fileName());
         return false;
     }
 
-    // input compress flag
-    quint8 compressFlag;
-    in >> compressFlag;
-    if (compressFlag) {
-        char *data = new char[fileInfoDataSize];
-        if (data == NULL) {
-            m_errorMessage = QString("Allocs data buffer [%1] failure.").arg(fileInfoDataSize);
+    // input compress flag and stored file information list data
+    QByteArray storedInfoData;
+    storedInfoData.resize((int) storedInfoDataSize);
+    if (in.readRawData(storedInfoData.data(), (int) storedInfoDataSize) != (int) storedInfoDataSize) {
+        m_errorMessage = QString("Reads data block from file %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+
+    if (m_version >= 6) {
+        quint32 savedChecksum = 0;
+        in >> savedChecksum;
+        if (savedChecksum != updateChecksum(0, storedInfoData.constData(), storedInfoData.size())) {
+            m_errorMessage = QString("Checksum of file information of package %1 is wrong.").arg(packageFile.fileName());
             return false;
         }
-        ok = readDataBlock(data, fileInfoDataSize, packageFile);
-        if (!ok) {
-            delete []data;
-            m_errorMessage = QString("Reads data block from file %1 failure.").arg(packageFile.fileName());
+    }
+    if (m_version >= 7 && indexHashes != GmPackageManifest::getChunkHashes(storedInfoData.constData(), storedInfoData.size(), m_manifestChunkSize)) {
+        m_errorMessage = QString("Manifest hashes of file information of package %1 are wrong.").arg(packageFile.fileName());
+        return false;
+    }
+
+    quint8 compressFlag = (quint8) storedInfoData.at(0);
+    qint64 position = packageInfoDataStartPos - m_packageFileStartPosition + (qint64) sizeof (quint8);
+    int headerSize = (int) sizeof (quint8);
+    bool plainEncryptFlag = (!compressFlag && isPlainFileInfoEncrypted());
+    if ((compressFlag || plainEncryptFlag) && m_version >= 12) {
+        // index nonce of the save is mixed into cipher position
+        if (storedInfoData.size() <= headerSize + IndexNonceSize) {
+            m_errorMessage = QString("File information of package %1 is invalid.").arg(packageFile.fileName());
             return false;
-        } else {
-            // uncompress data
-            QByteArray fileInfoListBuf = qUncompress((uchar*) data, fileInfoDataSize);
+        }
+        QByteArray indexNonce = storedInfoData.mid(headerSize, IndexNonceSize);
+        headerSize += IndexNonceSize;
+        position = getIndexCipherPosition(position + IndexNonceSize, indexNonce);
+    }
+    QList<QByteArray> segmentList;
+    QList<int> countList;
+    if (compressFlag && m_version >= 10) {
+        // segments are decrypted and uncompressed in parallel
+        QByteArray segmentData = QByteArray::fromRawData(storedInfoData.constData() + headerSize,
+                storedInfoData.size() - headerSize);
+        ok = uncompressFileInfoSegments(segmentData, position, infoCount, segmentList, countList);
+        if (!ok) return false;
+    } else {
+        QByteArray fileInfoListBuf = storedInfoData.mid(headerSize);
+        if (compressFlag) {
+            // decrypt and uncompress data
+            m_cipher.process(fileInfoListBuf.data(), fileInfoListBuf.size(), IndexCipherVolume, position);
+            int storedSize = fileInfoListBuf.size();
+            fileInfoListBuf = qUncompress((const uchar *) fileInfoListBuf.constData(), fileInfoListBuf.size());
             if (fileInfoListBuf.size() == 0) {
-                delete []data;
-                m_errorMessage = QString("Uncompress data block [%1] failure.").arg(fileInfoDataSize);
+                m_errorMessage = QString("Uncompress data block [%1] failure.").arg(storedSize);
                 return false;
             }
-            delete []data;
-            QDataStream inb(&fileInfoListBuf, QIODevice::ReadOnly);
-            for (int i = 0; i < infoCount; i++) {
-                GmPackageFileInfoItem item;
-                inb >> item;
-                m_fileInfoList.append(item);
-            }
+        } else if (plainEncryptFlag) {
+            // decrypt not compressed data
+            m_cipher.process(fileInfoListBuf.data(), fileInfoListBuf.size(), IndexCipherVolume, position);
         }
-    } else {
-        // input LoPFileInfoItems
-        for (int i = 0; i < infoCount; i++) {
-            GmPackageFileInfoItem item;
-            in >> item;
-            m_fileInfoList.append(item);
+        segmentList.append(fileInfoListBuf);
+        countList.append(infoCount);
+    }
+    storedInfoData.clear();
+
+    // input LoPFileInfoItems, all items are parsed into packed records of file index,
+    // records and names arena are allocated once for infoCount items
+    if (infoCount < 0 || !m_fileIndex.read(segmentList, countList, m_version)) {
+        m_errorMessage = QString("File information of package %1 is invalid.").arg(packageFile.fileName());
+        return false;
+    }
+    segmentList.clear();
+    m_storedInfoCount = infoCount;
+    m_storedInfoDataSize = storedInfoDataSize;
+    m_storedInfoCompressFlag = compressFlag;
+
+    // next solid block index for appending files
+    for (int i = 0; i < m_fileIndex.size(); i++) {
+        const GmPackageFileIndexRecord & record = m_fileIndex.record(i);
+        if (record.blockIndex >= m_solidBlockCount) m_solidBlockCount = record.blockIndex + 1;
+        if (record.volume > m_volumeCount) m_volumeCount = record.volume;
+    }
+
+    // leaf hashes of data blocks, blocks are in the order of their first item
+    if (m_version >= 7) {
+        QList<int> blockIndexList = getDataBlockIndexList(m_fileIndex);
+        int leafOffset = 0;
+        for (int i = 0; i < blockIndexList.size(); i++) {
+            const GmPackageFileIndexRecord & item = m_fileIndex.record(blockIndexList.at(i));
+            int leafSize = GmPackageManifest::getChunkCount(item.compressedDataLength, m_manifestChunkSize) * GmPackageManifest::HashSize;
+            if (leafOffset + leafSize > dataHashes.size()) break;
+            m_blockHashHash.insert(QPair<qint32, qint64>(item.volume, item.position), dataHashes.mid(leafOffset, leafSize));
+            leafOffset += leafSize;
+        }
+        if (leafOffset != dataHashes.size() || m_blockHashHash.size() != blockIndexList.size()) {
+            m_blockHashHash.clear();
+            m_errorMessage = QString("Manifest of package %1 doesn't match file information.").arg(packageFile.fileName());
+            return false;
         }
     }
 
     return true;
 }
 
+bool GmPackageManager::readManifest(QFile & packageFile, qint64 manifestEndPosition, qint64 & manifestStartPosition,
+        QByteArray & dataHashes, QByteArray & indexHashes)
+{
+    QDataStream in(&packageFile);
+    in.setByteOrder(GmPackageManager::getLoPackageByteOrder());
+
+    // manifest size is saved before package tail
+    qint64 manifestSize = 0;
+    qint64 manifestSizePosition = manifestEndPosition - (qint64) sizeof (qint64);
+    bool ok = (manifestSizePosition > 0) && packageFile.seek(manifestSizePosition);
+    if (ok) {
+        in >> manifestSize;
+        manifestStartPosition = manifestSizePosition - manifestSize;
+        ok = (manifestSize > 0 && manifestStartPosition > 0) && packageFile.seek(manifestStartPosition);
+    }
+    if (!ok) {
+        m_errorMessage = QString("Manifest of package %1 is invalid.").arg(packageFile.fileName());
+        return false;
+    }
+
+    qint32 chunkSize = 0, dataLeafCount = 0, indexLeafCount = 0;
+    in >> chunkSize >> dataLeafCount >> indexLeafCount;
+    qint64 leafHashesSize = ((qint64) dataLeafCount + indexLeafCount) * GmPackageManifest::HashSize;
+    if (chunkSize <= 0 || dataLeafCount < 0 || indexLeafCount <= 0 ||
+            (qint64) sizeof (qint32) * 3 + leafHashesSize + GmPackageManifest::HashSize != manifestSize || leafHashesSize > 0x7FFFFFFF) {
+        m_errorMessage = QString("Manifest of package %1 is invalid.").arg(packageFile.fileName());
+        return false;
+    }
+
+    QByteArray leafHashes;
+    leafHashes.resize((int) leafHashesSize);
+    m_manifestRoot.resize(GmPackageManifest::HashSize);
+    ok = (in.readRawData(leafHashes.data(), leafHashes.size()) == leafHashes.size());
+    ok = ok && (in.readRawData(m_manifestRoot.data(), m_manifestRoot.size()) == m_manifestRoot.size());
+    if (!ok) {
+        m_errorMessage = QString("Reads manifest from file %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+    if (GmPackageManifest::getRootHash(leafHashes) != m_manifestRoot) {
+        m_errorMessage = QString("Root hash of manifest of package %1 is wrong.").arg(packageFile.fileName());
+        return false;
+    }
+
+    m_manifestChunkSize = chunkSize;
+    int dataLeafHashesSize = dataLeafCount * GmPackageManifest::HashSize;
+    dataHashes = leafHashes.left(dataLeafHashesSize);
+    indexHashes = leafHashes.mid(dataLeafHashesSize);
+    return true;
+}
+
+bool GmPackageManager::writeManifest(QDataStream & out, const QByteArray & storedInfoData)
+{
+    // leaf hashes of data blocks, blocks are in the order of their first item
+    QByteArray leafHashes;
+    QList<int> blockIndexList = getDataBlockIndexList(m_fileIndex);
+    for (int i = 0; i < blockIndexList.size(); i++) {
+        GmPackageFileInfoItem item = m_fileIndex.at(blockIndexList.at(i));
+        QByteArray chunkHashes = getDataBlockHashes(item);
+        int chunkCount = GmPackageManifest::getChunkCount(item.compressedDataLength, m_manifestChunkSize);
+        if (chunkHashes.size() != chunkCount * GmPackageManifest::HashSize) {
+            m_errorMessage = QString("Manifest hashes of file %1 data are missing.").arg(item.filename);
+            return false;
+        }
+        leafHashes.append(chunkHashes);
+    }
+    qint32 dataLeafCount = leafHashes.size() / GmPackageManifest::HashSize;
+
+    // leaf hashes of stored file information data
+    QByteArray indexHashes = GmPackageManifest::getChunkHashes(storedInfoData.constData(), storedInfoData.size(), m_manifestChunkSize);
+    qint32 indexLeafCount = indexHashes.size() / GmPackageManifest::HashSize;
+    leafHashes.append(indexHashes);
+    m_manifestRoot = GmPackageManifest::getRootHash(leafHashes);
+
+    out << m_manifestChunkSize << dataLeafCount << indexLeafCount;
+    out.writeRawData(leafHashes.constData(), leafHashes.size());
+    out.writeRawData(m_manifestRoot.constData(), m_manifestRoot.size());
+    qint64 manifestSize = (qint64) sizeof (qint32) * 3 + leafHashes.size() + m_manifestRoot.size();
+    out << manifestSize;
+    return (out.status() == QDataStream::Ok);
+}
+
 bool GmPackageManager::saveFileInfo(QFile & packageFile)
 {
+    // current data volume is finished
+    if (!m_volumeFile.isNull()) {
+        m_volumeFile->close();
+        m_volumeFile.clear();
+    }
+
     qint64 packageInfoDataStartPos = getFileInfoStartPosition();
     if (packageInfoDataStartPos < 0) {
         m_errorMessage = QString("Gets file information start position of package %1 failure.").arg(packageFile.fileName());
         return false;
     }
-    int infoCount = m_fileInfoList.size();
+    int infoCount = m_fileIndex.size();
     if (infoCount == 0) {
         m_errorMessage = QString("File information list of package %1 is empty.").arg(packageFile.fileName());
         return false;
@@ -853,49 +2175,78 @@ bool GmPackageManager::saveFileInfo(QFile & packageFile)
         m_errorMessage = QString("Seeks position to %1 of file %2 failure.").arg(packageInfoDataStartPos).arg(packageFile.fileName());
         return false;
     }
+    GmPackageStatisticsTimer timer(m_statistics, GmPackageStatistics::IndexSavePhase);
 
     QDataStream out(&packageFile);
     out.setByteOrder(GmPackageManager::getLoPackageByteOrder());
 
-    bool originalSaveFlag = true;
-    if (m_compressFlag) {
-        QByteArray fileInfoListBuf;
-        QDataStream outb(&fileInfoListBuf, QIODevice::WriteOnly);
-        for (int i = 0; i < infoCount; i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            outb << item;
-        }
-        if (fileInfoListBuf.size() > 0) {
-            // compress file information list data
-            QByteArray cba = qCompress((const uchar *) fileInfoListBuf.constData(), fileInfoListBuf.size(), m_compressionLevel);
-            if (cba.size() > 0) {
-                originalSaveFlag = false;
-                // output compress flag
-                out << m_compressFlag;
-                // output LoPFileInfoItem list compressed data
-                ok = writeDataBlock(cba.constData(), (qint64) cba.size(), packageFile);
-                if (!ok) {
-                    m_errorMessage = QString("Writes data block to package %1 failure.").arg(packageFile.fileName());
-                    return false;
-                }
-            }
+    // stored file information data, compress flag and LoPFileInfoItem list data,
+    // compressed data is encrypted like data blocks
+    QByteArray storedInfoData;
+    storedInfoData.append((char) 0);
+    qint64 position = packageInfoDataStartPos - m_packageFileStartPosition + (qint64) sizeof (quint8);
+    // file information is saved again at the same position when files are removed or sorted,
+    // a new random nonce of every save keeps the key stream of encrypted data from being reused
+    QByteArray indexNonce;
+    if ((m_compressFlag || isPlainFileInfoEncrypted()) && m_version >= 12) {
+        indexNonce = GmPackageCipher::getRandomData(IndexNonceSize);
+        if (indexNonce.size() != IndexNonceSize) {
+            m_errorMessage = QString("Gets random index nonce of package %1 failure.").arg(packageFile.fileName());
+            return false;
         }
+        position = getIndexCipherPosition(position + IndexNonceSize, indexNonce);
     }
-    if (originalSaveFlag) {
-        // output compress flag
-        out << m_compressFlag;
-        // output LoPFileInfoItems
-        for (int i = 0; i < infoCount; i++) {
-            const GmPackageFileInfoItem & item = m_fileInfoList.at(i);
-            out << item;
+    if (m_compressFlag && m_version >= 10) {
+        // segments are serialized and compressed in parallel
+        QByteArray segmentData;
+        if (compressFileInfoSegments(segmentData, position)) {
+            storedInfoData[0] = (char) m_compressFlag;
+            storedInfoData.append(indexNonce);
+            storedInfoData.append(segmentData);
+        }
+    } else if (m_compressFlag) {
+        // compress file information list data
+        QByteArray fileInfoListBuf;
+        m_fileIndex.write(fileInfoListBuf, m_version);
+        QByteArray cba = qCompress((const uchar *) fileInfoListBuf.constData(), fileInfoListBuf.size(), m_compressionLevel);
+        if (cba.size() > 0) {
+            storedInfoData[0] = (char) m_compressFlag;
+            m_cipher.process(cba.data(), cba.size(), IndexCipherVolume, position);
+            storedInfoData.append(indexNonce);
+            storedInfoData.append(cba);
         }
     }
+    if (storedInfoData.size() == 1 && isPlainFileInfoEncrypted()) {
+        // not compressed file information is encrypted like compressed data
+        QByteArray fileInfoListBuf;
+        m_fileIndex.write(fileInfoListBuf, m_version);
+        m_cipher.process(fileInfoListBuf.data(), fileInfoListBuf.size(), IndexCipherVolume, position);
+        storedInfoData.append(indexNonce);
+        storedInfoData.append(fileInfoListBuf);
+    } else if (storedInfoData.size() == 1) {
+        m_fileIndex.write(storedInfoData, m_version);
+    }
+    timer.setBytes(storedInfoData.size());
+
+    if (out.writeRawData(storedInfoData.constData(), storedInfoData.size()) != storedInfoData.size()) {
+        m_errorMessage = QString("Writes data block to package %1 failure.").arg(packageFile.fileName());
+        return false;
+    }
+    m_storedInfoCount = infoCount;
+    m_storedInfoDataSize = storedInfoData.size();
+    m_storedInfoCompressFlag = (quint8) storedInfoData.at(0);
+    // checksum of compress flag and stored file information list data
+    if (m_version >= 6) out << updateChecksum(0, storedInfoData.constData(), storedInfoData.size());
+    if (m_version >= 7) {
+        ok = writeManifest(out, storedInfoData);
+        if (!ok) return false;
+    }
     // output information item count
     out << infoCount;
     // output package information data start position
-    out << packageInfoDataStartPos;
-    // output package file size
-    qint64 packageFileSize = packageFile.size() + sizeof (qint64);
+    out << (packageInfoDataStartPos - m_packageFileStartPosition);
+    // output package file size, the file may be longer than current position before resize
+    qint64 packageFileSize = packageFile.pos() + sizeof (qint64) - m_packageFileStartPosition;
     out << packageFileSize;
 
     // hear is package file tail, if some data exists after current position that must be truncated.
@@ -909,14 +2260,107 @@ bool GmPackageManager::saveFileInfo(QFile & packageFile)
     return true;
 }
 
+bool GmPackageManager::compressFileInfoSegments(QByteArray & segmentData, qint64 position) const
+{
+    segmentData.clear();
+
+    // item ranges of segments
+    QList<QPair<int, int> > rangeList;
+    for (int first = 0; first < m_fileIndex.size(); first += IndexSegmentSize) {
+        rangeList.append(QPair<int, int>(first, qMin(IndexSegmentSize, m_fileIndex.size() - first)));
+    }
+    GmPackageIndexSegmentCompressFunctor functor(&m_fileIndex, m_version, m_compressionLevel);
+    QList<QByteArray> compressedList = QtConcurrent::blockingMapped<QList<QByteArray> >(rangeList, functor);
+
+    // segment table, then segments, every segment is encrypted from its own position
+    {
+        QDataStream out(&segmentData, QIODevice::WriteOnly);
+        out.setByteOrder(GmPackageManager::getLoPackageByteOrder());
+        out << (qint32) rangeList.size();
+        for (int i = 0; i < rangeList.size(); i++) {
+            if (compressedList.at(i).isEmpty()) return false;
+            out << (qint32) rangeList.at(i).second << (qint32) compressedList.at(i).size();
+        }
+    }
+    qint64 segmentPosition = position + segmentData.size();
+    for (int i = 0; i < compressedList.size(); i++) {
+        QByteArray & segment = compressedList[i];
+        m_cipher.process(segment.data(), segment.size(), IndexCipherVolume, segmentPosition);
+        segmentData.append(segment);
+        segmentPosition += segment.size();
+        segment.clear();
+    }
+    return true;
+}
+
+bool GmPackageManager::uncompressFileInfoSegments(const QByteArray & segmentData, qint64 position, int infoCount,
+        QList<QByteArray> & segmentList, QList<int> & countList)
+{
+    segmentList.clear();
+    countList.clear();
+
+    // segment table
+    QDataStream in(segmentData);
+    in.setByteOrder(GmPackageManager::getLoPackageByteOrder());
+    qint32 segmentCount = 0;
+    in >> segmentCount;
+    qint64 tableSize = (qint64) sizeof (qint32) * (1 + 2 * (qint64) segmentCount);
+    bool ok = (segmentCount > 0 && segmentCount <= infoCount && tableSize <= segmentData.size());
+
+    QList<GmPackageIndexSegment> storedSegmentList;
+    qint64 offset = tableSize;
+    qint64 itemCount = 0;
+    for (int i = 0; i < segmentCount && ok; i++) {
+        qint32 count = 0, size = 0;
+        in >> count >> size;
+        ok = (count > 0 && size > 0 && offset + size <= segmentData.size());
+        GmPackageIndexSegment segment;
+        segment.position = position + offset;
+        segment.offset = (int) offset;
+        segment.size = size;
+        storedSegmentList.append(segment);
+        countList.append(count);
+        offset += size;
+        itemCount += count;
+    }
+    if (!ok || offset != segmentData.size() || itemCount != infoCount) {
+        countList.clear();
+        m_errorMessage = QString("Segments of file information are invalid.");
+        return false;
+    }
+
+    GmPackageIndexSegmentUncompressFunctor functor(segmentData.constData(), &m_cipher);
+    segmentList = QtConcurrent::blockingMapped<QList<QByteArray> >(storedSegmentList, functor);
+    for (int i = 0; i < segmentList.size(); i++) {
+        if (segmentList.at(i).isEmpty()) {
+            m_errorMessage = QString("Uncompress file information segment %1 [%2] failure.").arg(i).arg(storedSegmentList.at(i).size);
+            segmentList.clear();
+            countList.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+qint64 GmPackageManager::getIndexCipherPosition(qint64 position, const QByteArray & indexNonce)
+{
+    // nonce is little endian, positions of segments are added to the mixed position
+    quint64 nonce = 0;
+    for (int i = 0; i < indexNonce.size() && i < (int) sizeof (quint64); i++) {
+        nonce |= (quint64) (uchar) indexNonce.at(i) << (8 * i);
+    }
+    return (qint64) ((quint64) position ^ nonce);
+}
+
 bool GmPackageManager::appendPackage(const QString & packageFilename)
 {
     if (m_packageFilename.isEmpty()) return false;
     if (packageFilename.isEmpty()) return false;
     if (m_packageFilename == packageFilename) return false;
-    bool ok = false;
 
-    if (!isValid()) ok = load();
+    // package is loaded by constructor, otherwise load it now
+    bool ok = isValid();
+    if (!ok) ok = load();
     if (!ok) return false;
 
     // append package data into current package
@@ -944,30 +2388,38 @@ bool GmPackageManager::appendPackage(const QString & packageFilename)
     }
 
     GmPackageManager lopmAppend(packageFilename);
+    lopmAppend.setEncryptionKey(m_userKey);
     ok = lopmAppend.load();
-    if (!ok) return false;
+    if (!ok) {
+        m_errorMessage = lopmAppend.getErrorMessage();
+        return false;
+    }
 
-    // package information data of append package
-    const QList<GmPackageFileInfoItem> & lopFileInfoList = lopmAppend.getFileInfoList();
+    // package information data of append package, items are copied from its file index one by one
+    const GmPackageFileIndex & appendFileIndex = lopmAppend.getFileIndex();
 
-    for (int i = 0; i < lopFileInfoList.size(); i++) {
+    for (int i = 0; i < appendFileIndex.size(); i++) {
         // get file information item (filename, position, compressed length, original length) from package file information list
-        const GmPackageFileInfoItem & item = lopFileInfoList.at(i);
-        if (item.deleteFlag) continue;
+        if (appendFileIndex.record(i).deleteFlag) continue;
+        GmPackageFileInfoItem item = appendFileIndex.at(i);
+
+        // file data of appended item is stored in its own data block
+        GmPackageFileInfoItem itemAppend = item;
+        itemAppend.position = itemAppend.compressedDataLength = 0;
+        itemAppend.blockIndex = -1;
+        itemAppend.blockOffset = 0;
+        itemAppend.volume = 0;
 
         // read file data
         if (item.originalDataLength == 0) {
-            GmPackageFileInfoItem itemNull;
-            itemNull.filename = item.filename;
-            ok = appendFileInfo(itemNull);
+            ok = appendFileInfo(itemAppend);
             if (!ok) return false;
         } else {
             char *data = lopmAppend.readDataFile(packageFileAppend, item);
             if (data == NULL) return false;
-            GmPackageFileInfoItem itemAppend;
-            itemAppend.filename = item.filename;
-            ok = writeDataFile(data, packageFile, itemAppend);
+            ok = writeDataFile(data, item.originalDataLength, packageFile, itemAppend);
             delete []data;
+            if (!ok) return false;
             // add file information to package file information list
             ok = appendFileInfo(itemAppend);
             if (!ok) return false;
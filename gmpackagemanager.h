@@ -5,21 +5,69 @@
  *
  * 1. [int], version, start 1
  * 2. [quint8], compress flag, 0: not compress, 1: compress
+ *    version >= 2: [quint8], encryption flag, [char[128]], file identification
+ *    version >= 4: [qint32], compression dictionary length, [char[length]], zlib preset dictionary
+ *    version >= 8: encryption flag 2 is ChaCha20, then [char[16]], key salt, [char[16]], key check
  *
  * 3. [file(1) data block] ... ... [file(n) data block], 'n' number file data block
+ *    version >= 3: a solid data block contains data of many small files,
+ *    all files in the solid block have same data position and block index
+ *    version >= 5: data blocks can be saved in data volume files 'package.001', 'package.002', ...,
+ *    the volume files contain only data blocks, and the package file contains header and information blocks
+ *    version >= 11: a data block with long zero runs is sparse, its compress flag has SparseDataFlag,
+ *    [sparse map], see GmPackageSparseMap, then data of extents, compressed by other bits of compress flag
  *
  * 4. [quint8], compress flag of file information blocks data, 0: not compress, 1: compress
  *    [file(1) info block] ... ... [file(n) info block], 'n' number file index informaion block
  *    struct LoPFileInfoItem, define the block data
+ *    version >= 3: [qint32], solid block index, [qint64], file data offset in solid block
+ *    version >= 5: [qint32], data volume number, 0: package file
+ *    version >= 6: [quint32], CRC32 checksum of stored data block
+ *    version >= 9: file information blocks are front coded, see GmPackageFileIndex,
+ *        [file(1) name] ... [file(n) name], then [file(1) fields] ... [file(n) fields]
+ *        name: [varint], length of prefix shared with previous filename in UTF-16 characters,
+ *        [varint], UTF-8 length of filename suffix, [char[length]], UTF-8 filename suffix,
+ *        [varint], UTF-8 length of symbolic link target plus 1, 0: no target, [char[length - 1]], UTF-8 target
+ *        fields: fields of version 8 information block without filename and symbolic link target
+ *        varint is unsigned LEB128, 7 bits in every byte, the highest bit is set if more bytes follow
+ *    version >= 10: compressed file information blocks are split into segments of at most 65536 items,
+ *        [qint32], segment number, [qint32], item number, [qint32], stored size, ... of every segment,
+ *        then stored segments, every segment is front coded and compressed alone, it is encrypted
+ *        at its own position. not compressed file information blocks are same as version 9
+ *    version >= 12: compressed file information blocks start with [char[8]], random index nonce of the save,
+ *        it is mixed into cipher position of the blocks, so file information saved again at the same position
+ *        is encrypted with other key stream. not compressed file information blocks of ChaCha20 encryption
+ *        start with the nonce too and are encrypted like compressed blocks, otherwise they are same as version 9
+ *    version >= 6: [quint32], CRC32 checksum of stored file information blocks data with its compress flag
+ *    version >= 7: merkle tree manifest, see GmPackageManifest
+ *        [qint32], chunk size, [qint32], data leaf number, [qint32], file information leaf number
+ *        [char[20]] ... [char[20]], SHA-1 hashes of chunks of data blocks, blocks are in the order of
+ *        their first file information item, then hashes of chunks of stored file information data
+ *        [char[20]], root hash of the leaves
+ *        [qint64], manifest size from chunk size to root hash
  *
  * 5. [int], file number
  * 6. [qint64], package file information block's start position in package file
  * 7. [qint64], package file size
+ *
+ * positions are relative to package start, it isn't zero when the package is cated to other file tail
  */
 
+#include "gmpackagecipher.h"
+#include "gmpackagefileindex.h"
+#include "gmpackagesparsemap.h"
+
 #include <QString>
+#include <QStringList>
 #include <QDataStream>
 #include <QFile>
+#include <QFuture>
+#include <QSharedPointer>
+#include <QHash>
+#include <QPair>
+
+class GmPackageFileHandle;
+class GmPackageStatistics;
 
 struct GmPackageFileInfoItem
 {
@@ -29,8 +77,13 @@ struct GmPackageFileInfoItem
         position = compressedDataLength = originalDataLength = 0;
         permissions = QFile::ReadOwner | QFile::WriteOwner | QFile::ExeOwner;
         sort = 0;
+        compressFlag = 0x0;
         deleteFlag = 0x0;
         isSymLink = 0x0;
+        blockIndex = -1;
+        blockOffset = 0;
+        volume = 0;
+        checksum = 0;
     }
 
     void setCompressFlag(bool cf)
@@ -48,18 +101,94 @@ struct GmPackageFileInfoItem
         isSymLink = slf ? 0x01 : 0x0;
     }
 
+    // file data is stored in a solid block with other files
+    bool isSolid() const
+    {
+        return (blockIndex >= 0);
+    }
+
     QString filename;
     qint64 position; // file data start position in package file
     qint64 compressedDataLength; // compressed file data length
     qint64 originalDataLength; // original file data length
     QFile::Permissions permissions; // file original permission
     qint32 sort; // [0..255] the sort of file, the value specified by package builder
-    quint8 compressFlag; // compress flag, 0: not compress, 1: compress
+    quint8 compressFlag; // compress flag, 0: not compress, 1: compress, 2: compress with package dictionary,
+                         // SparseDataFlag is added if data block is sparse
     quint8 deleteFlag; // delete flag, 0: normal state, 1: deleted
     quint8 isSymLink; // symbolic link flag
     QString symLinkTarget; // path to the file or directory a symlink
+    qint32 blockIndex; // solid block index, -1: file data is stored in its own data block
+    qint64 blockOffset; // file data offset in uncompressed solid block
+    qint32 volume; // data volume number, 0: data is in package file, n: data is in volume file 'package.00n'
+    quint32 checksum; // CRC32 of stored data block (compressed and encrypted), same for files of solid block
+};
+
+// result of one file in batched read of file data
+struct GmPackageReadResult
+{
+    GmPackageReadResult()
+    {
+        index = -1;
+        ok = false;
+        streamFlag = false;
+    }
+
+    int index; // index of the file information item in the batch
+    GmPackageFileInfoItem item;
+    QByteArray data; // uncompressed file data
+    GmPackageSparseMap sparseMap; // sparse map of data block of file, it has no extent if block isn't sparse
+    bool ok;
+    // data isn't read, the data block is too large for buffer and is copied to file by copyDataFile
+    bool streamFlag;
+    QString errorMessage;
+};
+
+// coalesced read of adjacent data blocks in a batch
+struct GmPackageReadRun
+{
+    GmPackageReadRun()
+    {
+        volume = 0;
+        position = length = 0;
+    }
+
+    qint32 volume; // data volume of data blocks
+    qint64 position; // start position of data blocks in package file or data volume
+    qint64 length; // read length, zero for the run of files without data
+    QList<int> indexList; // indexes of file information items in the batch, sorted by data position
+};
+
+// batch of file information changes, many files are removed and sorted,
+// then file information of package is updated once
+struct GmPackageFileInfoBatch
+{
+    GmPackageFileInfoBatch()
+    {
+        allSort = -1;
+    }
+
+    void removeFile(const QString & filename)
+    {
+        removeFilenames.append(filename);
+    }
+
+    void setFileSort(const QString & filename, qint32 sort)
+    {
+        sortList.append(QPair<QString, qint32>(filename, sort));
+    }
+
+    bool isEmpty() const
+    {
+        return (allSort < 0 && sortList.isEmpty() && removeFilenames.isEmpty());
+    }
+
+    qint32 allSort; // sort of all files, it is applied first, -1: sort isn't changed
+    QList<QPair<QString, qint32> > sortList; // sort of files, applied in order
+    QStringList removeFilenames; // files to set delete flag, applied last
 };
 
+// input and output file information item in format of version 2
 QDataStream & operator>>(QDataStream &in, GmPackageFileInfoItem &item);
 QDataStream & operator<<(QDataStream &out, const GmPackageFileInfoItem &item);
 
@@ -68,6 +197,7 @@ class GmPackageManager
 public:
     GmPackageManager();
     GmPackageManager(const QString & packageFilename); // only for exists package
+    GmPackageManager(const QString & packageFilename, const QByteArray & userKey); // exists package encrypted by user key
     virtual ~GmPackageManager();
 
 public:
@@ -93,6 +223,70 @@ public:
     bool getCompressFlag() const;
     // set compression level
     bool setCompressionLevel(int compressionLevel = -1);
+    // encryption flag of package data, 0: not encrypted, 1: xor, 2: ChaCha20 (version >= 8)
+    quint8 getEncryption() const;
+    // user key of ChaCha20 encryption, it must be set before package header is written or read,
+    // a package key is derived from it and random salt of package. empty key is xor encryption
+    void setEncryptionKey(const QByteArray & userKey);
+    // cipher of package data, nonce of a data block is its volume and position
+    const GmPackageCipher & getCipher() const;
+    // cipher volume of stored file information data
+    static const quint32 IndexCipherVolume = 0xFFFFFFFF;
+    // size of random nonce saved before compressed file information (version >= 12)
+    static const int IndexNonceSize = 8;
+    // item number of a segment of compressed file information (version >= 10)
+    static const int IndexSegmentSize = 65536;
+    // zlib preset dictionary (version >= 4), it is saved in package header,
+    // so it must be set before the header is written, data is compressed with it if it isn't empty
+    void setDictionary(const QByteArray & dictionary);
+    const QByteArray & getDictionary() const;
+    // compress flag of file data compressed with package dictionary
+    static const quint8 DictionaryCompressFlag = 2;
+    // compress flag bit of sparse data block (version >= 11), only data between holes is stored,
+    // other bits of compress flag are compression of the data
+    static const quint8 SparseDataFlag = 0x04;
+    static const quint8 CompressMethodMask = 0x03;
+
+    // split package (version >= 5), data blocks are output to data volume files of volumeSize,
+    // a new volume is started when data block can't be put into current volume, a data block isn't
+    // split, so volume is larger than volumeSize only when it has one data block larger than volumeSize.
+    // 0 means all data blocks are output to package file
+    void setVolumeSize(qint64 volumeSize);
+    qint64 getVolumeSize() const;
+    // number of data volumes of loaded package, 0 if data are all in package file
+    int getVolumeCount() const;
+    // file name of data volume, volume 0 is package file, others are 'packageFilename.001', ...
+    static QString getVolumeFilename(const QString & packageFilename, int volume);
+
+    // verify checksum of data block when file data is read (version >= 6), default is false,
+    // streaming reads of GmPackageEntryDevice aren't verified
+    void setVerifyFlag(bool verifyFlag = true);
+    bool getVerifyFlag() const;
+    // update CRC32 checksum with data, start checksum is 0
+    static quint32 updateChecksum(quint32 checksum, const char *data, qint64 dataLength);
+    // root hash of merkle tree manifest of loaded or saved package (version >= 7), it is checked
+    // with leaf hashes when package is loaded, compare it with a trusted root to trust the package
+    const QByteArray & getManifestRoot() const;
+    // get manifest leaf hashes of data block of item, empty if the block isn't in manifest
+    QByteArray getDataBlockHashes(const GmPackageFileInfoItem & item) const;
+    // verify stored data block of item by manifest hashes (version >= 7) or by checksum (version 6),
+    // return true for older versions
+    bool verifyStoredData(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const;
+    // data block larger than buffer size is read in chunks, only a not compressed block of one file
+    // can be copied to file, any stored block can be verified
+    static const qint64 MaxBufferSize = 0x7FFFFFFF;
+    static bool canStreamDataFile(const GmPackageFileInfoItem & item);
+    // read not compressed data block of item in chunks, decrypt and write them to opened file, chunks are
+    // verified if verify flag is set. it is reentrant, failure return false and set errorMessage if it isn't NULL
+    bool copyDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item, QFile & file,
+            QString *errorMessage = NULL) const;
+    // verify stored data block of item in chunks, like verifyStoredData without reading all of it
+    bool verifyDataFileStream(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+            QString *errorMessage = NULL) const;
+    // time and bytes of phases are added to statistics if it isn't NULL, default is NULL,
+    // statistics isn't owned by manager, it must be kept while manager is used
+    void setStatistics(GmPackageStatistics *statistics);
+    GmPackageStatistics *getStatistics() const;
 
 public:
     // package file information
@@ -103,11 +297,15 @@ public:
     bool loadFileInfo(QFile & packageFile);
     // save file information data from it's start position
     bool saveFileInfo(QFile & packageFile);
-    // get file information data start position in package file, if null package, return -1
+    // get file information data start position in package file, if null package, return -1,
+    // checksum of file information is verified when it is loaded (version >= 6)
     qint64 getFileInfoStartPosition();
 
-    // get file information list, if not load, list is empty
-    const QList<GmPackageFileInfoItem> & getFileInfoList() const;
+    // get file index of packed file information items, if not load, index is empty
+    const GmPackageFileIndex & getFileIndex() const;
+    // get file information list, if not load, list is empty. the list is copied from file index and isn't kept,
+    // so iterate file index to filter items of a large package without the copy
+    QList<GmPackageFileInfoItem> getFileInfoList() const;
     bool getFileInfoList(int sort, QList<GmPackageFileInfoItem> & fileInfoList) const;
     bool getFileInfoList(const QList<int> & sortList, QList<GmPackageFileInfoItem> & fileInfoList) const;
     static bool getFileInfoList(const QList<GmPackageFileInfoItem> & sourceFileInfoList,
@@ -147,21 +345,29 @@ public:
     // get file information by index or filename, return true if found the specified file information item
     bool getFileInfo(int index, GmPackageFileInfoItem & item);
     bool getFileInfo(const QString & filename, GmPackageFileInfoItem & item);
-    // like upper, but return null pointer if not found
-    GmPackageFileInfoItem * getFileInfo(int index);
-    GmPackageFileInfoItem * getFileInfo(const QString & filename);
 
     // remove data file from package, set delete flag to 0x01
     bool removeDataFile(const QString & filename);
     bool removeDataFile(const QString & filename, QFile & packageFile);
-    static bool removeDataFile(const QString & filename, const QString & packageFilename);
+    // user key is needed if package is encrypted by user key
+    static bool removeDataFile(const QString & filename, const QString & packageFilename,
+                               const QByteArray & userKey = QByteArray());
 
     // set sort of all files in information list
     void setPackageFileSort(int sort);
     // set sort of all files in information list, and update new sort to package file
     bool setPackageFileSort(int sort, QFile & packageFile);
     // set sort of all files in package file directly
-    static bool setPackageFileSort(int sort, const QString & packageFilename);
+    static bool setPackageFileSort(int sort, const QString & packageFilename, const QByteArray & userKey = QByteArray());
+
+    // apply batch of changes to file information list, return false if a file isn't found, then nothing is changed,
+    // indexes of changed items are set to changedIndexList if it isn't NULL
+    bool applyFileInfoBatch(const GmPackageFileInfoBatch & batch, QList<int> *changedIndexList = NULL);
+    // apply batch and update file information of package file once, when stored file information isn't compressed
+    // (version >= 9), changed sort and delete flags are patched in place, otherwise file information is saved again
+    bool applyFileInfoBatch(const GmPackageFileInfoBatch & batch, QFile & packageFile);
+    static bool applyFileInfoBatch(const GmPackageFileInfoBatch & batch, const QString & packageFilename,
+                                   const QByteArray & userKey = QByteArray());
 
 public:
     // package file operation
@@ -176,16 +382,73 @@ public:
     // if m_compressFlag set, compress data then output data block, and set LoPFileInfoItem
     bool writeDataFile(const QByteArray & fba, QFile & packageFile, GmPackageFileInfoItem & item);
     bool writeDataFile(const char *data, qint64 dataLength, QFile & packageFile, GmPackageFileInfoItem & item);
-    // output data block directly from current position
-    bool writeDataBlock(const char *data, qint64 dataLength, QFile & packageFile);
+    // output data block directly from current position, checksum is updated with stored data if it isn't NULL,
+    // manifest hashes of stored data are set to chunkHashes if it isn't NULL
+    bool writeDataBlock(const char *data, qint64 dataLength, QFile & packageFile, quint32 *checksum = NULL,
+            QByteArray *chunkHashes = NULL);
+    // get file to output data block of dataLength, it is packageFile or data volume file in split mode
+    QFile *getDataOutputFile(QFile & packageFile, qint64 dataLength, qint32 & volume);
+    // output solid block of many files data from current position, (version >= 3)
+    // items' block offset and original data length must be set, then data position, block index
+    // and compressed data length of items are set, and the items are appended to file information list
+    bool writeSolidBlock(const QByteArray & blockData, QFile & packageFile, QList<GmPackageFileInfoItem> & itemList);
 
     // input file data by LoPFileInfoItem information from file current position
     char *readDataFile(QFile & packageFile, const GmPackageFileInfoItem & item);
     // input file data by filename from package
     char *readDataFile(QFile & packageFile, const QString & filename, qint64 & fileSize);
-    // input data block derectly from file current position
-    bool readDataBlock(char *data, qint64 dataLength, QFile & packageFile);
-    // get file data block's start position in package file,
+    // input data block derectly from package file current position, checksum is updated with stored data if it isn't NULL
+    bool readDataBlock(char *data, qint64 dataLength, QFile & packageFile, quint32 *checksum = NULL);
+    // reentrant input of file data by positional read from package file handle, the functions
+    // can be called from many threads at the same time, because manager state isn't changed,
+    // failure return false and set errorMessage if it isn't NULL
+    bool readDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+            QByteArray & data, QString *errorMessage = NULL) const;
+    bool readDataBlock(char *data, qint64 dataLength, qint64 position,
+            GmPackageFileHandle & packageHandle, QString *errorMessage = NULL) const;
+    // input uncompressed data block of file, for solid block it contains data of many files
+    bool readFileDataBlock(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item,
+            QByteArray & blockData, QString *errorMessage = NULL) const;
+    // decrypt stored data block (changed in place) and uncompress it to file data
+    bool decodeDataFile(const GmPackageFileInfoItem & item, QByteArray & storedData,
+            QByteArray & data, QString *errorMessage = NULL) const;
+    // decrypt stored data block (changed in place) and uncompress it to data block
+    bool decodeDataBlock(const GmPackageFileInfoItem & item, QByteArray & storedData,
+            QByteArray & blockData, QString *errorMessage = NULL) const;
+    // uncompress data block by compress flag of item, sparse data block is expanded, failure return empty data
+    QByteArray uncompressDataBlock(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const;
+    // get file data from uncompressed data block, return false if block length doesn't match
+    static bool getFileDataFromBlock(const GmPackageFileInfoItem & item, const QByteArray & blockData, QByteArray & data);
+
+    // batched input of file data, the items are sorted by data position and adjacent data blocks
+    // are coalesced into large positional reads, then the blocks are read and uncompressed
+    // by the global thread pool. results are sorted by index of item in the batch.
+    bool readDataFiles(GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & fileInfoList,
+            QList<GmPackageReadResult> & resultList) const;
+    // sort items of a batch by data position and coalesce adjacent data blocks into runs,
+    // runs of different data volumes are interleaved, so parallel reads are spread on volumes,
+    // the items without data are put into the last run with zero length
+    QList<GmPackageReadRun> getReadRunList(const QList<GmPackageFileInfoItem> & fileInfoList) const;
+    // verify checksums of all data blocks by parallel coalesced reads without uncompress (version >= 6),
+    // return false and append messages of wrong blocks to errorMessageList
+    bool verifyDataFiles(GmPackageFileHandle & packageHandle, QStringList & errorMessageList) const;
+    // like upper, but only data blocks of the files are read and verified
+    bool verifyDataFiles(GmPackageFileHandle & packageHandle, const QList<GmPackageFileInfoItem> & fileInfoList,
+            QStringList & errorMessageList) const;
+    // verify checksums of data blocks in one run, return messages of wrong blocks
+    QStringList verifyDataRun(GmPackageFileHandle & packageHandle, const GmPackageReadRun & run,
+            const QList<GmPackageFileInfoItem> & fileInfoList) const;
+    // read data runs in parallel by the global thread pool, result lists are in the order of runs
+    bool readDataRuns(GmPackageFileHandle & packageHandle, const QList<GmPackageReadRun> & runList,
+            const QList<GmPackageFileInfoItem> & fileInfoList, QList<QList<GmPackageReadResult> > & runResultList) const;
+    // read data blocks of one run and uncompress them, results are in the order of run index list
+    bool readDataRun(GmPackageFileHandle & packageHandle, const GmPackageReadRun & run,
+            const QList<GmPackageFileInfoItem> & fileInfoList, QList<GmPackageReadResult> & resultList) const;
+    // asynchronous batched input, every result of the future is the result list of one coalesced read,
+    // the manager must be kept until the future is finished
+    QFuture<QList<GmPackageReadResult> > readDataFilesAsync(const QSharedPointer<GmPackageFileHandle> & packageHandle,
+            const QList<GmPackageFileInfoItem> & fileInfoList) const;
+    // get file data block's start position in package file or in data volume of item,
     // if the package append another file's tail, the start position add offset of header file's length
     qint64 getFileDataStartPosition(const GmPackageFileInfoItem & item) const;
 
@@ -201,6 +464,32 @@ public:
 
 private:
     void init();
+    // indexes of items with distinct data blocks, the first item of every data block
+    static QList<int> getDataBlockIndexList(const QList<GmPackageFileInfoItem> & fileInfoList);
+    static QList<int> getDataBlockIndexList(const GmPackageFileIndex & fileIndex);
+    // stored file information of package file has fixed size fields of loaded items, they can be patched
+    bool canPatchFileInfo() const;
+    // not compressed file information is encrypted by ChaCha20 (version >= 12)
+    bool isPlainFileInfoEncrypted() const;
+    // write sort and delete flag of items to stored file information in one write, update checksum and manifest
+    bool patchFileInfo(QFile & packageFile, const QList<int> & indexList);
+    // segments of compressed file information (version >= 10), they are compressed and uncompressed by the global
+    // thread pool, position is the cipher position of segment data, return false if a segment fails
+    bool compressFileInfoSegments(QByteArray & segmentData, qint64 position) const;
+    bool uncompressFileInfoSegments(const QByteArray & segmentData, qint64 position, int infoCount,
+            QList<QByteArray> & segmentList, QList<int> & countList);
+    // cipher position of compressed file information from its position and index nonce (version >= 12)
+    static qint64 getIndexCipherPosition(qint64 position, const QByteArray & indexNonce);
+    // read stored data block of item in chunks aligned to manifest chunks, they are hashed if verifyFlag is set,
+    // then decrypted and written to file if it isn't NULL
+    bool streamDataFile(GmPackageFileHandle & packageHandle, const GmPackageFileInfoItem & item, QFile *file,
+            bool verifyFlag, QString *errorMessage) const;
+    // uncompress sparse data block (version >= 11), data of extents is put between zero filled holes
+    QByteArray uncompressSparseDataBlock(const GmPackageFileInfoItem & item, const char *data, qint64 dataLength) const;
+    // output and input merkle tree manifest, stored file information data is the last leaves
+    bool writeManifest(QDataStream & out, const QByteArray & storedInfoData);
+    bool readManifest(QFile & packageFile, qint64 manifestEndPosition, qint64 & manifestStartPosition,
+            QByteArray & dataHashes, QByteArray & indexHashes);
 
 private:
     // package filename
@@ -211,9 +500,33 @@ private:
     quint8 m_compressFlag; // package data compress flag, 1: compress format, 0: not compressed
     quint8 m_encryption; // encryption flag
     char m_fileIdentification[128];
+    QByteArray m_dictionary; // zlib preset dictionary
+    QByteArray m_userKey; // user key of ChaCha20 encryption
+    QByteArray m_keySalt; // salt of package key
+    GmPackageCipher m_cipher; // cipher of encryption flag with package key
 
     // package data file start position, default is 0, when cated some file tail, the value set to header file size
     int m_packageFileStartPosition;
+    // end position of file data blocks in package file, file information blocks are saved from here
+    qint64 m_fileDataEndPosition;
+    // solid block number, index of next solid block
+    qint32 m_solidBlockCount;
+
+    // data volumes, size limit of volume, number of volumes, and current output volume file
+    qint64 m_volumeSize;
+    qint32 m_volumeCount;
+    QSharedPointer<QFile> m_volumeFile;
+
+    // verify checksum of data block when it is read
+    bool m_verifyFlag;
+
+    // merkle tree manifest, chunk size, leaf hashes of data blocks by (volume, position) and root hash
+    qint32 m_manifestChunkSize;
+    QHash<QPair<qint32, qint64>, QByteArray> m_blockHashHash;
+    QByteArray m_manifestRoot;
+
+    // phase counters of package operations
+    GmPackageStatistics *m_statistics;
 
     // Valid values are between 0 and 9, with 9 corresponding to the greatest compression
     // (i.e. smaller compressed data) at the cost of using a slower algorithm.
@@ -222,8 +535,12 @@ private:
     // The default value is -1, which specifies zlib's default compression.
     int m_compressionLevel;
 
-    // package file information list
-    QList<GmPackageFileInfoItem> m_fileInfoList;
+    // package file information, packed items and names arena
+    GmPackageFileIndex m_fileIndex;
+    // stored file information in package file, item count, size and compress flag, when it is loaded or saved
+    int m_storedInfoCount;
+    qint64 m_storedInfoDataSize;
+    quint8 m_storedInfoCompressFlag;
 
     QString m_errorMessage;
 
@@ -0,0 +1,98 @@
+#include "gmpackagemanifest.h"
+
+#include <QList>
+#include <QCryptographicHash>
+#include <QtConcurrentMap>
+
+const int GmPackageManifest::HashSize;
+const int GmPackageManifest::DefaultChunkSize;
+
+// hash prefix of leaves and nodes, a leaf hash can't be taken as a node hash
+static const char LeafHashPrefix = 0x00;
+static const char NodeHashPrefix = 0x01;
+// data of more chunks is hashed in parallel
+static const int ParallelChunkCount = 4;
+
+// chunk of data hashed in thread pool
+struct GmManifestChunk
+{
+    const char *data;
+    int length;
+};
+
+class GmManifestChunkHashFunctor
+{
+public:
+    typedef QByteArray result_type;
+
+    QByteArray operator()(const GmManifestChunk & chunk) const
+    {
+        return GmPackageManifest::getLeafHash(chunk.data, chunk.length);
+    }
+};
+
+int GmPackageManifest::getChunkCount(qint64 dataLength, int chunkSize)
+{
+    if (dataLength <= 0 || chunkSize <= 0) return 0;
+    return (int) ((dataLength + chunkSize - 1) / chunkSize);
+}
+
+QByteArray GmPackageManifest::getLeafHash(const char *data, int dataLength)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&LeafHashPrefix, 1);
+    hash.addData(data, dataLength);
+    return hash.result();
+}
+
+QByteArray GmPackageManifest::getChunkHashes(const char *data, qint64 dataLength, int chunkSize)
+{
+    QByteArray hashes;
+    int chunkCount = getChunkCount(dataLength, chunkSize);
+    if (data == NULL || chunkCount == 0) return hashes;
+
+    QList<GmManifestChunk> chunkList;
+    for (qint64 offset = 0; offset < dataLength; offset += chunkSize) {
+        GmManifestChunk chunk;
+        chunk.data = data + offset;
+        chunk.length = (int) qMin((qint64) chunkSize, dataLength - offset);
+        chunkList.append(chunk);
+    }
+
+    hashes.reserve(chunkCount * HashSize);
+    if (chunkCount < ParallelChunkCount) {
+        for (int i = 0; i < chunkList.size(); i++) {
+            hashes.append(getLeafHash(chunkList.at(i).data, chunkList.at(i).length));
+        }
+    } else {
+        QList<QByteArray> hashList = QtConcurrent::blockingMapped<QList<QByteArray> >(chunkList, GmManifestChunkHashFunctor());
+        for (int i = 0; i < hashList.size(); i++) hashes.append(hashList.at(i));
+    }
+    return hashes;
+}
+
+QByteArray GmPackageManifest::getRootHash(const QByteArray & leafHashes)
+{
+    QByteArray level = leafHashes;
+    int count = level.size() / HashSize;
+    if (count == 0) return QByteArray();
+
+    while (count > 1) {
+        QByteArray upperLevel;
+        upperLevel.reserve(((count + 1) / 2) * HashSize);
+        for (int i = 0; i < count; i += 2) {
+            const char *left = level.constData() + i * HashSize;
+            if (i + 1 == count) {
+                upperLevel.append(left, HashSize);
+                continue;
+            }
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            hash.addData(&NodeHashPrefix, 1);
+            hash.addData(left, HashSize * 2);
+            upperLevel.append(hash.result());
+        }
+        level = upperLevel;
+        count = level.size() / HashSize;
+    }
+    return level;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QByteArray>
+
+// merkle tree manifest of package (version >= 7),
+// stored data blocks and stored file information are split into chunks of fixed size, the leaves of
+// the tree are SHA-1 hashes of the chunks, so a range of data is verified by hashing only its chunks.
+// leaf and node hashes have different prefix bytes, a node with one child is moved to upper level.
+// leaf hashes are concatenated in a byte array, every hash has HashSize bytes.
+class GmPackageManifest
+{
+public:
+    static const int HashSize = 20;
+    static const int DefaultChunkSize = 256 * 1024;
+
+    // get leaf hashes of data chunks, chunks of large data are hashed in parallel by global thread pool
+    static QByteArray getChunkHashes(const char *data, qint64 dataLength, int chunkSize);
+    // get number of chunks of data
+    static int getChunkCount(qint64 dataLength, int chunkSize);
+    // get root hash of leaf hashes, empty for no leaves
+    static QByteArray getRootHash(const QByteArray & leafHashes);
+    // get hash of one leaf chunk
+    static QByteArray getLeafHash(const char *data, int dataLength);
+};
@@ -0,0 +1,116 @@
+#include "gmpackageprogress.h"
+
+const int GmPackageProgress::DefaultInterval;
+
+// JSON string of file name, quote, backslash and control characters are escaped
+static QString toJsonString(const QString & str)
+{
+    QString result("\"");
+    for (int i = 0; i < str.size(); i++) {
+        QChar ch = str.at(i);
+        if (ch == QChar('"') || ch == QChar('\\')) {
+            result += QChar('\\');
+            result += ch;
+        } else if (ch.unicode() < 0x20) {
+            result += QString("\\u%1").arg((int) ch.unicode(), 4, 16, QChar('0'));
+        } else {
+            result += ch;
+        }
+    }
+    result += QChar('"');
+    return result;
+}
+
+int GmPackageProgressInfo::getPercent() const
+{
+    if (bytesTotal > 0) return (int) qMin((qint64) 100, bytesDone * 100 / bytesTotal);
+    if (fileNumber > 0) return (int) (1.0 * (fileIndex + 1) / fileNumber * 100);
+    return -1;
+}
+
+QString GmPackageProgressInfo::toJson() const
+{
+    // file name is appended, not by arg(), because it may contain place markers
+    QString json("{\"file\":");
+    json += toJsonString(filename);
+    json += QString(",\"index\":%1,\"files\":%2,\"bytes\":%3,\"bytes_total\":%4")
+            .arg(fileIndex).arg(fileNumber).arg(bytesDone).arg(bytesTotal);
+    json += QString(",\"seconds\":%1,\"mb_per_s\":%2,\"eta\":%3,\"finished\":%4}")
+            .arg(QString::number(seconds, 'f', 3)).arg(QString::number(bytesPerSecond / (1024.0 * 1024.0), 'f', 2))
+            .arg(QString::number(etaSeconds, 'f', 1)).arg(finished ? "true" : "false");
+    return json;
+}
+
+GmPackageProgress::GmPackageProgress()
+{
+    m_interval = DefaultInterval;
+    m_reportMsecs = 0;
+}
+
+void GmPackageProgress::setInterval(int msecs)
+{
+    m_interval = qMax(0, msecs);
+}
+
+int GmPackageProgress::getInterval() const
+{
+    return m_interval;
+}
+
+void GmPackageProgress::start(int fileNumber, qint64 bytesTotal)
+{
+    m_info = GmPackageProgressInfo();
+    m_info.fileNumber = fileNumber;
+    m_info.bytesTotal = bytesTotal;
+    m_timer.start();
+    m_reportMsecs = -1;
+}
+
+void GmPackageProgress::addBytes(qint64 bytes)
+{
+    m_info.bytesDone += bytes;
+}
+
+bool GmPackageProgress::update(const QString & filename, int fileIndex)
+{
+    m_info.filename = filename;
+    m_info.fileIndex = fileIndex;
+
+    // elapsed time is read for every file, it is much cheaper than output
+    qint64 msecs = m_timer.elapsed();
+    bool due = (m_reportMsecs < 0 || msecs - m_reportMsecs >= m_interval || fileIndex == m_info.fileNumber - 1);
+    if (!due) return false;
+
+    m_reportMsecs = msecs;
+    updateRate();
+    return true;
+}
+
+void GmPackageProgress::finish()
+{
+    m_info.finished = true;
+    if (m_info.fileNumber < 0) m_info.fileNumber = m_info.fileIndex + 1;
+    if (m_info.bytesTotal < 0) m_info.bytesTotal = m_info.bytesDone;
+    updateRate();
+}
+
+const GmPackageProgressInfo & GmPackageProgress::getInfo() const
+{
+    return m_info;
+}
+
+void GmPackageProgress::updateRate()
+{
+    m_info.seconds = m_timer.nsecsElapsed() / 1e9;
+    m_info.bytesPerSecond = (m_info.seconds > 0) ? m_info.bytesDone / m_info.seconds : 0;
+
+    // remaining time by bytes throughput, or by file rate if bytes total is unknown
+    m_info.etaSeconds = -1;
+    if (m_info.finished) {
+        m_info.etaSeconds = 0;
+    } else if (m_info.bytesTotal >= 0 && m_info.bytesPerSecond > 0) {
+        m_info.etaSeconds = qMax((qint64) 0, m_info.bytesTotal - m_info.bytesDone) / m_info.bytesPerSecond;
+    } else if (m_info.fileNumber > 0 && m_info.fileIndex >= 0 && m_info.seconds > 0) {
+        m_info.etaSeconds = (m_info.fileNumber - m_info.fileIndex - 1) * m_info.seconds / (m_info.fileIndex + 1);
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <QString>
+#include <QMetaType>
+#include <QElapsedTimer>
+
+// progress of package build or install, payload of progress signal and JSON line
+struct GmPackageProgressInfo
+{
+    GmPackageProgressInfo()
+    {
+        fileIndex = -1;
+        fileNumber = -1;
+        bytesDone = 0;
+        bytesTotal = -1;
+        seconds = 0;
+        bytesPerSecond = 0;
+        etaSeconds = -1;
+        finished = false;
+    }
+
+    // percent value from 0 to 100 by bytes, or by files if bytes total is unknown, -1 if both are unknown
+    int getPercent() const;
+    // one JSON object, for example
+    // {"file":"a/b.txt","index":9,"files":100,"bytes":4096,"bytes_total":40960,"seconds":0.5,"mb_per_s":0.01,"eta":4.5,"finished":false}
+    QString toJson() const;
+
+    QString filename; // last done file
+    int fileIndex; // index of last done file, from 0 to n-1
+    int fileNumber; // file number, -1 if it is unknown
+    qint64 bytesDone; // bytes of done files
+    qint64 bytesTotal; // bytes of all files, -1 if it is unknown
+    double seconds; // elapsed seconds from start
+    double bytesPerSecond; // average throughput from start
+    double etaSeconds; // estimated remaining seconds, -1 if it is unknown
+    bool finished; // the last report of build or install
+};
+
+Q_DECLARE_METATYPE(GmPackageProgressInfo)
+
+// rate limited progress, files are counted one by one, but a report is due at most once every interval,
+// so console output and signals aren't per file when there are millions of small files
+class GmPackageProgress
+{
+public:
+    static const int DefaultInterval = 100; // milliseconds
+
+    GmPackageProgress();
+
+    // 0 means every file is reported
+    void setInterval(int msecs);
+    int getInterval() const;
+
+    // start progress of fileNumber files of bytesTotal bytes, -1 if it is unknown
+    void start(int fileNumber = -1, qint64 bytesTotal = -1);
+    // add bytes of current file
+    void addBytes(qint64 bytes);
+    // file of index is done, return true if a report is due, the first and last files are always due
+    bool update(const QString & filename, int fileIndex);
+    // progress is finished, the finished report is always due
+    void finish();
+
+    // progress information, throughput and ETA are updated when a report is due
+    const GmPackageProgressInfo & getInfo() const;
+
+private:
+    void updateRate();
+
+private:
+    int m_interval;
+    QElapsedTimer m_timer;
+    qint64 m_reportMsecs; // time of last report
+    GmPackageProgressInfo m_info;
+};
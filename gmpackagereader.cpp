@@ -0,0 +1,233 @@
+#include "gmpackagereader.h"
+#include "gmpackageentrydevice.h"
+
+#include <QMutexLocker>
+
+#include <string.h>
+
+const qint64 GmPackageReader::DefaultCacheSize;
+
+// cache cost unit, QCache cost is int, so the cost is counted by KiB
+static const qint64 CacheCostUnit = 1024;
+
+GmPackageReader::GmPackageReader()
+{
+    setCacheSize(DefaultCacheSize);
+}
+
+GmPackageReader::GmPackageReader(const QString & packageFilename, qint64 cacheSize)
+{
+    setCacheSize(cacheSize);
+    open(packageFilename);
+}
+
+GmPackageReader::~GmPackageReader()
+{
+    close();
+}
+
+void GmPackageReader::setEncryptionKey(const QByteArray & userKey)
+{
+    m_encryptionKey = userKey;
+}
+
+bool GmPackageReader::open(const QString & packageFilename)
+{
+    close();
+    m_packageFilename = packageFilename;
+    if (m_packageFilename.isEmpty()) {
+        m_errorMessage = QString("Package file name is empty.");
+        return false;
+    }
+
+    // load package information
+    m_lopm.setEncryptionKey(m_encryptionKey);
+    bool ok = m_lopm.load(m_packageFilename);
+    if (!ok || !m_lopm.isValid()) {
+        m_errorMessage = QString("Loads package file %1 failure.").arg(m_packageFilename);
+        return false;
+    }
+
+    // open package file
+    QSharedPointer<GmPackageFileHandle> packageHandle(new GmPackageFileHandle(m_packageFilename));
+    if (!packageHandle->isOpen()) {
+        m_errorMessage = QString("Opens package file %1 failure.").arg(m_packageFilename);
+        return false;
+    }
+    m_packageHandle = packageHandle;
+
+    return true;
+}
+
+void GmPackageReader::close()
+{
+    m_packageHandle.clear();
+    clearCache();
+}
+
+bool GmPackageReader::isOpen() const
+{
+    return (!m_packageHandle.isNull());
+}
+
+const QString & GmPackageReader::getPackageFilename() const
+{
+    return m_packageFilename;
+}
+
+const QString & GmPackageReader::getErrorMessage() const
+{
+    return m_errorMessage;
+}
+
+const GmPackageManager & GmPackageReader::getPackageManager() const
+{
+    return m_lopm;
+}
+
+void GmPackageReader::setCacheSize(qint64 cacheSize)
+{
+    QMutexLocker locker(&m_cacheMutex);
+    if (cacheSize < 0) cacheSize = 0;
+    m_cacheSize = cacheSize;
+    qint64 maxCost = qMin(m_cacheSize / CacheCostUnit, (qint64) 0x7FFFFFFF);
+    m_dataCache.setMaxCost((int) maxCost);
+}
+
+qint64 GmPackageReader::getCacheSize() const
+{
+    return m_cacheSize;
+}
+
+void GmPackageReader::clearCache()
+{
+    QMutexLocker locker(&m_cacheMutex);
+    m_dataCache.clear();
+}
+
+bool GmPackageReader::fileExists(const QString & filename) const
+{
+    return (indexOf(filename) >= 0);
+}
+
+bool GmPackageReader::getFileInfo(const QString & filename, GmPackageFileInfoItem & item) const
+{
+    int index = indexOf(filename);
+    if (index < 0) return false;
+    item = m_lopm.getFileIndex().at(index);
+    return true;
+}
+
+bool GmPackageReader::getFileData(const QString & filename, QByteArray & data, QString *errorMessage)
+{
+    int index = indexOf(filename);
+    if (index < 0) {
+        setErrorMessage(errorMessage, QString("File %1 not exists.").arg(filename));
+        return false;
+    }
+    GmPackageFileInfoItem item = m_lopm.getFileIndex().at(index);
+    return getFileData(item, data, errorMessage);
+}
+
+bool GmPackageReader::getFileData(const GmPackageFileInfoItem & item, QByteArray & data, QString *errorMessage)
+{
+    data.clear();
+    if (!isOpen()) {
+        setErrorMessage(errorMessage, QString("Package file is not opened."));
+        return false;
+    }
+    if (item.originalDataLength == 0) return true;
+
+    QPair<qint32, qint64> cacheKey(item.volume, m_lopm.getFileDataStartPosition(item));
+
+    // fetch from cache, files of one solid block share the cached block
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        QByteArray *cacheData = m_dataCache.object(cacheKey);
+        if (cacheData) {
+            bool ok = GmPackageManager::getFileDataFromBlock(item, *cacheData, data);
+            if (!ok) setErrorMessage(errorMessage, QString("Data block of file %1 is invalid.").arg(item.filename));
+            return ok;
+        }
+    }
+
+    QByteArray blockData;
+    bool ok = m_lopm.readFileDataBlock(*m_packageHandle, item, blockData, errorMessage);
+    if (!ok) return false;
+    ok = GmPackageManager::getFileDataFromBlock(item, blockData, data);
+    if (!ok) {
+        setErrorMessage(errorMessage, QString("Data block of file %1 is invalid.").arg(item.filename));
+        return false;
+    }
+
+    // insert into cache, data larger than budget is not cached
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        int cost = (int) qMin((blockData.size() + CacheCostUnit - 1) / CacheCostUnit, (qint64) 0x7FFFFFFF);
+        if (cost <= m_dataCache.maxCost()) {
+            m_dataCache.insert(cacheKey, new QByteArray(blockData), cost);
+        }
+    }
+
+    return true;
+}
+
+char *GmPackageReader::getFileData(const QString & filename, qint64 & fileSize, QString *errorMessage)
+{
+    QByteArray data;
+    bool ok = getFileData(filename, data, errorMessage);
+    if (!ok || data.isEmpty()) return NULL;
+
+    char *fileData = new char[data.size()];
+    if (fileData == NULL) return NULL;
+    memcpy(fileData, data.constData(), data.size());
+    fileSize = data.size();
+    return fileData;
+}
+
+bool GmPackageReader::getFileData(const QStringList & filenames, QList<GmPackageReadResult> & resultList) const
+{
+    resultList.clear();
+    if (!isOpen()) return false;
+
+    QList<GmPackageFileInfoItem> fileInfoList;
+    getFileInfoList(filenames, fileInfoList);
+    bool ok = m_lopm.readDataFiles(*m_packageHandle, fileInfoList, resultList);
+    return ok;
+}
+
+QFuture<QList<GmPackageReadResult> > GmPackageReader::getFileDataAsync(const QStringList & filenames) const
+{
+    QList<GmPackageFileInfoItem> fileInfoList;
+    if (isOpen()) getFileInfoList(filenames, fileInfoList);
+    return m_lopm.readDataFilesAsync(m_packageHandle, fileInfoList);
+}
+
+GmPackageEntryDevice *GmPackageReader::createDevice(const QString & filename, QObject *parent) const
+{
+    GmPackageFileInfoItem item;
+    bool ok = getFileInfo(filename, item);
+    if (!ok) return NULL;
+    return new GmPackageEntryDevice(m_packageHandle, m_lopm, item, parent);
+}
+
+void GmPackageReader::getFileInfoList(const QStringList & filenames, QList<GmPackageFileInfoItem> & fileInfoList) const
+{
+    fileInfoList.clear();
+    for (int i = 0; i < filenames.size(); i++) {
+        int index = indexOf(filenames.at(i));
+        if (index >= 0) fileInfoList.append(m_lopm.getFileIndex().at(index));
+    }
+}
+
+int GmPackageReader::indexOf(const QString & filename) const
+{
+    // lookup table of file index is read only after package is loaded, so it is reentrant
+    if (!isOpen()) return -1;
+    return m_lopm.getFileIndex().indexOf(filename);
+}
+
+void GmPackageReader::setErrorMessage(QString *errorMessage, const QString & message) const
+{
+    if (errorMessage) *errorMessage = message;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "gmpackagemanager.h"
+#include "gmpackagefilehandle.h"
+
+#include <QHash>
+#include <QCache>
+#include <QMutex>
+#include <QByteArray>
+#include <QPair>
+#include <QSharedPointer>
+
+class GmPackageEntryDevice;
+
+// long-lived reader of one package,
+// the package information list is loaded and the package file is opened only once,
+// recently uncompressed data blocks are kept in a LRU cache limited by bytes.
+// all public functions are thread-safe after the package is opened,
+// file data are read by positional read without lock, only the cache is locked.
+class GmPackageReader
+{
+public:
+    GmPackageReader();
+    GmPackageReader(const QString & packageFilename, qint64 cacheSize = DefaultCacheSize);
+    virtual ~GmPackageReader();
+
+public:
+    // default byte budget of uncompressed data cache
+    static const qint64 DefaultCacheSize = 64 * 1024 * 1024;
+
+    // user key of package encrypted by ChaCha20, it must be set before package is opened
+    void setEncryptionKey(const QByteArray & userKey);
+
+    // open package, load package information and open package file
+    bool open(const QString & packageFilename);
+    void close();
+    bool isOpen() const;
+    const QString & getPackageFilename() const;
+    const QString & getErrorMessage() const;
+
+    // package manager holding the loaded package information
+    const GmPackageManager & getPackageManager() const;
+
+    // byte budget of uncompressed data cache, 0 disables the cache
+    void setCacheSize(qint64 cacheSize);
+    qint64 getCacheSize() const;
+    void clearCache();
+
+public:
+    bool fileExists(const QString & filename) const;
+    bool getFileInfo(const QString & filename, GmPackageFileInfoItem & item) const;
+
+    // get file data by filename, data is taken from cache if read recently
+    bool getFileData(const QString & filename, QByteArray & data, QString *errorMessage = NULL);
+    bool getFileData(const GmPackageFileInfoItem & item, QByteArray & data, QString *errorMessage = NULL);
+    // like GmPackageInstaller::getFileData, failure return NULL, the buffer is released by delete []
+    char *getFileData(const QString & filename, qint64 & fileSize, QString *errorMessage = NULL);
+
+    // batched read of file data, reads are coalesced and uncompressed in thread pool,
+    //   the data cache isn't used, files not found are ignored, see GmPackageManager::readDataFiles
+    bool getFileData(const QStringList & filenames, QList<GmPackageReadResult> & resultList) const;
+    QFuture<QList<GmPackageReadResult> > getFileDataAsync(const QStringList & filenames) const;
+
+    // create device to read file data by stream, the device shares package file of reader
+    GmPackageEntryDevice *createDevice(const QString & filename, QObject *parent = 0) const;
+
+private:
+    void getFileInfoList(const QStringList & filenames, QList<GmPackageFileInfoItem> & fileInfoList) const;
+    // index of file information item which isn't deleted, -1 if it isn't found or package isn't opened
+    int indexOf(const QString & filename) const;
+    void setErrorMessage(QString *errorMessage, const QString & message) const;
+
+private:
+    QString m_packageFilename;
+    QString m_errorMessage;
+    QByteArray m_encryptionKey;
+
+    // package information, file index of it has lookup table by filename
+    GmPackageManager m_lopm;
+
+    QSharedPointer<GmPackageFileHandle> m_packageHandle;
+
+    // uncompressed data block cache, key is data volume and data start position, cost is KiB
+    QCache<QPair<qint32, qint64>, QByteArray> m_dataCache;
+    qint64 m_cacheSize;
+    QMutex m_cacheMutex;
+};
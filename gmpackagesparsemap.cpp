@@ -0,0 +1,181 @@
+#include "gmpackagesparsemap.h"
+
+#include <QtEndian>
+#include <string.h>
+
+const qint64 GmPackageSparseMap::BlockSize;
+const qint64 GmPackageSparseMap::MinHoleSize;
+const int GmPackageSparseMap::HeaderSize;
+const int GmPackageSparseMap::ExtentRecordSize;
+
+// all bytes of data are zero, every byte is compared with the next one
+static bool isZeroData(const char *data, qint64 dataLength)
+{
+    if (dataLength <= 0) return true;
+    if (data[0] != 0) return false;
+    return (memcmp(data, data + 1, (size_t) (dataLength - 1)) == 0);
+}
+
+GmPackageSparseMap::GmPackageSparseMap()
+{
+    m_originalDataLength = 0;
+}
+
+GmPackageSparseMap GmPackageSparseMap::fromData(const char *data, qint64 dataLength)
+{
+    GmPackageSparseMap sparseMap;
+    if (data == NULL || dataLength <= 0) return sparseMap;
+    sparseMap.m_originalDataLength = dataLength;
+
+    // zero blocks are collected into holes, the last block can be shorter
+    qint64 extentStart = 0;
+    qint64 holeStart = -1;
+    for (qint64 blockStart = 0; blockStart < dataLength; blockStart += BlockSize) {
+        qint64 blockLength = qMin(BlockSize, dataLength - blockStart);
+        if (isZeroData(data + blockStart, blockLength)) {
+            if (holeStart < 0) holeStart = blockStart;
+            continue;
+        }
+        if (holeStart >= 0 && blockStart - holeStart >= MinHoleSize) {
+            if (holeStart > extentStart) sparseMap.appendExtent(extentStart, holeStart - extentStart);
+            extentStart = blockStart;
+        }
+        holeStart = -1;
+    }
+    if (holeStart >= 0 && dataLength - holeStart >= MinHoleSize) {
+        if (holeStart > extentStart) sparseMap.appendExtent(extentStart, holeStart - extentStart);
+    } else {
+        sparseMap.appendExtent(extentStart, dataLength - extentStart);
+    }
+    return sparseMap;
+}
+
+qint64 GmPackageSparseMap::getSerializedSize(const char *header)
+{
+    qint32 extentCount = qFromLittleEndian<qint32>((const uchar *) header + 8);
+    if (extentCount < 0) return -1;
+    return HeaderSize + (qint64) extentCount * ExtentRecordSize;
+}
+
+bool GmPackageSparseMap::read(const char *data, qint64 dataLength)
+{
+    m_originalDataLength = 0;
+    m_extentList.clear();
+    if (data == NULL || dataLength < HeaderSize) return false;
+    qint64 serializedSize = getSerializedSize(data);
+    if (serializedSize < 0 || serializedSize > dataLength) return false;
+
+    qint64 originalDataLength = qFromLittleEndian<qint64>((const uchar *) data);
+    if (originalDataLength < 0) return false;
+    int extentCount = (int) ((serializedSize - HeaderSize) / ExtentRecordSize);
+    const uchar *record = (const uchar *) data + HeaderSize;
+    qint64 endOffset = 0;
+    for (int i = 0; i < extentCount; i++, record += ExtentRecordSize) {
+        qint64 offset = qFromLittleEndian<qint64>(record);
+        qint64 length = qFromLittleEndian<qint64>(record + 8);
+        if (offset < endOffset || length <= 0 || length > originalDataLength - offset) {
+            m_extentList.clear();
+            return false;
+        }
+        appendExtent(offset, length);
+        endOffset = offset + length;
+    }
+    m_originalDataLength = originalDataLength;
+    return true;
+}
+
+QByteArray GmPackageSparseMap::toByteArray() const
+{
+    QByteArray data((int) getSerializedSize(), '\0');
+    uchar *record = (uchar *) data.data();
+    qToLittleEndian<qint64>(m_originalDataLength, record);
+    qToLittleEndian<qint32>(m_extentList.size(), record + 8);
+    record += HeaderSize;
+    for (int i = 0; i < m_extentList.size(); i++, record += ExtentRecordSize) {
+        qToLittleEndian<qint64>(m_extentList.at(i).offset, record);
+        qToLittleEndian<qint64>(m_extentList.at(i).length, record + 8);
+    }
+    return data;
+}
+
+qint64 GmPackageSparseMap::getSerializedSize() const
+{
+    return HeaderSize + (qint64) m_extentList.size() * ExtentRecordSize;
+}
+
+bool GmPackageSparseMap::hasHole() const
+{
+    return (getExtentDataLength() < m_originalDataLength);
+}
+
+qint64 GmPackageSparseMap::getOriginalDataLength() const
+{
+    return m_originalDataLength;
+}
+
+qint64 GmPackageSparseMap::getExtentDataLength() const
+{
+    if (m_extentList.isEmpty()) return 0;
+    const GmPackageDataExtent & extent = m_extentList.last();
+    return extent.dataPosition + extent.length;
+}
+
+const QList<GmPackageDataExtent> & GmPackageSparseMap::getExtentList() const
+{
+    return m_extentList;
+}
+
+int GmPackageSparseMap::findExtent(qint64 offset) const
+{
+    // binary search of sorted extents
+    int low = 0;
+    int high = m_extentList.size();
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        const GmPackageDataExtent & extent = m_extentList.at(middle);
+        if (extent.offset + extent.length <= offset) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+QByteArray GmPackageSparseMap::gather(const char *data) const
+{
+    QByteArray extentData;
+    qint64 extentDataLength = getExtentDataLength();
+    if (data == NULL || extentDataLength > 0x7FFFFFFF) return extentData;
+
+    extentData.resize((int) extentDataLength);
+    for (int i = 0; i < m_extentList.size(); i++) {
+        const GmPackageDataExtent & extent = m_extentList.at(i);
+        memcpy(extentData.data() + extent.dataPosition, data + extent.offset, (size_t) extent.length);
+    }
+    return extentData;
+}
+
+bool GmPackageSparseMap::scatter(const char *extentData, qint64 extentDataLength, char *data, qint64 dataLength) const
+{
+    if (extentDataLength != getExtentDataLength() || dataLength != m_originalDataLength) return false;
+
+    qint64 offset = 0;
+    for (int i = 0; i < m_extentList.size(); i++) {
+        const GmPackageDataExtent & extent = m_extentList.at(i);
+        memset(data + offset, 0, (size_t) (extent.offset - offset));
+        memcpy(data + extent.offset, extentData + extent.dataPosition, (size_t) extent.length);
+        offset = extent.offset + extent.length;
+    }
+    memset(data + offset, 0, (size_t) (dataLength - offset));
+    return true;
+}
+
+void GmPackageSparseMap::appendExtent(qint64 offset, qint64 length)
+{
+    GmPackageDataExtent extent;
+    extent.offset = offset;
+    extent.length = length;
+    extent.dataPosition = getExtentDataLength();
+    m_extentList.append(extent);
+}
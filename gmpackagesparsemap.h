@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+
+// range of data which isn't a hole
+struct GmPackageDataExtent
+{
+    qint64 offset; // offset in original data
+    qint64 length;
+    qint64 dataPosition; // position in concatenated data of extents
+};
+
+Q_DECLARE_TYPEINFO(GmPackageDataExtent, Q_PRIMITIVE_TYPE);
+
+// sparse map of data block (version >= 11), a run of zero bytes of at least MinHoleSize is a hole,
+// only data of extents between holes is stored and compressed. holes are whole blocks of BlockSize
+// aligned in original data, so a file system can leave them unallocated when the data is written.
+// serialized map, little endian: [qint64], original data length, [qint32], extent number,
+// [qint64], offset, [qint64], length of every extent, extents are sorted and don't overlap
+class GmPackageSparseMap
+{
+public:
+    static const qint64 BlockSize = 4096;
+    static const qint64 MinHoleSize = 64 * 1024;
+    static const int HeaderSize = 12;
+    static const int ExtentRecordSize = 16;
+
+    GmPackageSparseMap();
+
+    // find holes of data, the map has one extent of all data if there is no hole
+    static GmPackageSparseMap fromData(const char *data, qint64 dataLength);
+    // size of serialized map from its header of HeaderSize bytes, -1 if it is invalid
+    static qint64 getSerializedSize(const char *header);
+
+    // read serialized map from head of data, return false if it is truncated or invalid
+    bool read(const char *data, qint64 dataLength);
+    QByteArray toByteArray() const;
+    qint64 getSerializedSize() const;
+
+    bool hasHole() const;
+    qint64 getOriginalDataLength() const;
+    // length of concatenated data of extents
+    qint64 getExtentDataLength() const;
+    const QList<GmPackageDataExtent> & getExtentList() const;
+    // index of the first extent which ends after offset, extent number if there is none
+    int findExtent(qint64 offset) const;
+
+    // concatenate data of extents from original data
+    QByteArray gather(const char *data) const;
+    // copy concatenated data of extents to original data, holes are filled with zero
+    bool scatter(const char *extentData, qint64 extentDataLength, char *data, qint64 dataLength) const;
+
+private:
+    void appendExtent(qint64 offset, qint64 length);
+
+private:
+    qint64 m_originalDataLength;
+    QList<GmPackageDataExtent> m_extentList;
+};
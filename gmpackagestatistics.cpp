@@ -0,0 +1,124 @@
+#include "gmpackagestatistics.h"
+
+#include <QMutexLocker>
+#include <QStringList>
+
+void GmPackageStatisticsCounter::add(qint64 value)
+{
+#if QT_VERSION >= 0x050300
+    m_value.fetchAndAddRelaxed(value);
+#else
+    QMutexLocker locker(&m_mutex);
+    m_value += value;
+#endif
+}
+
+qint64 GmPackageStatisticsCounter::load() const
+{
+#if QT_VERSION >= 0x050E00
+    return m_value.loadRelaxed();
+#elif QT_VERSION >= 0x050300
+    return m_value.load();
+#else
+    QMutexLocker locker(&m_mutex);
+    return m_value;
+#endif
+}
+
+void GmPackageStatisticsCounter::store(qint64 value)
+{
+#if QT_VERSION >= 0x050E00
+    m_value.storeRelaxed(value);
+#elif QT_VERSION >= 0x050300
+    m_value.store(value);
+#else
+    QMutexLocker locker(&m_mutex);
+    m_value = value;
+#endif
+}
+
+GmPackageStatistics::GmPackageStatistics()
+{
+    clear();
+}
+
+GmPackageStatistics::GmPackageStatistics(const GmPackageStatistics & other)
+{
+    clear();
+    add(other);
+}
+
+GmPackageStatistics & GmPackageStatistics::operator=(const GmPackageStatistics & other)
+{
+    if (this == &other) return *this;
+    clear();
+    add(other);
+    return *this;
+}
+
+void GmPackageStatistics::add(int phase, qint64 nsecs, qint64 bytes, qint64 count)
+{
+    if (phase < 0 || phase >= PhaseCount) return;
+    m_nsecs[phase].add(nsecs);
+    m_bytes[phase].add(bytes);
+    m_count[phase].add(count);
+}
+
+void GmPackageStatistics::add(const GmPackageStatistics & other)
+{
+    if (this == &other) return;
+    for (int i = 0; i < PhaseCount; i++) {
+        m_nsecs[i].add(other.m_nsecs[i].load());
+        m_bytes[i].add(other.m_bytes[i].load());
+        m_count[i].add(other.m_count[i].load());
+    }
+}
+
+void GmPackageStatistics::clear()
+{
+    for (int i = 0; i < PhaseCount; i++) {
+        m_nsecs[i].store(0);
+        m_bytes[i].store(0);
+        m_count[i].store(0);
+    }
+}
+
+qint64 GmPackageStatistics::getNsecs(int phase) const
+{
+    if (phase < 0 || phase >= PhaseCount) return 0;
+    return m_nsecs[phase].load();
+}
+
+qint64 GmPackageStatistics::getBytes(int phase) const
+{
+    if (phase < 0 || phase >= PhaseCount) return 0;
+    return m_bytes[phase].load();
+}
+
+qint64 GmPackageStatistics::getCount(int phase) const
+{
+    if (phase < 0 || phase >= PhaseCount) return 0;
+    return m_count[phase].load();
+}
+
+QString GmPackageStatistics::getPhaseName(int phase)
+{
+    static const char *phaseNames[PhaseCount] = {
+        "scan", "file_read", "compress", "encrypt", "write", "index_save",
+        "index_load", "package_read", "decrypt", "uncompress", "checksum", "file_write"
+    };
+    if (phase < 0 || phase >= PhaseCount) return QString();
+    return QString(phaseNames[phase]);
+}
+
+QString GmPackageStatistics::toJson() const
+{
+    QStringList phaseList;
+    for (int i = 0; i < PhaseCount; i++) {
+        qint64 count = m_count[i].load();
+        if (count == 0) continue;
+        phaseList.append(QString("\"%1\":{\"nsecs\":%2,\"bytes\":%3,\"count\":%4}")
+                .arg(getPhaseName(i)).arg(m_nsecs[i].load()).arg(m_bytes[i].load()).arg(count));
+    }
+    return QString("{") + phaseList.join(",") + QString("}");
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <QString>
+#include <QMutex>
+#include <QMetaType>
+#include <QElapsedTimer>
+#if QT_VERSION >= 0x050300
+#include <QAtomicInteger>
+#endif
+
+// counter of statistics, it is atomic on Qt 5.3 or later, otherwise it is locked by its own mutex
+class GmPackageStatisticsCounter
+{
+public:
+    GmPackageStatisticsCounter() : m_value(0) { }
+
+    void add(qint64 value);
+    qint64 load() const;
+    void store(qint64 value);
+
+private:
+    GmPackageStatisticsCounter(const GmPackageStatisticsCounter &);
+    GmPackageStatisticsCounter & operator=(const GmPackageStatisticsCounter &);
+
+private:
+#if QT_VERSION >= 0x050300
+    QAtomicInteger<qint64> m_value;
+#else
+    qint64 m_value;
+    mutable QMutex m_mutex;
+#endif
+};
+
+// per-phase counters of package build, install and read,
+// every phase has cumulative time in nanoseconds, processed bytes and number of calls (found files for scan).
+// counters are updated by many threads of parallel install and batched read, every counter is updated
+// atomically without a lock shared by phases, counters of one phase aren't read as one snapshot
+class GmPackageStatistics
+{
+public:
+    enum Phase {
+        ScanPhase = 0,        // scan source directories
+        FileReadPhase,        // read source files
+        CompressPhase,        // compress data blocks
+        EncryptPhase,         // encrypt stored data blocks
+        WritePhase,           // write stored data blocks to package or data volumes
+        IndexSavePhase,       // serialize, compress and save file information
+        IndexLoadPhase,       // load and uncompress file information
+        PackageReadPhase,     // read stored data blocks from package or data volumes
+        DecryptPhase,         // decrypt stored data blocks
+        UncompressPhase,      // uncompress data blocks
+        ChecksumPhase,        // checksum and manifest hashes of stored data blocks
+        FileWritePhase,       // write installed files, by all writer threads
+        PhaseCount
+    };
+
+    GmPackageStatistics();
+    GmPackageStatistics(const GmPackageStatistics & other);
+    GmPackageStatistics & operator=(const GmPackageStatistics & other);
+
+    // add time, bytes and calls to phase
+    void add(int phase, qint64 nsecs, qint64 bytes = 0, qint64 count = 1);
+    // add all counters of other statistics
+    void add(const GmPackageStatistics & other);
+    void clear();
+
+    qint64 getNsecs(int phase) const;
+    qint64 getBytes(int phase) const;
+    qint64 getCount(int phase) const;
+    static QString getPhaseName(int phase);
+
+    // one JSON object, phases without calls are omitted, for example
+    // {"compress":{"nsecs":1200,"bytes":4096,"count":1},"write":{...}}
+    // nsecs of a phase run by many threads (uncompress, file write, ...) is summed over the threads,
+    // so it can be more than wall time of install
+    QString toJson() const;
+
+private:
+    GmPackageStatisticsCounter m_nsecs[PhaseCount];
+    GmPackageStatisticsCounter m_bytes[PhaseCount];
+    GmPackageStatisticsCounter m_count[PhaseCount];
+};
+
+Q_DECLARE_METATYPE(GmPackageStatistics)
+
+// time a scope and add it to phase of statistics when the scope ends, nothing is done if statistics is NULL
+class GmPackageStatisticsTimer
+{
+public:
+    GmPackageStatisticsTimer(GmPackageStatistics *statistics, int phase, qint64 bytes = 0)
+        : m_statistics(statistics), m_phase(phase), m_bytes(bytes)
+    {
+        if (m_statistics) m_timer.start();
+    }
+
+    ~GmPackageStatisticsTimer()
+    {
+        if (m_statistics) m_statistics->add(m_phase, m_timer.nsecsElapsed(), m_bytes);
+    }
+
+    // bytes known only at the end of the scope
+    void setBytes(qint64 bytes) { m_bytes = bytes; }
+
+private:
+    GmPackageStatistics *m_statistics;
+    int m_phase;
+    qint64 m_bytes;
+    QElapsedTimer m_timer;
+};
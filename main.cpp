@@ -6,12 +6,14 @@
  */
 
 #include <QtGui/QApplication>
+#include <QFile>
 #include <QFileInfo>
 #include <QTextStream>
 
 #include "gmpackagemanager.h"
 #include "gmpackagebuilder.h"
 #include "gmpackageinstaller.h"
+#include "encrypt_rc4.h"
 
 void printUsage(char *app)
 {
@@ -23,6 +25,43 @@ void printUsage(char *app)
     out << "Usage: " << "\n";
     out << "    Build   package: " << appFilename << " -b PackageName SourceDirName[1]...SourceDirName[n]" << "\n";
     out << "    Install package: " << appFilename << " -i InstallDirName [PackageName]" << "\n";
+    out << "    Verify  package: " << appFilename << " -v PackageName [FileName ...]" << "\n";
+    out << "    Encrypt file   : " << appFilename << " -e SourceFile DestFile [KeyFile]" << "\n";
+    out << "    Decrypt file encrypted by old versions: " << appFilename << " -E SourceFile DestFile [KeyFile]" << "\n";
+    out << "    Encrypt package data while it is built, installed or verified: " << appFilename << " -k KeyFile -b|-i|-v ..." << "\n";
+    out << "    Output JSON statistics of build, install or verify phases ('-' is stderr): " << appFilename << " -j JsonFile -b|-i|-v ..." << "\n";
+    out << "    Output JSON lines of build or install progress ('-' is stderr): " << appFilename << " -p ProgressFile -b|-i ..." << "\n";
+    out << "    Store data of files of same data once while package is built: " << appFilename << " -d -b ..." << "\n";
+    out << "    Install files of same data by write, clone or hard link (default write): " << appFilename << " -l write|clone|link -i ..." << "\n";
+    out.flush();
+}
+
+// open output file of JSON lines, '-' is stderr, so JSON isn't mixed with information printed to stdout
+bool openOutputFile(QFile & file, const QString & filename)
+{
+    bool ok = false;
+    if (filename == QString("-")) {
+        ok = file.open(stderr, QIODevice::WriteOnly | QIODevice::Unbuffered);
+    } else {
+        file.setFileName(filename);
+        ok = file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered);
+    }
+    if (!ok) {
+        QByteArray ba = filename.toLocal8Bit();
+        printf("Opens output file %s failure.\n", ba.data());
+    }
+    return ok;
+}
+
+// output statistics as one JSON line, empty filename outputs nothing
+void writeStatistics(const QString & statisticsFilename, const GmPackageStatistics & statistics)
+{
+    if (statisticsFilename.isEmpty()) return;
+
+    QFile file;
+    if (!openOutputFile(file, statisticsFilename)) return;
+    QTextStream out(&file);
+    out << statistics.toJson() << "\n";
     out.flush();
 }
 
@@ -32,12 +71,9 @@ void buildPackage(const QString & packageName, const QString & sourceDirName)
     out << "Source Dir Name: " << sourceDirName << "\n";
     out.flush();
 
-    QStringList fileList;
-    GmPackageBuilder::getFileList(sourceDirName, fileList);
-
     bool printInfo = false;
-    GmPackageBuilder builder(sourceDirName, fileList);
-    bool ok = builder.buildPackage(packageName, printInfo);
+    GmPackageBuilder builder;
+    bool ok = builder.buildPackageFromDir(sourceDirName, packageName, printInfo);
 
     // print error message
     if (!ok) {
@@ -53,7 +89,8 @@ void buildPackage(const QString & packageName, const QString & sourceDirName)
     out.flush();
 }
 
-void buildPackage(const QString & packageName, const QStringList & sourceDirNameList)
+void buildPackage(const QString & packageName, const QStringList & sourceDirNameList, const QByteArray & userKey,
+        const QString & statisticsFilename, const QString & progressFilename, bool deduplicateFlag)
 {
     if (sourceDirNameList.size() == 0) return;
 
@@ -74,22 +111,21 @@ void buildPackage(const QString & packageName, const QStringList & sourceDirName
     bool printInfo = false;
     bool ok = false;
     GmPackageBuilder builder;
+    builder.setEncryptionKey(userKey);
+    builder.setDeduplicateMode(deduplicateFlag);
+    QFile progressFile;
+    if (!progressFilename.isEmpty() && openOutputFile(progressFile, progressFilename)) builder.setProgressDevice(&progressFile);
     for (int i = 0; i < sourceDirNameList.size(); i++) {
         QString sourceDirName;
         QStringList fileList;
         if (i == 0) {
             sourceDirName = sourceDirNameList.at(i);
-            GmPackageBuilder::getFileList(sourceDirName, fileList);
-            ok = builder.setFileList(sourceDirName, fileList);
-            if (!ok) {
-                failureSourceDirList << sourceDirName;
-                continue;
-            }
             if (printInfo) {
                 out << "Building Source Dir: " << sourceDirName << " ...\n";
                 out.flush();
             }
-            ok = builder.buildPackage(packageName, printInfo);
+            // files are output in sorted order after the source dir is scanned
+            ok = builder.buildPackageFromDir(sourceDirName, packageName, printInfo);
             if (!ok) failureSourceDirList << sourceDirName;
         } else {
             sourceDirName = sourceDirNameList.at(i);
@@ -121,9 +157,11 @@ void buildPackage(const QString & packageName, const QStringList & sourceDirName
         }
     }
     out.flush();
+    writeStatistics(statisticsFilename, builder.getStatistics());
 }
 
-void installPackage(const QString & installDirName, const QString & packageName)
+void installPackage(const QString & installDirName, const QString & packageName, const QByteArray & userKey,
+        const QString & statisticsFilename, const QString & progressFilename, int duplicateMode)
 {
     QTextStream out(stdout);
     out << "InstallDirName: " << installDirName << "\n";
@@ -131,6 +169,10 @@ void installPackage(const QString & installDirName, const QString & packageName)
 
     bool printInfo = true;
     GmPackageInstaller installer(installDirName);
+    installer.setEncryptionKey(userKey);
+    installer.setDuplicateMode(duplicateMode);
+    QFile progressFile;
+    if (!progressFilename.isEmpty() && openOutputFile(progressFile, progressFilename)) installer.setProgressDevice(&progressFile);
     bool ok = installer.installPackage(packageName, printInfo);
     // print error message
     if (!ok) {
@@ -145,45 +187,112 @@ void installPackage(const QString & installDirName, const QString & packageName)
         out << "Install Success!" << "\n";
     }
     out.flush();
+    writeStatistics(statisticsFilename, installer.getStatistics());
 }
 
-extern void encrypt(char *sourcefile, char *destfile, char *key0);
-int readkey(char *keyfile, char *key);
+void verifyPackage(const QString & packageName, const QStringList & filenames, const QByteArray & userKey,
+        const QString & statisticsFilename)
+{
+    QTextStream out(stdout);
+
+    bool printInfo = true;
+    GmPackageInstaller installer;
+    installer.setEncryptionKey(userKey);
+    bool ok = installer.verifyPackage(packageName, filenames, printInfo);
+    // print error message
+    if (!ok) {
+        const QStringList &msgList = installer.getErrorMessage();
+        for (int i = 0; i < msgList.size(); i++) {
+            out << "  " << msgList.at(i) << "\n";
+        }
+        out << "Verify failure!" << "\n";
+    } else {
+        out << "Verify success!" << "\n";
+    }
+    out.flush();
+    writeStatistics(statisticsFilename, installer.getStatistics());
+}
 
 int main(int argc, char *argv[])
 {
     printf("argc = %d\n", argc);
 
+    // key file of package encryption, statistics file, progress file, deduplicate and duplicate modes are before command
+    QByteArray userKey;
+    QString statisticsFilename, progressFilename;
+    bool deduplicateFlag = false;
+    int duplicateMode = GmPackageInstaller::DuplicateWriteMode;
+    while (argc >= 3 && (QString(argv[1]) == QString("-k") || QString(argv[1]) == QString("-j") || QString(argv[1]) == QString("-p")
+            || QString(argv[1]) == QString("-l") || QString(argv[1]) == QString("-d"))) {
+        if (QString(argv[1]) == QString("-d")) {
+            deduplicateFlag = true;
+            argv[1] = argv[0];
+            argv += 1;
+            argc -= 1;
+            continue;
+        } else if (QString(argv[1]) == QString("-k")) {
+            char key[256] = "";
+            if (readkey(argv[2], key) != 0 || key[0] == '\0') {
+                printf("Reads key file %s failure.\n", argv[2]);
+                return 1;
+            }
+            userKey = QByteArray(key);
+        } else if (QString(argv[1]) == QString("-l")) {
+            QString mode(argv[2]);
+            if (mode == QString("write")) {
+                duplicateMode = GmPackageInstaller::DuplicateWriteMode;
+            } else if (mode == QString("clone")) {
+                duplicateMode = GmPackageInstaller::DuplicateCloneMode;
+            } else if (mode == QString("link")) {
+                duplicateMode = GmPackageInstaller::DuplicateHardLinkMode;
+            } else {
+                printf("Duplicate mode %s is unknown.\n", argv[2]);
+                return 1;
+            }
+        } else if (QString(argv[1]) == QString("-j")) {
+            statisticsFilename = QString::fromLocal8Bit(argv[2]);
+        } else {
+            progressFilename = QString::fromLocal8Bit(argv[2]);
+        }
+        argv[2] = argv[0];
+        argv += 2;
+        argc -= 2;
+    }
+
     if (argc < 3) {
         printUsage(argv[0]);
         return 0;
     }
 
-    QString optb("-b"), opti("-i"), opte("-e");
+    QString optb("-b"), opti("-i"), opte("-e"), optE("-E"), optv("-v");
     QString opt(argv[1]);
     if (opt == optb) {
         if (argc >= 4) {
             QString packageName(argv[2]);
             QStringList sourceDirNameList;
             for (int i = 3; i < argc; i++) sourceDirNameList << argv[i];
-            buildPackage(packageName, sourceDirNameList);
+            buildPackage(packageName, sourceDirNameList, userKey, statisticsFilename, progressFilename, deduplicateFlag);
         } else {
             printUsage(argv[0]);
         }
     } else if (opt == opti) {
         if (argc == 4) {
-            installPackage(argv[2], argv[3]);
+            installPackage(argv[2], argv[3], userKey, statisticsFilename, progressFilename, duplicateMode);
         } else {
             printUsage(argv[0]);
         }
-    } else if (opt == opte) {
+    } else if (opt == optv) {
+        QStringList filenames;
+        for (int i = 3; i < argc; i++) filenames << argv[i];
+        verifyPackage(argv[2], filenames, userKey, statisticsFilename);
+    } else if (opt == opte || opt == optE) {
         if (argc >= 4) {
             char key[256] = "";
             if (argc > 4) {
                 char *keyfile = argv[4];
                 readkey(keyfile, key);
             }
-            encrypt(argv[2], argv[3], key);
+            encrypt(argv[2], argv[3], key, opt == optE);
         } else {
             printUsage(argv[0]);
         }
@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# tests of package cipher by RFC 8439 test vectors
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+TARGET = gmpackagetest
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES += main.cpp \
+    ../gmpackagecipher.cpp
+
+HEADERS += \
+    ../gmpackagecipher.h
@@ -0,0 +1,78 @@
+/*
+ * tests of package cipher by ChaCha20 test vectors of RFC 8439,
+ * results are printed on stdout, exit code is the number of failed tests
+ */
+
+#include <QCoreApplication>
+#include <QByteArray>
+#include <QTextStream>
+
+#include "gmpackagecipher.h"
+
+// RFC 8439 key 00:01:02:...:1f of all test vectors
+static QByteArray getTestKey()
+{
+    QByteArray key;
+    for (int i = 0; i < GmPackageCipher::KeySize; i++) key.append((char) i);
+    return key;
+}
+
+static int checkData(const QString & name, const QByteArray & data, const QByteArray & expectedData)
+{
+    QTextStream out(stdout);
+    if (data == expectedData) {
+        out << "PASS " << name << "\n";
+        return 0;
+    }
+    out << "FAIL " << name << "\n";
+    out << "    expected " << expectedData.toHex() << "\n";
+    out << "    actual   " << data.toHex() << "\n";
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    GmPackageCipher cipher;
+    cipher.setMode(GmPackageCipher::ChaCha20Mode);
+    cipher.setKey(getTestKey());
+    int failCount = 0;
+
+    // nonce of cipher is [volume][position low 32 bits][position high 32 bits] in little endian words,
+    // block counter is offset / 64
+
+    // 2.3.2, block function, nonce 00:00:00:09:00:00:00:4a:00:00:00:00, block counter 1
+    QByteArray blockData = QByteArray::fromHex(
+            "10f1e7e4d13b5915500fdd1fa32071c4c7d1f4c733c068030422aa9ac3d46c4e"
+            "d2826446079faa0914c2d705d98b02a2b5129cd1de164eb9cbd083e8a2503c4e");
+    QByteArray keyStream(64, '\0');
+    cipher.process(keyStream.data(), keyStream.size(), 0x09000000, 0x4a000000, 64);
+    failCount += checkData("block function", keyStream, blockData);
+
+    // the same block in key stream of many blocks, which are generated four at a time by SSE2
+    keyStream = QByteArray(64 * 9, '\0');
+    cipher.process(keyStream.data(), keyStream.size(), 0x09000000, 0x4a000000);
+    failCount += checkData("block function of many blocks", keyStream.mid(64, 64), blockData);
+
+    // 2.4.2, encryption, nonce 00:00:00:00:00:00:00:4a:00:00:00:00, initial block counter 1
+    QByteArray plainData("Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+            "for the future, sunscreen would be it.");
+    QByteArray cipherData = QByteArray::fromHex(
+            "6e2e359a2568f98041ba0728dd0d6981e97e7aec1d4360c20a27afccfd9fae0b"
+            "f91b65c5524733ab8f593dabcd62b3571639d624e65152ab8f530c359f0861d8"
+            "07ca0dbf500d6a6156a38e088a22b65e52bc514d16ccf806818ce91ab7793736"
+            "5af90bbf74a35be6b40b8eedf2785e42874d");
+    QByteArray data = plainData;
+    cipher.process(data.data(), data.size(), 0, 0x4a000000, 64);
+    failCount += checkData("encryption", data, cipherData);
+
+    // streaming reads decrypt from any offset in data block
+    data = cipherData;
+    int splitLength = 37;
+    cipher.process(data.data(), splitLength, 0, 0x4a000000, 64);
+    cipher.process(data.data() + splitLength, data.size() - splitLength, 0, 0x4a000000, 64 + splitLength);
+    failCount += checkData("decryption from offset", data, plainData);
+
+    return failCount;
+}